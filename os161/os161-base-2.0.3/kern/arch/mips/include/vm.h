@@ -114,13 +114,16 @@ paddr_t ram_getfirstfree(void);
  * TLB shootdown bits.
  *
  * We'll take up to 16 invalidations before just flushing the whole TLB.
+ *
+ * dumbvm only ever flushes the whole TLB. If ts_done is not NULL, the
+ * target CPU does V() on it once its TLB is clean, so the sender can
+ * wait for that before reusing the frames.
  */
 
+struct semaphore;
+
 struct tlbshootdown {
-	/*
-	 * Change this to what you need for your VM design.
-	 */
-	int ts_placeholder;
+	struct semaphore *ts_done;
 };
 
 #define TLBSHOOTDOWN_MAX 16
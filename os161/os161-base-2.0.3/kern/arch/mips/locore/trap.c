@@ -114,15 +114,14 @@ kill_curthread(vaddr_t epc, unsigned code, vaddr_t vaddr)
 	 * You will probably want to change this.
 	 */
 	#if OPT_SHELL
-	curproc->p_exited = 1;
+	/* same as sys__exit, so that the parent gets to see the status */
+	proc_vfork_release(curproc, true);
 	if(sig == SIGSEGV){
-		curproc->p_status = _MKWAIT_CORE(sig);
+		proc_exit(_MKWAIT_CORE(sig));
 	}
 	else{
-		curproc->p_status = _MKWAIT_SIG(sig);
+		proc_exit(_MKWAIT_SIG(sig));
 	}
-
-	thread_exit();
 	#endif
 
 	//should not return
@@ -209,6 +208,14 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+#if OPT_SHELL
+		if (!iskern && curproc->p_exiting) {
+			/* as at done, once the interrupt state is back */
+			spl = splhigh();
+			splx(spl);
+			proc_exit_thread();
+		}
+#endif
 		goto done2;
 	}
 
@@ -329,6 +336,15 @@ mips_trap(struct trapframe *tf)
 	panic("I can't handle this... I think I'll just die now...\n");
 
  done:
+#if OPT_SHELL
+	/*
+	 * Another thread of the process has called _exit (or died):
+	 * leave instead of going back to user mode.
+	 */
+	if (!iskern && curproc->p_exiting) {
+		proc_exit_thread();
+	}
+#endif
 	/*
 	 * Turn interrupts off on the processor, without affecting the
 	 * stored interrupt state.
@@ -37,6 +37,8 @@
 #include <addrspace.h>
 #include <syscall.h>
 #include <copyinout.h>
+#include <clock.h>
+#include <sysstat.h>
 
 #if OPT_SHELL
 #define MAKE_64BITS(x,y) (((int64_t)x) << 32 | y)
@@ -88,9 +90,11 @@ syscall(struct trapframe *tf)
 	int callno;
 	int32_t retval;
 	int err = 0;
+	struct timespec start;
 #if OPT_SHELL
 	int64_t retval64;
 	int extra_param;
+	off_t extra_off;
 	bool ret64 = false;
 #endif
 
@@ -100,6 +104,9 @@ syscall(struct trapframe *tf)
 
 	callno = tf->tf_v0;
 
+	gettime(&start);
+	sysstat_enter(callno);
+
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
 	 * really return a value, just 0 for success and -1 on
@@ -121,6 +128,16 @@ syscall(struct trapframe *tf)
 				 (userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_nanosleep:
+		err = sys_nanosleep((userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_sysstat:
+		err = sys_sysstat((userptr_t)tf->tf_a0,
+				  (unsigned)tf->tf_a1, &retval);
+		break;
+
 	    /* Add stuff here */
 #if OPT_SHELL
 
@@ -135,8 +152,7 @@ syscall(struct trapframe *tf)
             break;
 
         case SYS_remove:
-	      	/* just ignore: do nothing */
-	        retval = 0;
+	        retval = sys_remove((userptr_t)tf->tf_a0, &err);
             break;
 
 	    case SYS_write:
@@ -170,6 +186,15 @@ syscall(struct trapframe *tf)
 	        err = sys_fork(tf, &retval);
             break;
 
+	    case SYS_vfork:
+	        err = sys_vfork(tf, &retval);
+            break;
+
+	    case SYS_spawn:
+	        err = sys_spawn((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1,
+	            (userptr_t)tf->tf_a2, (int)tf->tf_a3, &retval);
+            break;
+
 		case SYS___getcwd:
 			retval = sys___getcwd((userptr_t)tf->tf_a0, (size_t)tf->tf_a1, &err);
 			break;
@@ -209,6 +234,61 @@ syscall(struct trapframe *tf)
 				(size_t)tf->tf_a2, &err);
 			break;
 
+		case SYS_getdents:
+			retval = sys_getdents((int)tf->tf_a0,
+				(userptr_t)tf->tf_a1,
+				(size_t)tf->tf_a2, &err);
+			break;
+
+		case SYS_pipe:
+			retval = sys_pipe((userptr_t)tf->tf_a0, &err);
+			break;
+
+		case SYS_mmap:
+			/* fd and the (64-bit, aligned) offset are on the stack */
+			err = copyin((userptr_t)(tf->tf_sp + 16), &extra_param, sizeof(int));
+			if(err)
+				break;
+			err = copyin((userptr_t)(tf->tf_sp + 24), &extra_off, sizeof(off_t));
+			if(err)
+				break;
+			retval = (int)sys_mmap((vaddr_t)tf->tf_a0,
+				(size_t)tf->tf_a1, (int)tf->tf_a2, (int)tf->tf_a3,
+				(int)extra_param, extra_off, &err);
+			break;
+
+		case SYS_ftruncate:
+			retval = sys_ftruncate((int)tf->tf_a0,
+				(off_t) MAKE_64BITS(tf->tf_a2, tf->tf_a3), &err);
+			break;
+
+		case SYS_munmap:
+			retval = sys_munmap((vaddr_t)tf->tf_a0,
+				(size_t)tf->tf_a1, &err);
+			break;
+
+		case SYS___thread_create:
+			err = sys_thread_create(tf, (vaddr_t)tf->tf_a0,
+				(vaddr_t)tf->tf_a1, (vaddr_t)tf->tf_a2, &retval);
+			break;
+
+		case SYS___thread_exit:
+			sys_thread_exit((userptr_t)tf->tf_a0);
+			break;
+
+		case SYS___thread_join:
+			err = sys_thread_join((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+			break;
+
+		case SYS___futex_wait:
+			err = sys_futex_wait((userptr_t)tf->tf_a0, (int)tf->tf_a1);
+			break;
+
+		case SYS___futex_wake:
+			retval = sys_futex_wake((userptr_t)tf->tf_a0,
+				(int)tf->tf_a1, &err);
+			break;
+
 #endif
 
 	    default:
@@ -217,6 +297,7 @@ syscall(struct trapframe *tf)
 		break;
 	}
 
+	sysstat_exit(callno, err, &start);
 
 	if (err) {
 		/*
@@ -286,3 +367,19 @@ enter_forked_process(struct trapframe *tf)
 	(void)tf;
 #endif
 }
+
+/*
+ * Enter user mode for a new thread of the current process. TF already
+ * holds the thread's entry point, argument and stack pointer.
+ */
+void
+enter_new_thread(struct trapframe *tf)
+{
+	struct trapframe newTf = *tf; // copy trap frame onto kernel stack
+
+	kfree(tf);
+
+	as_activate();
+
+	mips_usermode(&newTf);
+}
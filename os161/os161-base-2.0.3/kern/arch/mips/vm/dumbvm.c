@@ -33,11 +33,17 @@
 #include <spl.h>
 #include <cpu.h>
 #include <spinlock.h>
+#include <synch.h>
 #include <proc.h>
 #include <current.h>
 #include <mips/tlb.h>
 #include <addrspace.h>
 #include <vm.h>
+#include <uio.h>
+#include <vnode.h>
+#include <shm.h>
+#include <vmtext.h>
+#include <kern/mman.h>
 
 /*
  * Dumb MIPS-only "VM system" that is intended to only be just barely
@@ -75,13 +81,23 @@ static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
 int 
 is_valid_pointer(userptr_t addr, struct addrspace *as){
   unsigned int pointer = (unsigned int) addr;
+  struct vm_mapping *m;
   if (pointer >= MIPS_KSEG0)
     return 0;
-  if(!(((pointer >= as->as_vbase1) && (pointer < as->as_vbase1 + PAGE_SIZE*as->as_npages1))||
+  if(((pointer >= as->as_vbase1) && (pointer < as->as_vbase1 + PAGE_SIZE*as->as_npages1))||
   ((pointer >= as->as_vbase2) && (pointer < as->as_vbase2 + PAGE_SIZE*as->as_npages2))||
-  (pointer>=MIPS_KSEG0 - PAGE_SIZE*DUMBVM_STACKPAGES)))
-    return 0;
-  return 1;
+  (pointer>=MIPS_KSEG0 - PAGE_SIZE*DUMBVM_STACKPAGES))
+    return 1;
+  /* mmap'ed areas */
+  lock_acquire(as->as_lock);
+  for (m = as->as_mappings; m != NULL; m = m->vm_next) {
+    if (pointer >= m->vm_vbase && pointer < m->vm_vbase + PAGE_SIZE*m->vm_npages) {
+      lock_release(as->as_lock);
+      return 1;
+    }
+  }
+  lock_release(as->as_lock);
+  return 0;
 }
 #endif
 
@@ -89,7 +105,7 @@ is_valid_pointer(userptr_t addr, struct addrspace *as){
 
 /* G.Cabodi - support for free/alloc */
 
-static struct spinlock freemem_lock = SPINLOCK_INITIALIZER;
+static struct ticketlock freemem_lock = TICKETLOCK_INITIALIZER;
 
 static unsigned char *freeRamFrames = NULL;
 static unsigned long *allocSize = NULL;
@@ -99,9 +115,9 @@ static int allocTableActive = 0;
 
 static int isTableActive () {
   int active;
-  spinlock_acquire(&freemem_lock);
+  ticketlock_acquire(&freemem_lock);
   active = allocTableActive;
-  spinlock_release(&freemem_lock);
+  ticketlock_release(&freemem_lock);
   return active;
 }
 
@@ -109,6 +125,9 @@ void
 vm_bootstrap(void)
 {
   int i;
+#if OPT_SHELL
+  text_bootstrap();
+#endif
   nRamFrames = ((int)ram_getsize())/PAGE_SIZE;  
   /* alloc freeRamFrame and allocSize */  
   freeRamFrames = kmalloc(sizeof(unsigned char)*nRamFrames);
@@ -122,9 +141,9 @@ vm_bootstrap(void)
     freeRamFrames[i] = (unsigned char)0;
     allocSize[i]     = 0;  
   }
-  spinlock_acquire(&freemem_lock);
+  ticketlock_acquire(&freemem_lock);
   allocTableActive = 1;
-  spinlock_release(&freemem_lock);
+  ticketlock_release(&freemem_lock);
 }
 
 /*
@@ -152,7 +171,7 @@ getfreeppages(unsigned long npages) {
   long i, first, found, np = (long)npages;
 
   if (!isTableActive()) return 0; 
-  spinlock_acquire(&freemem_lock);
+  ticketlock_acquire(&freemem_lock);
   for (i=0,first=found=-1; i<nRamFrames; i++) {
     if (freeRamFrames[i]) {
       if (i==0 || !freeRamFrames[i-1]) 
@@ -175,7 +194,7 @@ getfreeppages(unsigned long npages) {
     addr = 0;
   }
 
-  spinlock_release(&freemem_lock);
+  ticketlock_release(&freemem_lock);
 
   return addr;
 }
@@ -194,9 +213,9 @@ getppages(unsigned long npages)
     spinlock_release(&stealmem_lock);
   }
   if (addr!=0 && isTableActive()) {
-    spinlock_acquire(&freemem_lock);
+    ticketlock_acquire(&freemem_lock);
     allocSize[addr/PAGE_SIZE] = npages;
-    spinlock_release(&freemem_lock);
+    ticketlock_release(&freemem_lock);
   } 
 
   return addr;
@@ -212,12 +231,12 @@ freeppages(paddr_t addr, unsigned long npages){
   KASSERT(allocSize!=NULL);
   KASSERT(nRamFrames>first);
 
-  spinlock_acquire(&freemem_lock);
+  ticketlock_acquire(&freemem_lock);
   for (i=first; i<first+np; i++) {
     freeRamFrames[i] = (unsigned char)1;
   }
   allocSize[first] = 0;
-  spinlock_release(&freemem_lock);
+  ticketlock_release(&freemem_lock);
 
   return 1;
 }
@@ -247,13 +266,441 @@ free_kpages(vaddr_t addr){
   }
 }
 
+/*
+ * Flush this CPU's TLB. Unlike as_activate, this does not depend on
+ * the current thread having an address space.
+ */
+static void
+tlb_flush(void)
+{
+	int i, spl;
+
+	/* Disable interrupts on this CPU while frobbing the TLB. */
+	spl = splhigh();
+	for (i=0; i<NUM_TLB; i++) {
+		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	}
+	splx(spl);
+}
+
 void
 vm_tlbshootdown(const struct tlbshootdown *ts)
 {
-	(void)ts;
-	panic("dumbvm tried to do tlb shootdown?!\n");
+	tlb_flush();
+	if (ts->ts_done != NULL) {
+		V(ts->ts_done);
+	}
+}
+
+#if OPT_SHELL
+
+/*
+ * mmap support. An address space only has a handful of mappings, so
+ * they are kept in an unsorted list. The list, and the frames of the
+ * mappings, are only touched with as_lock held.
+ */
+
+static struct vm_mapping *
+mapping_find(struct addrspace *as, vaddr_t vaddr)
+{
+  struct vm_mapping *m;
+
+  for (m = as->as_mappings; m != NULL; m = m->vm_next) {
+    if (vaddr >= m->vm_vbase && vaddr < m->vm_vbase + m->vm_npages*PAGE_SIZE) {
+      return m;
+    }
+  }
+  return NULL;
+}
+
+static struct vm_mapping *
+mapping_create(vaddr_t vbase, size_t npages, int prot, int flags,
+               struct vnode *vn, off_t offset, struct shm_object *shm)
+{
+  struct vm_mapping *m;
+  size_t i;
+
+  m = kmalloc(sizeof(struct vm_mapping));
+  if (m == NULL) {
+    return NULL;
+  }
+  m->vm_frames = NULL;
+  if (shm == NULL) {
+    m->vm_frames = kmalloc(npages*sizeof(paddr_t));
+    if (m->vm_frames == NULL) {
+      kfree(m);
+      return NULL;
+    }
+    for (i=0; i<npages; i++) {
+      m->vm_frames[i] = 0;
+    }
+  }
+  m->vm_vbase = vbase;
+  m->vm_npages = npages;
+  m->vm_prot = prot;
+  m->vm_flags = flags;
+  m->vm_vn = vn;
+  m->vm_offset = offset;
+  m->vm_shm = shm;
+  m->vm_next = NULL;
+  if (vn != NULL) {
+    VOP_INCREF(vn);
+  }
+  if (shm != NULL) {
+    shm_incref(shm);
+  }
+  return m;
+}
+
+static void
+mapping_destroy(struct vm_mapping *m)
+{
+  size_t i;
+
+  if (m->vm_shm != NULL) {
+    /* the frames belong to the object */
+    shm_decref(m->vm_shm);
+  }
+  else {
+    for (i=0; i<m->vm_npages; i++) {
+      freeppages(m->vm_frames[i], 1);
+    }
+  }
+  if (m->vm_vn != NULL) {
+    VOP_DECREF(m->vm_vn);
+  }
+  kfree(m->vm_frames);
+  kfree(m);
+}
+
+/*
+ * Copy a mapping for fork. Shared mappings keep using the same shm
+ * object. Otherwise pages that can be written are copied; read-only
+ * pages are left out and will be read again from the file if the
+ * child touches them.
+ */
+static int
+mapping_copy(struct vm_mapping *old, struct vm_mapping **ret)
+{
+  struct vm_mapping *new;
+  size_t i;
+
+  new = mapping_create(old->vm_vbase, old->vm_npages, old->vm_prot,
+                       old->vm_flags, old->vm_vn, old->vm_offset,
+                       old->vm_shm);
+  if (new == NULL) {
+    return ENOMEM;
+  }
+  if (old->vm_shm == NULL && (old->vm_prot & PROT_WRITE)) {
+    for (i=0; i<old->vm_npages; i++) {
+      if (old->vm_frames[i] == 0) {
+        continue;
+      }
+      new->vm_frames[i] = getppages(1);
+      if (new->vm_frames[i] == 0) {
+        mapping_destroy(new);
+        return ENOMEM;
+      }
+      memmove((void *)PADDR_TO_KVADDR(new->vm_frames[i]),
+              (const void *)PADDR_TO_KVADDR(old->vm_frames[i]),
+              PAGE_SIZE);
+    }
+  }
+  *ret = new;
+  return 0;
+}
+
+/*
+ * Handle a fault on a mapped page: check the protection and, on the
+ * first access, give the page a frame and fill it.
+ */
+static int
+mapping_fault(struct vm_mapping *m, int faulttype, vaddr_t faultaddress,
+              paddr_t *ret)
+{
+  struct iovec iov;
+  struct uio ku;
+  unsigned idx;
+  paddr_t paddr;
+  vaddr_t kva;
+  int result;
+
+  if (m->vm_prot == PROT_NONE) {
+    return EFAULT;
+  }
+  if (faulttype == VM_FAULT_WRITE && !(m->vm_prot & PROT_WRITE)) {
+    return EFAULT;
+  }
+
+  idx = (faultaddress - m->vm_vbase) / PAGE_SIZE;
+  if (m->vm_shm != NULL) {
+    return shm_getpage(m->vm_shm, m->vm_offset / PAGE_SIZE + idx, ret);
+  }
+  if (m->vm_frames[idx] == 0) {
+    paddr = getppages(1);
+    if (paddr == 0) {
+      return ENOMEM;
+    }
+    kva = PADDR_TO_KVADDR(paddr);
+    if (m->vm_vn == NULL) {
+      bzero((void *)kva, PAGE_SIZE);
+    }
+    else {
+      uio_kinit(&iov, &ku, (void *)kva, PAGE_SIZE,
+                m->vm_offset + (off_t)idx*PAGE_SIZE, UIO_READ);
+      result = VOP_READ(m->vm_vn, &ku);
+      if (result) {
+        freeppages(paddr, 1);
+        return result;
+      }
+      /* the part past the end of the file reads as zeros */
+      bzero((void *)(kva + PAGE_SIZE - ku.uio_resid), ku.uio_resid);
+    }
+    m->vm_frames[idx] = paddr;
+  }
+
+  *ret = m->vm_frames[idx];
+  return 0;
+}
+
+static bool
+range_overlaps(vaddr_t b1, size_t n1, vaddr_t b2, size_t n2)
+{
+  return b1 < b2 + n2*PAGE_SIZE && b2 < b1 + n1*PAGE_SIZE;
+}
+
+/*
+ * Return the base of some area of AS overlapping the NPAGES pages at
+ * BASE, or 0 if the range is free.
+ */
+static vaddr_t
+as_overlap(struct addrspace *as, vaddr_t base, size_t npages)
+{
+  vaddr_t stackbase = USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
+  struct vm_mapping *m;
+
+  if (range_overlaps(base, npages, as->as_vbase1, as->as_npages1)) {
+    return as->as_vbase1;
+  }
+  if (range_overlaps(base, npages, as->as_vbase2, as->as_npages2)) {
+    return as->as_vbase2;
+  }
+  if (range_overlaps(base, npages, stackbase, DUMBVM_STACKPAGES)) {
+    return stackbase;
+  }
+  for (m = as->as_mappings; m != NULL; m = m->vm_next) {
+    if (range_overlaps(base, npages, m->vm_vbase, m->vm_npages)) {
+      return m->vm_vbase;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Find room for NPAGES pages, going down from just below the stack
+ * (leaving an unmapped guard page). Returns 0 if there is none.
+ */
+static vaddr_t
+as_find_hole(struct addrspace *as, size_t npages)
+{
+  vaddr_t top = USERSTACK - (DUMBVM_STACKPAGES + 1) * PAGE_SIZE;
+  vaddr_t base, obase;
+  size_t len = npages * PAGE_SIZE;
+
+  while (top >= len + PAGE_SIZE) {
+    base = top - len;
+    obase = as_overlap(as, base, npages);
+    if (obase == 0) {
+      return base;
+    }
+    top = obase;
+  }
+  return 0;
 }
 
+int
+as_map(struct addrspace *as, vaddr_t *vaddr, size_t npages,
+       int prot, int flags, struct vnode *vn, off_t offset,
+       struct shm_object *shm)
+{
+  struct vm_mapping *m;
+  vaddr_t base = *vaddr;
+
+  dumbvm_can_sleep();
+  KASSERT(npages > 0);
+
+  if (flags & MAP_FIXED) {
+    if ((base & PAGE_FRAME) != base || base == 0 || base >= USERSTACK ||
+        npages > (USERSTACK - base) / PAGE_SIZE) {
+      return EINVAL;
+    }
+  }
+
+  m = mapping_create(0, npages, prot, flags, vn, offset, shm);
+  if (m == NULL) {
+    return ENOMEM;
+  }
+
+  lock_acquire(as->as_lock);
+  if (flags & MAP_FIXED) {
+    /* we do not replace existing mappings */
+    if (as_overlap(as, base, npages) != 0) {
+      lock_release(as->as_lock);
+      mapping_destroy(m);
+      return EINVAL;
+    }
+  }
+  else {
+    /* the address is only a hint, which we ignore */
+    base = as_find_hole(as, npages);
+    if (base == 0) {
+      lock_release(as->as_lock);
+      mapping_destroy(m);
+      return ENOMEM;
+    }
+  }
+  m->vm_vbase = base;
+  m->vm_next = as->as_mappings;
+  as->as_mappings = m;
+  lock_release(as->as_lock);
+
+  *vaddr = base;
+  return 0;
+}
+
+int
+as_unmap(struct addrspace *as, vaddr_t vaddr, size_t npages)
+{
+  struct vm_mapping *m, **pm, *dead = NULL;
+  vaddr_t top = vaddr + npages * PAGE_SIZE;
+  struct tlbshootdown ts;
+  unsigned i, n;
+
+  dumbvm_can_sleep();
+
+  /*
+   * Other threads of the process may be running on other CPUs, with
+   * TLB entries for the pages about to be freed. Get ready to flush
+   * them now, while failing is still harmless.
+   */
+  ts.ts_done = NULL;
+  if (cpu_count() > 1) {
+    ts.ts_done = sem_create("munmap", 0);
+    if (ts.ts_done == NULL) {
+      return ENOMEM;
+    }
+  }
+
+  lock_acquire(as->as_lock);
+
+  /* first make sure no mapping would have to be split */
+  for (m = as->as_mappings; m != NULL; m = m->vm_next) {
+    if (range_overlaps(vaddr, npages, m->vm_vbase, m->vm_npages) &&
+        (m->vm_vbase < vaddr || m->vm_vbase + m->vm_npages*PAGE_SIZE > top)) {
+      lock_release(as->as_lock);
+      if (ts.ts_done != NULL) {
+        sem_destroy(ts.ts_done);
+      }
+      return EINVAL;
+    }
+  }
+
+  pm = &as->as_mappings;
+  while (*pm != NULL) {
+    m = *pm;
+    if (range_overlaps(vaddr, npages, m->vm_vbase, m->vm_npages)) {
+      *pm = m->vm_next;
+      m->vm_next = dead;
+      dead = m;
+    }
+    else {
+      pm = &m->vm_next;
+    }
+  }
+
+  lock_release(as->as_lock);
+
+  /*
+   * Drop stale translations everywhere, and wait until every CPU
+   * has, before the frames can go to someone else. The mappings are
+   * unlinked already, so no new entries for them can be made.
+   */
+  tlb_flush();
+  if (ts.ts_done != NULL) {
+    n = ipi_tlbshootdown_broadcast(&ts);
+    for (i=0; i<n; i++) {
+      P(ts.ts_done);
+    }
+    sem_destroy(ts.ts_done);
+  }
+
+  while (dead != NULL) {
+    m = dead;
+    dead = m->vm_next;
+    mapping_destroy(m);
+  }
+  return 0;
+}
+
+/*
+ * Take region 1 from the text cache instead of loading it privately.
+ */
+int
+as_share_text(struct addrspace *as, struct vnode *vn, off_t offset,
+              vaddr_t vaddr, size_t filesize)
+{
+  KASSERT(as->as_text == NULL);
+  KASSERT(as->as_pbase1 == 0);
+
+  if (vaddr < as->as_vbase1 ||
+      filesize > as->as_npages1*PAGE_SIZE - (vaddr - as->as_vbase1)) {
+    return ENOEXEC;
+  }
+  return text_get(vn, offset, vaddr, filesize, as->as_npages1, &as->as_text);
+}
+
+/*
+ * Find the physical address behind VADDR, giving a mapped page its
+ * frame if it has not been touched yet.
+ */
+int
+as_translate(struct addrspace *as, vaddr_t vaddr, paddr_t *ret)
+{
+  vaddr_t page = vaddr & PAGE_FRAME;
+  vaddr_t stackbase = USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE;
+  struct vm_mapping *m;
+  paddr_t paddr;
+  int result;
+
+  KASSERT(lock_do_i_hold(as->as_lock));
+
+  if (page >= as->as_vbase1 &&
+      page < as->as_vbase1 + as->as_npages1*PAGE_SIZE) {
+    paddr = page - as->as_vbase1 + as->as_pbase1;
+  }
+  else if (page >= as->as_vbase2 &&
+           page < as->as_vbase2 + as->as_npages2*PAGE_SIZE) {
+    paddr = page - as->as_vbase2 + as->as_pbase2;
+  }
+  else if (page >= stackbase && page < USERSTACK) {
+    paddr = page - stackbase + as->as_stackpbase;
+  }
+  else if ((m = mapping_find(as, page)) != NULL) {
+    result = mapping_fault(m, VM_FAULT_READ, page, &paddr);
+    if (result) {
+      return result;
+    }
+  }
+  else {
+    return EFAULT;
+  }
+
+  *ret = paddr + (vaddr - page);
+  return 0;
+}
+
+#endif /* OPT_SHELL */
+
 int
 vm_fault(int faulttype, vaddr_t faultaddress)
 {
@@ -263,6 +710,12 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	uint32_t ehi, elo;
 	struct addrspace *as;
 	int spl;
+	bool writable = true;
+#if OPT_SHELL
+	struct vm_mapping *m;
+	int result;
+	bool maplocked = false;
+#endif
 
 	faultaddress &= PAGE_FRAME;
 
@@ -270,8 +723,13 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
+#if OPT_SHELL
+		/* write to a read-only mapping */
+		return EFAULT;
+#else
 		/* We always create pages read-write, so we can't get this */
 		panic("dumbvm: got VM_FAULT_READONLY\n");
+#endif
 	    case VM_FAULT_READ:
 	    case VM_FAULT_WRITE:
 		break;
@@ -320,6 +778,10 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 
 	if (faultaddress >= vbase1 && faultaddress < vtop1) {
 		paddr = (faultaddress - vbase1) + as->as_pbase1;
+#if OPT_SHELL
+		/* other processes run the same frames */
+		writable = as->as_text == NULL;
+#endif
 	}
 	else if (faultaddress >= vbase2 && faultaddress < vtop2) {
 		paddr = (faultaddress - vbase2) + as->as_pbase2;
@@ -327,32 +789,70 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	else if (faultaddress >= stackbase && faultaddress < stacktop) {
 		paddr = (faultaddress - stackbase) + as->as_stackpbase;
 	}
+#if OPT_SHELL
+	else {
+		/*
+		 * Keep the mapping locked until the TLB entry is in, so
+		 * that munmap's TLB flush cannot slip in between.
+		 */
+		lock_acquire(as->as_lock);
+		m = mapping_find(as, faultaddress);
+		if (m == NULL) {
+			lock_release(as->as_lock);
+			return EFAULT;
+		}
+		result = mapping_fault(m, faulttype, faultaddress, &paddr);
+		if (result) {
+			lock_release(as->as_lock);
+			return result;
+		}
+		writable = (m->vm_prot & PROT_WRITE) != 0;
+		maplocked = true;
+	}
+#else
 	else {
 		return EFAULT;
 	}
+#endif
 
 	/* make sure it's page-aligned */
 	KASSERT((paddr & PAGE_FRAME) == paddr);
 
+	ehi = faultaddress;
+	elo = paddr | TLBLO_VALID;
+	if (writable) {
+		elo |= TLBLO_DIRTY;
+	}
+
 	/* Disable interrupts on this CPU while frobbing the TLB. */
 	spl = splhigh();
 
 	for (i=0; i<NUM_TLB; i++) {
-		tlb_read(&ehi, &elo, i);
-		if (elo & TLBLO_VALID) {
-			continue;
+		uint32_t oehi, oelo;
+
+		tlb_read(&oehi, &oelo, i);
+		if (!(oelo & TLBLO_VALID)) {
+			break;
 		}
-		ehi = faultaddress;
-		elo = paddr | TLBLO_DIRTY | TLBLO_VALID;
+	}
+	if (i < NUM_TLB) {
 		DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x\n", faultaddress, paddr);
 		tlb_write(ehi, elo, i);
-		splx(spl);
-		return 0;
 	}
-
-	kprintf("dumbvm: Ran out of TLB entries - cannot handle page fault\n");
+	else {
+		/* TLB full: evict a random entry, it will fault back in */
+		DEBUG(DB_VM, "dumbvm: 0x%x -> 0x%x (random)\n",
+		      faultaddress, paddr);
+		tlb_random(ehi, elo);
+	}
 	splx(spl);
-	return EFAULT;
+
+#if OPT_SHELL
+	if (maplocked) {
+		lock_release(as->as_lock);
+	}
+#endif
+	return 0;
 }
 
 struct addrspace *
@@ -370,15 +870,39 @@ as_create(void)
 	as->as_pbase2 = 0;
 	as->as_npages2 = 0;
 	as->as_stackpbase = 0;
+#if OPT_SHELL
+	as->as_lock = lock_create("addrspace");
+	if (as->as_lock == NULL) {
+		kfree(as);
+		return NULL;
+	}
+	as->as_mappings = NULL;
+	as->as_text = NULL;
+#endif
 
 	return as;
 }
 
 void as_destroy(struct addrspace *as){
   dumbvm_can_sleep();
+#if OPT_SHELL
+  if (as->as_text != NULL) {
+    /* region 1 belongs to the text object */
+    text_decref(as->as_text);
+  }
+  else
+#endif
   freeppages(as->as_pbase1, as->as_npages1);
   freeppages(as->as_pbase2, as->as_npages2);
   freeppages(as->as_stackpbase, DUMBVM_STACKPAGES);
+#if OPT_SHELL
+  while (as->as_mappings != NULL) {
+    struct vm_mapping *m = as->as_mappings;
+    as->as_mappings = m->vm_next;
+    mapping_destroy(m);
+  }
+  lock_destroy(as->as_lock);
+#endif
   kfree(as);
 }
 
@@ -466,6 +990,12 @@ as_prepare_load(struct addrspace *as)
 
 	dumbvm_can_sleep();
 
+#if OPT_SHELL
+	if (as->as_text != NULL) {
+		as->as_pbase1 = text_pbase(as->as_text);
+	}
+	else
+#endif
 	as->as_pbase1 = getppages(as->as_npages1);
 	if (as->as_pbase1 == 0) {
 		return ENOMEM;
@@ -481,6 +1011,9 @@ as_prepare_load(struct addrspace *as)
 		return ENOMEM;
 	}
 
+#if OPT_SHELL
+	if (as->as_text == NULL)
+#endif
 	as_zero_region(as->as_pbase1, as->as_npages1);
 	as_zero_region(as->as_pbase2, as->as_npages2);
 	as_zero_region(as->as_stackpbase, DUMBVM_STACKPAGES);
@@ -521,6 +1054,13 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 	new->as_npages1 = old->as_npages1;
 	new->as_vbase2 = old->as_vbase2;
 	new->as_npages2 = old->as_npages2;
+#if OPT_SHELL
+	if (old->as_text != NULL) {
+		/* shared text is shared with the child too */
+		text_incref(old->as_text);
+		new->as_text = old->as_text;
+	}
+#endif
 
 	/* (Mis)use as_prepare_load to allocate some physical memory. */
 	if (as_prepare_load(new)) {
@@ -532,6 +1072,9 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 	KASSERT(new->as_pbase2 != 0);
 	KASSERT(new->as_stackpbase != 0);
 
+#if OPT_SHELL
+	if (new->as_text == NULL)
+#endif
 	memmove((void *)PADDR_TO_KVADDR(new->as_pbase1),
 		(const void *)PADDR_TO_KVADDR(old->as_pbase1),
 		old->as_npages1*PAGE_SIZE);
@@ -544,6 +1087,27 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 		(const void *)PADDR_TO_KVADDR(old->as_stackpbase),
 		DUMBVM_STACKPAGES*PAGE_SIZE);
 
+#if OPT_SHELL
+	{
+		struct vm_mapping *m, *newm;
+		int result;
+
+		/* other threads of the parent may be mapping meanwhile */
+		lock_acquire(old->as_lock);
+		for (m = old->as_mappings; m != NULL; m = m->vm_next) {
+			result = mapping_copy(m, &newm);
+			if (result) {
+				lock_release(old->as_lock);
+				as_destroy(new);
+				return result;
+			}
+			newm->vm_next = new->as_mappings;
+			new->as_mappings = newm;
+		}
+		lock_release(old->as_lock);
+	}
+#endif
+
 	*ret = new;
 	return 0;
 }
@@ -38,6 +38,7 @@
 #include <thread.h>
 #include <current.h>
 #include <membar.h>
+#include <prof.h>
 #include <synch.h>
 #include <mainbus.h>
 #include <sys161/bus.h>
@@ -76,6 +77,24 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+/*
+ * Restart the on-chip timer so that it goes off COUNT cycles from
+ * now, whatever c0_count was.
+ */
+static
+void
+mips_timer_restart(uint32_t count)
+{
+	/* $9 == c0_count, $11 == c0_compare */
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mtc0 $0, $9;"		/* count = 0 */
+		"mtc0 %0, $11;"		/* compare = count */
+		".set pop"		/* restore assembler mode */
+		:: "r" (count));
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -119,6 +138,23 @@ mainbus_bootstrap(void)
 	mips_timer_set(CPU_FREQUENCY / HZ);
 }
 
+/*
+ * Tickless idle: push the next timer interrupt as far away as the
+ * counter allows (some three minutes at 25 MHz), and bring the
+ * period back to normal when the CPU wakes up.
+ */
+void
+mainbus_stop_hardclock(void)
+{
+	mips_timer_restart(0xffffffff);
+}
+
+void
+mainbus_start_hardclock(void)
+{
+	mips_timer_restart(CPU_FREQUENCY / HZ);
+}
+
 /*
  * Start all secondary CPUs.
  */
@@ -316,6 +352,9 @@ mainbus_interrupt(struct trapframe *tf)
 	if (cause & MIPS_TIMER_BIT) {
 		/* Reset the timer (this clears the interrupt) */
 		mips_timer_set(CPU_FREQUENCY / HZ);
+		/* let the profiler see where we were */
+		prof_tick(tf->tf_epc, tf->tf_ra,
+			  (tf->tf_status & CST_KUp) != 0);
 		/* and call hardclock */
 		hardclock();
 		seen = true;
@@ -43,6 +43,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/mman.h>
 #include <stat.h>
 #include <lib.h>
 #include <array.h>
@@ -672,6 +673,18 @@ emufs_stat(struct vnode *v, struct stat *statbuf)
 	return 0;
 }
 
+/*
+ * VOP_GETSIZE
+ */
+static
+int
+emufs_getsize(struct vnode *v, off_t *ret)
+{
+	struct emufs_vnode *ev = v->vn_data;
+
+	return emu_getsize(ev->ev_emu, ev->ev_handle, ret);
+}
+
 /*
  * VOP_GETTYPE for files
  */
@@ -992,13 +1005,20 @@ emufs_namefile(struct vnode *v, struct uio *uio)
 
 /*
  * VOP_MMAP
+ *
+ * Pages are read through emufs_read on demand, so any file can be
+ * mapped as long as writes never need to reach the host.
  */
 static
 int
-emufs_mmap(struct vnode *v)
+emufs_mmap(struct vnode *v, int prot, int flags, struct shm_object **ret)
 {
 	(void)v;
-	return ENOSYS;
+	if ((flags & MAP_SHARED) && (prot & PROT_WRITE)) {
+		return ENOSYS;
+	}
+	*ret = NULL;
+	return 0;
 }
 
 //////////////////////////////
@@ -1228,10 +1248,12 @@ static const struct vnode_ops emufs_fileops = {
 	.vop_read = emufs_read,
 	.vop_readlink = emufs_readlink_notlink,
 	.vop_getdirentry = emufs_uio_op_notdir,
+	.vop_getdirents = emufs_uio_op_notdir,
 	.vop_write = emufs_write,
 	.vop_ioctl = emufs_ioctl,
 	.vop_stat = emufs_stat,
 	.vop_gettype = emufs_file_gettype,
+	.vop_getsize = emufs_getsize,
 	.vop_isseekable = emufs_isseekable,
 	.vop_fsync = emufs_fsync,
 	.vop_mmap = emufs_mmap,
@@ -1262,13 +1284,15 @@ static const struct vnode_ops emufs_dirops = {
 	.vop_read = emufs_uio_op_isdir,
 	.vop_readlink = emufs_uio_op_isdir,
 	.vop_getdirentry = emufs_getdirentry,
+	.vop_getdirents = vnode_getdirents_generic,
 	.vop_write = emufs_uio_op_isdir,
 	.vop_ioctl = emufs_ioctl,
 	.vop_stat = emufs_stat,
 	.vop_gettype = emufs_dir_gettype,
+	.vop_getsize = emufs_getsize,
 	.vop_isseekable = emufs_isseekable,
 	.vop_fsync = emufs_void_op_isdir,
-	.vop_mmap = emufs_void_op_isdir,
+	.vop_mmap = vopfail_mmap_isdir,
 	.vop_truncate = emufs_truncate_isdir,
 	.vop_namefile = emufs_namefile,
 
@@ -657,10 +657,12 @@ static const struct vnode_ops semfs_dirops = {
 	.vop_read = vopfail_uio_isdir,
 	.vop_readlink = vopfail_uio_isdir,
 	.vop_getdirentry = semfs_getdirentry,
+	.vop_getdirents = vnode_getdirents_generic,
 	.vop_write = vopfail_uio_isdir,
 	.vop_ioctl = semfs_ioctl,
 	.vop_stat = semfs_dirstat,
 	.vop_gettype = semfs_gettype,
+	.vop_getsize = vnode_getsize_bystat,
 	.vop_isseekable = semfs_isseekable,
 	.vop_fsync = semfs_fsync,
 	.vop_mmap = vopfail_mmap_isdir,
@@ -690,10 +692,12 @@ static const struct vnode_ops semfs_semops = {
 	.vop_read = semfs_read,
 	.vop_readlink = vopfail_uio_inval,
 	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_getdirents = vopfail_uio_notdir,
 	.vop_write = semfs_write,
 	.vop_ioctl = semfs_ioctl,
 	.vop_stat = semfs_semstat,
 	.vop_gettype = semfs_gettype,
+	.vop_getsize = vnode_getsize_bystat,
 	.vop_isseekable = semfs_isseekable,
 	.vop_fsync = semfs_fsync,
 	.vop_mmap = vopfail_mmap_perm,
@@ -35,7 +35,10 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <stat.h>
+#include <uio.h>
 #include <vfs.h>
+#include <vnode.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
@@ -237,3 +240,88 @@ sfs_lookonce(struct sfs_vnode *sv, const char *name,
 	return 0;
 }
 
+
+/*
+ * Fill UIO with dirent records starting at slot number
+ * uio->uio_offset, and leave uio_offset at the first slot not
+ * returned. Slots are read a disk block at a time; the type, size
+ * and link count of each entry come from its inode.
+ */
+int
+sfs_dir_getdirents(struct sfs_vnode *sv, struct uio *uio)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct sfs_direntry sds[SFS_BLOCKSIZE / sizeof(struct sfs_direntry)];
+	struct sfs_vnode *ent;
+	mode_t type;
+	int nentries, slot, next, batch, i, result;
+	bool any = false;
+
+	if (uio->uio_offset < 0) {
+		return EINVAL;
+	}
+
+	nentries = sfs_dir_nentries(sv);
+	if (uio->uio_offset >= nentries) {
+		/* at or past end of directory */
+		return 0;
+	}
+
+	result = 0;
+	next = uio->uio_offset;
+	while (next < nentries) {
+		/* Read the rest of this block's slots in one go */
+		slot = next;
+		batch = SFS_BLOCKSIZE / sizeof(struct sfs_direntry)
+			- slot % (SFS_BLOCKSIZE / sizeof(struct sfs_direntry));
+		if (batch > nentries - slot) {
+			batch = nentries - slot;
+		}
+		result = sfs_metaio(sv, slot * sizeof(struct sfs_direntry),
+				    sds, batch * sizeof(struct sfs_direntry),
+				    UIO_READ);
+		if (result) {
+			break;
+		}
+
+		for (i=0; i<batch && result==0; i++) {
+			if (sds[i].sfd_ino == SFS_NOINO) {
+				next = slot + i + 1;
+				continue;
+			}
+			/* Ensure null termination, just in case */
+			sds[i].sfd_name[sizeof(sds[i].sfd_name)-1] = 0;
+
+			result = sfs_loadvnode(sfs, sds[i].sfd_ino,
+					       SFS_TYPE_INVAL, &ent);
+			if (result) {
+				break;
+			}
+			type = (ent->sv_i.sfi_type == SFS_TYPE_DIR) ?
+				S_IFDIR : S_IFREG;
+			result = vnode_emitdirent(uio, ent->sv_ino, type,
+						  ent->sv_i.sfi_linkcount,
+						  ent->sv_i.sfi_size,
+						  sds[i].sfd_name);
+			VOP_DECREF(&ent->sv_absvn);
+			if (result == 0) {
+				any = true;
+				next = slot + i + 1;
+			}
+		}
+		if (result) {
+			break;
+		}
+	}
+
+	uio->uio_offset = next;
+	if (result == ENOSPC) {
+		/* a full buffer is the normal way to stop */
+		return any ? 0 : EINVAL;
+	}
+	if (result && any) {
+		/* hand back what we have; the error will recur next time */
+		return 0;
+	}
+	return result;
+}
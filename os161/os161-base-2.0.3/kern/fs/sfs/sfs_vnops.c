@@ -35,6 +35,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/mman.h>
 #include <stat.h>
 #include <lib.h>
 #include <uio.h>
@@ -175,6 +176,21 @@ sfs_stat(struct vnode *v, struct stat *statbuf)
 	return 0;
 }
 
+/*
+ * Return the size of the file, straight from the in-memory inode.
+ */
+static
+int
+sfs_getsize(struct vnode *v, off_t *ret)
+{
+	struct sfs_vnode *sv = v->vn_data;
+
+	vfs_biglock_acquire();
+	*ret = sv->sv_i.sfi_size;
+	vfs_biglock_release();
+	return 0;
+}
+
 /*
  * Return the type of the file (types as per kern/stat.h)
  */
@@ -233,13 +249,21 @@ sfs_fsync(struct vnode *v)
 
 /*
  * Called for mmap().
+ *
+ * The VM system reads mapped pages with sfs_read when they are first
+ * touched, so mappings need no setup here. Shared writable mappings
+ * are refused because nothing ever writes the pages back.
  */
 static
 int
-sfs_mmap(struct vnode *v   /* add stuff as needed */)
+sfs_mmap(struct vnode *v, int prot, int flags, struct shm_object **ret)
 {
 	(void)v;
-	return ENOSYS;
+	if ((flags & MAP_SHARED) && (prot & PROT_WRITE)) {
+		return ENOSYS;
+	}
+	*ret = NULL;
+	return 0;
 }
 
 /*
@@ -545,6 +569,31 @@ sfs_lookparent(struct vnode *v, char *path, struct vnode **ret,
 	return 0;
 }
 
+/*
+ * Read a batch of directory entries.
+ */
+static
+int
+sfs_getdirents(struct vnode *v, struct uio *uio)
+{
+	struct sfs_vnode *sv = v->vn_data;
+	int result;
+
+	KASSERT(uio->uio_rw == UIO_READ);
+
+	vfs_biglock_acquire();
+
+	if (sv->sv_i.sfi_type != SFS_TYPE_DIR) {
+		vfs_biglock_release();
+		return ENOTDIR;
+	}
+
+	result = sfs_dir_getdirents(sv, uio);
+
+	vfs_biglock_release();
+	return result;
+}
+
 /*
  * Lookup gets a vnode for a pathname.
  *
@@ -593,10 +642,12 @@ const struct vnode_ops sfs_fileops = {
 	.vop_read = sfs_read,
 	.vop_readlink = vopfail_uio_notdir,
 	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_getdirents = vopfail_uio_notdir,
 	.vop_write = sfs_write,
 	.vop_ioctl = sfs_ioctl,
 	.vop_stat = sfs_stat,
 	.vop_gettype = sfs_gettype,
+	.vop_getsize = sfs_getsize,
 	.vop_isseekable = sfs_isseekable,
 	.vop_fsync = sfs_fsync,
 	.vop_mmap = sfs_mmap,
@@ -627,10 +678,12 @@ const struct vnode_ops sfs_dirops = {
 	.vop_read = vopfail_uio_isdir,
 	.vop_readlink = vopfail_uio_inval,
 	.vop_getdirentry = vopfail_uio_nosys,
+	.vop_getdirents = sfs_getdirents,
 	.vop_write = vopfail_uio_isdir,
 	.vop_ioctl = sfs_ioctl,
 	.vop_stat = sfs_stat,
 	.vop_gettype = sfs_gettype,
+	.vop_getsize = sfs_getsize,
 	.vop_isseekable = sfs_isseekable,
 	.vop_fsync = sfs_fsync,
 	.vop_mmap = vopfail_mmap_isdir,
@@ -61,6 +61,7 @@ int sfs_dir_unlink(struct sfs_vnode *sv, int slot);
 int sfs_lookonce(struct sfs_vnode *sv, const char *name,
 		struct sfs_vnode **ret,
 		int *slot);
+int sfs_dir_getdirents(struct sfs_vnode *sv, struct uio *uio);
 
 /* Functions in sfs_inode.c */
 int sfs_sync_inode(struct sfs_vnode *sv);
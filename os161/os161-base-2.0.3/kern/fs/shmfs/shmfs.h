@@ -0,0 +1,82 @@
+#ifndef SHMFS_H
+#define SHMFS_H
+
+/*
+ * shmfs: fake filesystem of named shared memory segments, attached
+ * as "shm:". It works like semfs: open("shm:name", O_CREAT) creates
+ * a segment, ftruncate() sets its size, and mmap(MAP_SHARED) on the
+ * file maps the segment's frames. Segments are not readable or
+ * writable with read()/write(); all access goes through mmap.
+ *
+ * A segment lives as long as it has a name or a vnode; the memory
+ * itself is a shm object that also stays alive while mapped.
+ */
+
+#include <array.h>
+#include <fs.h>
+#include <vnode.h>
+
+#ifndef SHMFS_INLINE
+#define SHMFS_INLINE INLINE
+#endif
+
+/*
+ * Constants
+ */
+
+#define SHMFS_ROOTDIR	0xffffffffU		/* segnum for root dir */
+
+/*
+ * A segment: name and memory object.
+ */
+struct shmfs_seg {
+	char *shms_name;			/* Name */
+	struct shm_object *shms_obj;		/* Memory (one reference) */
+	bool shms_hasvnode;			/* The vnode exists */
+	bool shms_linked;			/* In the directory */
+};
+DECLARRAY(shmfs_seg, SHMFS_INLINE);
+
+/*
+ * Vnode.
+ */
+struct shmfs_vnode {
+	struct vnode shmv_absvn;		/* Abstract vnode */
+	struct shmfs *shmv_shmfs;		/* Back-pointer to fs */
+	unsigned shmv_segnum;			/* Which segment */
+};
+
+/*
+ * The structure for the shm file system. There is only one.
+ * The number of segments is expected to be small, so a single lock
+ * covers both the vnode table and the segment table (which is also
+ * the directory).
+ */
+struct shmfs {
+	struct fs shmfs_absfs;			/* Abstract fs object */
+
+	struct lock *shmfs_lock;		/* Lock for following */
+	struct vnodearray *shmfs_vnodes;	/* Currently extant vnodes */
+	struct shmfs_segarray *shmfs_segs;	/* Segments */
+};
+
+/*
+ * Arrays
+ */
+
+DEFARRAY(shmfs_seg, SHMFS_INLINE);
+
+
+/*
+ * Functions.
+ */
+
+/* in shmfs_fsops.c */
+struct shmfs_seg *shmfs_seg_create(const char *name);
+void shmfs_seg_destroy(struct shmfs_seg *);
+
+/* in shmfs_vnops.c */
+int shmfs_getvnode(struct shmfs *, unsigned, struct vnode **ret);
+
+
+#endif /* SHMFS_H */
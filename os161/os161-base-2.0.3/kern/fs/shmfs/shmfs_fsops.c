@@ -0,0 +1,224 @@
+/*
+ * shmfs: fs-level operations and segment objects.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <vfs.h>
+#include <fs.h>
+#include <vnode.h>
+#include <shm.h>
+
+#define SHMFS_INLINE
+#include "shmfs.h"
+
+////////////////////////////////////////////////////////////
+// shmfs_seg
+
+/*
+ * Constructor for shmfs_seg. New segments are empty; ftruncate gives
+ * them a size.
+ */
+struct shmfs_seg *
+shmfs_seg_create(const char *name)
+{
+	struct shmfs_seg *seg;
+
+	seg = kmalloc(sizeof(*seg));
+	if (seg == NULL) {
+		return NULL;
+	}
+	seg->shms_name = kstrdup(name);
+	if (seg->shms_name == NULL) {
+		kfree(seg);
+		return NULL;
+	}
+	seg->shms_obj = shm_create(0);
+	if (seg->shms_obj == NULL) {
+		kfree(seg->shms_name);
+		kfree(seg);
+		return NULL;
+	}
+	seg->shms_hasvnode = false;
+	seg->shms_linked = false;
+	return seg;
+}
+
+/*
+ * Destructor for shmfs_seg. The memory survives while mapped.
+ */
+void
+shmfs_seg_destroy(struct shmfs_seg *seg)
+{
+	shm_decref(seg->shms_obj);
+	kfree(seg->shms_name);
+	kfree(seg);
+}
+
+////////////////////////////////////////////////////////////
+// fs-level operations
+
+/*
+ * Sync doesn't need to do anything.
+ */
+static
+int
+shmfs_sync(struct fs *fs)
+{
+	(void)fs;
+	return 0;
+}
+
+/*
+ * We have only one volume name and it's hardwired.
+ */
+static
+const char *
+shmfs_getvolname(struct fs *fs)
+{
+	(void)fs;
+	return "shm";
+}
+
+/*
+ * Get the root directory vnode.
+ */
+static
+int
+shmfs_getroot(struct fs *fs, struct vnode **ret)
+{
+	struct shmfs *shmfs = fs->fs_data;
+	struct vnode *vn;
+	int result;
+
+	result = shmfs_getvnode(shmfs, SHMFS_ROOTDIR, &vn);
+	if (result) {
+		kprintf("shmfs: couldn't load root vnode: %s\n",
+			strerror(result));
+		return result;
+	}
+	*ret = vn;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// mount and unmount logic
+
+/*
+ * Destructor for struct shmfs.
+ */
+static
+void
+shmfs_destroy(struct shmfs *shmfs)
+{
+	struct shmfs_seg *seg;
+	unsigned i, num;
+
+	num = shmfs_segarray_num(shmfs->shmfs_segs);
+	for (i=0; i<num; i++) {
+		seg = shmfs_segarray_get(shmfs->shmfs_segs, i);
+		if (seg != NULL) {
+			shmfs_seg_destroy(seg);
+		}
+	}
+	shmfs_segarray_setsize(shmfs->shmfs_segs, 0);
+
+	shmfs_segarray_destroy(shmfs->shmfs_segs);
+	vnodearray_destroy(shmfs->shmfs_vnodes);
+	lock_destroy(shmfs->shmfs_lock);
+	kfree(shmfs);
+}
+
+/*
+ * Unmount routine.
+ */
+static
+int
+shmfs_unmount(struct fs *fs)
+{
+	struct shmfs *shmfs = fs->fs_data;
+
+	lock_acquire(shmfs->shmfs_lock);
+	if (vnodearray_num(shmfs->shmfs_vnodes) > 0) {
+		lock_release(shmfs->shmfs_lock);
+		return EBUSY;
+	}
+
+	lock_release(shmfs->shmfs_lock);
+	shmfs_destroy(shmfs);
+
+	return 0;
+}
+
+/*
+ * Operations table.
+ */
+static const struct fs_ops shmfs_fsops = {
+	.fsop_sync = shmfs_sync,
+	.fsop_getvolname = shmfs_getvolname,
+	.fsop_getroot = shmfs_getroot,
+	.fsop_unmount = shmfs_unmount,
+};
+
+/*
+ * Constructor for struct shmfs.
+ */
+static
+struct shmfs *
+shmfs_create(void)
+{
+	struct shmfs *shmfs;
+
+	shmfs = kmalloc(sizeof(*shmfs));
+	if (shmfs == NULL) {
+		goto fail_total;
+	}
+
+	shmfs->shmfs_lock = lock_create("shmfs");
+	if (shmfs->shmfs_lock == NULL) {
+		goto fail_shmfs;
+	}
+	shmfs->shmfs_vnodes = vnodearray_create();
+	if (shmfs->shmfs_vnodes == NULL) {
+		goto fail_lock;
+	}
+	shmfs->shmfs_segs = shmfs_segarray_create();
+	if (shmfs->shmfs_segs == NULL) {
+		goto fail_vnodes;
+	}
+
+	shmfs->shmfs_absfs.fs_data = shmfs;
+	shmfs->shmfs_absfs.fs_ops = &shmfs_fsops;
+	return shmfs;
+
+ fail_vnodes:
+	vnodearray_destroy(shmfs->shmfs_vnodes);
+ fail_lock:
+	lock_destroy(shmfs->shmfs_lock);
+ fail_shmfs:
+	kfree(shmfs);
+ fail_total:
+	return NULL;
+}
+
+/*
+ * Create the shmfs. There is only one shmfs and it's attached as
+ * "shm:" during bootup.
+ */
+void
+shmfs_bootstrap(void)
+{
+	struct shmfs *shmfs;
+	int result;
+
+	shmfs = shmfs_create();
+	if (shmfs == NULL) {
+		panic("Out of memory creating shmfs\n");
+	}
+	result = vfs_addfs("shm", &shmfs->shmfs_absfs);
+	if (result) {
+		panic("Attaching shmfs: %s\n", strerror(result));
+	}
+}
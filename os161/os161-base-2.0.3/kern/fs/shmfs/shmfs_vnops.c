@@ -0,0 +1,653 @@
+/*
+ * shmfs: vnode operations.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/mman.h>
+#include <lib.h>
+#include <stat.h>
+#include <uio.h>
+#include <synch.h>
+#include <vm.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <shm.h>
+
+#include "shmfs.h"
+
+static int shmfs_getvnode_locked(struct shmfs *, unsigned, struct vnode **);
+
+////////////////////////////////////////////////////////////
+// basic ops
+
+static
+int
+shmfs_eachopen(struct vnode *vn, int openflags)
+{
+	struct shmfs_vnode *shmv = vn->vn_data;
+
+	if (shmv->shmv_segnum == SHMFS_ROOTDIR) {
+		if ((openflags & O_ACCMODE) != O_RDONLY) {
+			return EISDIR;
+		}
+		if (openflags & O_APPEND) {
+			return EISDIR;
+		}
+	}
+
+	return 0;
+}
+
+static
+int
+shmfs_ioctl(struct vnode *vn, int op, userptr_t data)
+{
+	(void)vn;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+static
+int
+shmfs_gettype(struct vnode *vn, mode_t *ret)
+{
+	struct shmfs_vnode *shmv = vn->vn_data;
+
+	*ret = shmv->shmv_segnum == SHMFS_ROOTDIR ? S_IFDIR : S_IFREG;
+	return 0;
+}
+
+static
+bool
+shmfs_isseekable(struct vnode *vn)
+{
+	struct shmfs_vnode *shmv = vn->vn_data;
+
+	/* segments are only accessed through mmap */
+	return shmv->shmv_segnum == SHMFS_ROOTDIR;
+}
+
+static
+int
+shmfs_fsync(struct vnode *vn)
+{
+	(void)vn;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// segment ops
+
+static
+struct shmfs_seg *
+shmfs_getseg(struct shmfs_vnode *shmv)
+{
+	struct shmfs *shmfs = shmv->shmv_shmfs;
+	struct shmfs_seg *seg;
+
+	lock_acquire(shmfs->shmfs_lock);
+	seg = shmfs_segarray_get(shmfs->shmfs_segs, shmv->shmv_segnum);
+	lock_release(shmfs->shmfs_lock);
+	return seg;
+}
+
+/*
+ * stat() for segment vnodes
+ */
+static
+int
+shmfs_segstat(struct vnode *vn, struct stat *buf)
+{
+	struct shmfs_vnode *shmv = vn->vn_data;
+	struct shmfs *shmfs = shmv->shmv_shmfs;
+	struct shmfs_seg *seg;
+
+	seg = shmfs_getseg(shmv);
+
+	bzero(buf, sizeof(*buf));
+
+	buf->st_size = shm_npages(seg->shms_obj) * PAGE_SIZE;
+	lock_acquire(shmfs->shmfs_lock);
+	buf->st_nlink = seg->shms_linked ? 1 : 0;
+	lock_release(shmfs->shmfs_lock);
+
+	buf->st_mode = S_IFREG | 0666;
+	buf->st_blksize = PAGE_SIZE;
+	buf->st_blocks = 0;
+	buf->st_dev = 0;
+	buf->st_ino = shmv->shmv_segnum;
+
+	return 0;
+}
+
+/*
+ * ftruncate: set the size (rounded up to whole pages). Not allowed
+ * while the segment is mapped.
+ */
+static
+int
+shmfs_truncate(struct vnode *vn, off_t len)
+{
+	struct shmfs_vnode *shmv = vn->vn_data;
+	struct shmfs_seg *seg;
+
+	if (len < 0) {
+		return EINVAL;
+	}
+	seg = shmfs_getseg(shmv);
+	return shm_resize(seg->shms_obj, (len + PAGE_SIZE - 1) / PAGE_SIZE);
+}
+
+/*
+ * mmap: hand the memory object to the VM system. A segment is shared
+ * by definition.
+ */
+static
+int
+shmfs_mmap(struct vnode *vn, int prot, int flags, struct shm_object **ret)
+{
+	struct shmfs_vnode *shmv = vn->vn_data;
+	struct shmfs_seg *seg;
+
+	(void)prot;
+	if (!(flags & MAP_SHARED)) {
+		return ENOSYS;
+	}
+	seg = shmfs_getseg(shmv);
+	shm_incref(seg->shms_obj);
+	*ret = seg->shms_obj;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// directory ops
+
+/*
+ * Directory read. The uio offset is the index of the next slot of
+ * the segment table to look at.
+ */
+static
+int
+shmfs_getdirentry(struct vnode *dirvn, struct uio *uio)
+{
+	struct shmfs_vnode *dirshmv = dirvn->vn_data;
+	struct shmfs *shmfs = dirshmv->shmv_shmfs;
+	struct shmfs_seg *seg;
+	unsigned num, pos;
+	int result = 0;
+
+	KASSERT(uio->uio_offset >= 0);
+	pos = uio->uio_offset;
+
+	lock_acquire(shmfs->shmfs_lock);
+
+	num = shmfs_segarray_num(shmfs->shmfs_segs);
+	for (; pos < num; pos++) {
+		seg = shmfs_segarray_get(shmfs->shmfs_segs, pos);
+		if (seg != NULL && seg->shms_linked) {
+			result = uiomove(seg->shms_name,
+					 strlen(seg->shms_name), uio);
+			pos++;
+			break;
+		}
+	}
+	/* past the last one: EOF */
+
+	lock_release(shmfs->shmfs_lock);
+	if (result == 0) {
+		uio->uio_offset = pos;
+	}
+	return result;
+}
+
+/*
+ * stat() for dirs
+ */
+static
+int
+shmfs_dirstat(struct vnode *vn, struct stat *buf)
+{
+	struct shmfs_vnode *shmv = vn->vn_data;
+	struct shmfs *shmfs = shmv->shmv_shmfs;
+
+	bzero(buf, sizeof(*buf));
+
+	lock_acquire(shmfs->shmfs_lock);
+	buf->st_size = shmfs_segarray_num(shmfs->shmfs_segs);
+	lock_release(shmfs->shmfs_lock);
+
+	buf->st_mode = S_IFDIR | 1777;
+	buf->st_nlink = 2;
+	buf->st_blocks = 0;
+	buf->st_dev = 0;
+	buf->st_ino = SHMFS_ROOTDIR;
+
+	return 0;
+}
+
+/*
+ * Backend for getcwd. No subdirs: send back the empty string.
+ */
+static
+int
+shmfs_namefile(struct vnode *vn, struct uio *uio)
+{
+	(void)vn;
+	(void)uio;
+	return 0;
+}
+
+/*
+ * Find a linked segment by name. Call with the lock held.
+ */
+static
+bool
+shmfs_findname(struct shmfs *shmfs, const char *name, unsigned *ret)
+{
+	struct shmfs_seg *seg;
+	unsigned i, num;
+
+	KASSERT(lock_do_i_hold(shmfs->shmfs_lock));
+	num = shmfs_segarray_num(shmfs->shmfs_segs);
+	for (i=0; i<num; i++) {
+		seg = shmfs_segarray_get(shmfs->shmfs_segs, i);
+		if (seg != NULL && seg->shms_linked &&
+		    !strcmp(seg->shms_name, name)) {
+			*ret = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Create a segment.
+ */
+static
+int
+shmfs_creat(struct vnode *dirvn, const char *name, bool excl, mode_t mode,
+	    struct vnode **resultvn)
+{
+	struct shmfs_vnode *dirshmv = dirvn->vn_data;
+	struct shmfs *shmfs = dirshmv->shmv_shmfs;
+	struct shmfs_seg *seg;
+	unsigned i, num, segnum;
+	int result;
+
+	(void)mode;
+	if (!strcmp(name, ".") || !strcmp(name, "..")) {
+		return EEXIST;
+	}
+
+	lock_acquire(shmfs->shmfs_lock);
+	if (shmfs_findname(shmfs, name, &segnum)) {
+		if (excl) {
+			result = EEXIST;
+		}
+		else {
+			result = shmfs_getvnode_locked(shmfs, segnum,
+						       resultvn);
+		}
+		lock_release(shmfs->shmfs_lock);
+		return result;
+	}
+
+	/* create it, in the first free slot */
+	seg = shmfs_seg_create(name);
+	if (seg == NULL) {
+		lock_release(shmfs->shmfs_lock);
+		return ENOMEM;
+	}
+	num = shmfs_segarray_num(shmfs->shmfs_segs);
+	for (i=0; i<num; i++) {
+		if (shmfs_segarray_get(shmfs->shmfs_segs, i) == NULL) {
+			break;
+		}
+	}
+	if (i < num) {
+		shmfs_segarray_set(shmfs->shmfs_segs, i, seg);
+	}
+	else if (num == SHMFS_ROOTDIR) {
+		/* Too many */
+		shmfs_seg_destroy(seg);
+		lock_release(shmfs->shmfs_lock);
+		return ENOSPC;
+	}
+	else {
+		result = shmfs_segarray_add(shmfs->shmfs_segs, seg, &i);
+		if (result) {
+			shmfs_seg_destroy(seg);
+			lock_release(shmfs->shmfs_lock);
+			return result;
+		}
+	}
+
+	result = shmfs_getvnode_locked(shmfs, i, resultvn);
+	if (result) {
+		/* nobody has seen it yet: take it back */
+		shmfs_segarray_set(shmfs->shmfs_segs, i, NULL);
+		shmfs_seg_destroy(seg);
+	}
+	else {
+		seg->shms_linked = true;
+	}
+	lock_release(shmfs->shmfs_lock);
+	return result;
+}
+
+/*
+ * Unlink a segment. It goes away once it is neither open nor
+ * mapped.
+ */
+static
+int
+shmfs_remove(struct vnode *dirvn, const char *name)
+{
+	struct shmfs_vnode *dirshmv = dirvn->vn_data;
+	struct shmfs *shmfs = dirshmv->shmv_shmfs;
+	struct shmfs_seg *seg;
+	unsigned segnum;
+
+	if (!strcmp(name, ".") || !strcmp(name, "..")) {
+		return EINVAL;
+	}
+
+	lock_acquire(shmfs->shmfs_lock);
+	if (!shmfs_findname(shmfs, name, &segnum)) {
+		lock_release(shmfs->shmfs_lock);
+		return ENOENT;
+	}
+	seg = shmfs_segarray_get(shmfs->shmfs_segs, segnum);
+	seg->shms_linked = false;
+	if (!seg->shms_hasvnode) {
+		shmfs_segarray_set(shmfs->shmfs_segs, segnum, NULL);
+		shmfs_seg_destroy(seg);
+	}
+	lock_release(shmfs->shmfs_lock);
+	return 0;
+}
+
+/*
+ * Lookup: get a segment by name.
+ */
+static
+int
+shmfs_lookup(struct vnode *dirvn, char *path, struct vnode **resultvn)
+{
+	struct shmfs_vnode *dirshmv = dirvn->vn_data;
+	struct shmfs *shmfs = dirshmv->shmv_shmfs;
+	unsigned segnum;
+	int result;
+
+	if (!strcmp(path, ".") || !strcmp(path, "..")) {
+		VOP_INCREF(dirvn);
+		*resultvn = dirvn;
+		return 0;
+	}
+
+	lock_acquire(shmfs->shmfs_lock);
+	if (shmfs_findname(shmfs, path, &segnum)) {
+		result = shmfs_getvnode_locked(shmfs, segnum, resultvn);
+	}
+	else {
+		result = ENOENT;
+	}
+	lock_release(shmfs->shmfs_lock);
+	return result;
+}
+
+/*
+ * Lookparent: because we don't have subdirs, just return the root
+ * dir and copy the name.
+ */
+static
+int
+shmfs_lookparent(struct vnode *dirvn, char *path,
+		 struct vnode **resultdirvn, char *namebuf, size_t bufmax)
+{
+	if (strlen(path)+1 > bufmax) {
+		return ENAMETOOLONG;
+	}
+	strcpy(namebuf, path);
+
+	VOP_INCREF(dirvn);
+	*resultdirvn = dirvn;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// vnode lifecycle operations
+
+/*
+ * Destructor for shmfs_vnode.
+ */
+static
+void
+shmfs_vnode_destroy(struct shmfs_vnode *shmv)
+{
+	vnode_cleanup(&shmv->shmv_absvn);
+	kfree(shmv);
+}
+
+/*
+ * Reclaim - drop a vnode that's no longer in use.
+ */
+static
+int
+shmfs_reclaim(struct vnode *vn)
+{
+	struct shmfs_vnode *shmv = vn->vn_data;
+	struct shmfs *shmfs = shmv->shmv_shmfs;
+	struct vnode *vn2;
+	struct shmfs_seg *seg;
+	unsigned i, num;
+
+	lock_acquire(shmfs->shmfs_lock);
+
+	/* vnode refcount is protected by the vnode's ->vn_countlock */
+	spinlock_acquire(&vn->vn_countlock);
+	if (vn->vn_refcount > 1) {
+		/* consume the reference VOP_DECREF passed us */
+		vn->vn_refcount--;
+
+		spinlock_release(&vn->vn_countlock);
+		lock_release(shmfs->shmfs_lock);
+		return EBUSY;
+	}
+
+	spinlock_release(&vn->vn_countlock);
+
+	/* remove from the table */
+	num = vnodearray_num(shmfs->shmfs_vnodes);
+	for (i=0; i<num; i++) {
+		vn2 = vnodearray_get(shmfs->shmfs_vnodes, i);
+		if (vn2 == vn) {
+			vnodearray_remove(shmfs->shmfs_vnodes, i);
+			break;
+		}
+	}
+
+	if (shmv->shmv_segnum != SHMFS_ROOTDIR) {
+		seg = shmfs_segarray_get(shmfs->shmfs_segs, shmv->shmv_segnum);
+		KASSERT(seg->shms_hasvnode);
+		seg->shms_hasvnode = false;
+		if (seg->shms_linked == false) {
+			shmfs_segarray_set(shmfs->shmfs_segs,
+					   shmv->shmv_segnum, NULL);
+			shmfs_seg_destroy(seg);
+		}
+	}
+
+	lock_release(shmfs->shmfs_lock);
+
+	shmfs_vnode_destroy(shmv);
+	return 0;
+}
+
+/*
+ * Vnode ops table for the root dir.
+ */
+static const struct vnode_ops shmfs_dirops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = shmfs_eachopen,
+	.vop_reclaim = shmfs_reclaim,
+
+	.vop_read = vopfail_uio_isdir,
+	.vop_readlink = vopfail_uio_isdir,
+	.vop_getdirentry = shmfs_getdirentry,
+	.vop_getdirents = vnode_getdirents_generic,
+	.vop_write = vopfail_uio_isdir,
+	.vop_ioctl = shmfs_ioctl,
+	.vop_stat = shmfs_dirstat,
+	.vop_gettype = shmfs_gettype,
+	.vop_getsize = vnode_getsize_bystat,
+	.vop_isseekable = shmfs_isseekable,
+	.vop_fsync = shmfs_fsync,
+	.vop_mmap = vopfail_mmap_isdir,
+	.vop_truncate = vopfail_truncate_isdir,
+	.vop_namefile = shmfs_namefile,
+
+	.vop_creat = shmfs_creat,
+	.vop_symlink = vopfail_symlink_nosys,
+	.vop_mkdir = vopfail_mkdir_nosys,
+	.vop_link = vopfail_link_nosys,
+	.vop_remove = shmfs_remove,
+	.vop_rmdir = vopfail_string_nosys,
+	.vop_rename = vopfail_rename_nosys,
+	.vop_lookup = shmfs_lookup,
+	.vop_lookparent = shmfs_lookparent,
+};
+
+/*
+ * Vnode ops table for segments (files).
+ */
+static const struct vnode_ops shmfs_segops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = shmfs_eachopen,
+	.vop_reclaim = shmfs_reclaim,
+
+	.vop_read = vopfail_uio_inval,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_getdirents = vopfail_uio_notdir,
+	.vop_write = vopfail_uio_inval,
+	.vop_ioctl = shmfs_ioctl,
+	.vop_stat = shmfs_segstat,
+	.vop_gettype = shmfs_gettype,
+	.vop_getsize = vnode_getsize_bystat,
+	.vop_isseekable = shmfs_isseekable,
+	.vop_fsync = shmfs_fsync,
+	.vop_mmap = shmfs_mmap,
+	.vop_truncate = shmfs_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+/*
+ * Constructor for shmfs vnodes.
+ */
+static
+struct shmfs_vnode *
+shmfs_vnode_create(struct shmfs *shmfs, unsigned segnum)
+{
+	const struct vnode_ops *optable;
+	struct shmfs_vnode *shmv;
+	int result;
+
+	if (segnum == SHMFS_ROOTDIR) {
+		optable = &shmfs_dirops;
+	}
+	else {
+		optable = &shmfs_segops;
+	}
+
+	shmv = kmalloc(sizeof(*shmv));
+	if (shmv == NULL) {
+		return NULL;
+	}
+
+	shmv->shmv_shmfs = shmfs;
+	shmv->shmv_segnum = segnum;
+
+	result = vnode_init(&shmv->shmv_absvn, optable,
+			    &shmfs->shmfs_absfs, shmv);
+	/* vnode_init doesn't actually fail */
+	KASSERT(result == 0);
+
+	return shmv;
+}
+
+/*
+ * Look up the vnode for a segment by number; if it doesn't exist,
+ * create it. Call with the lock held.
+ */
+static
+int
+shmfs_getvnode_locked(struct shmfs *shmfs, unsigned segnum,
+		      struct vnode **ret)
+{
+	struct vnode *vn;
+	struct shmfs_vnode *shmv;
+	struct shmfs_seg *seg;
+	unsigned i, num;
+	int result;
+
+	KASSERT(lock_do_i_hold(shmfs->shmfs_lock));
+
+	/* Look for it */
+	num = vnodearray_num(shmfs->shmfs_vnodes);
+	for (i=0; i<num; i++) {
+		vn = vnodearray_get(shmfs->shmfs_vnodes, i);
+		shmv = vn->vn_data;
+		if (shmv->shmv_segnum == segnum) {
+			VOP_INCREF(vn);
+			*ret = vn;
+			return 0;
+		}
+	}
+
+	/* Make it */
+	shmv = shmfs_vnode_create(shmfs, segnum);
+	if (shmv == NULL) {
+		return ENOMEM;
+	}
+	result = vnodearray_add(shmfs->shmfs_vnodes, &shmv->shmv_absvn, NULL);
+	if (result) {
+		shmfs_vnode_destroy(shmv);
+		return ENOMEM;
+	}
+	if (segnum != SHMFS_ROOTDIR) {
+		seg = shmfs_segarray_get(shmfs->shmfs_segs, segnum);
+		KASSERT(seg != NULL);
+		KASSERT(seg->shms_hasvnode == false);
+		seg->shms_hasvnode = true;
+	}
+
+	*ret = &shmv->shmv_absvn;
+	return 0;
+}
+
+int
+shmfs_getvnode(struct shmfs *shmfs, unsigned segnum, struct vnode **ret)
+{
+	int result;
+
+	lock_acquire(shmfs->shmfs_lock);
+	result = shmfs_getvnode_locked(shmfs, segnum, ret);
+	lock_release(shmfs->shmfs_lock);
+	return result;
+}
@@ -40,6 +40,31 @@
 #include "opt-shell.h"
 
 struct vnode;
+struct lock;
+struct shm_object;
+struct text_object;
+
+#if OPT_SHELL
+/*
+ * Mapping created by mmap() on top of the regions loaded from the
+ * executable and the stack. Pages get a frame the first time they are
+ * touched: zero-filled for anonymous mappings, read from vm_vn at
+ * vm_offset otherwise. vm_frames[i] is 0 for pages not loaded yet.
+ * Shared mappings instead take their frames from vm_shm (starting at
+ * page vm_offset/PAGE_SIZE of the object) and have no vm_frames.
+ */
+struct vm_mapping {
+        vaddr_t vm_vbase;               /* first page of the mapping */
+        size_t vm_npages;               /* length in pages */
+        int vm_prot;                    /* PROT_* flags */
+        int vm_flags;                   /* MAP_* flags */
+        struct vnode *vm_vn;            /* backing file, or NULL */
+        off_t vm_offset;                /* file offset of the first page */
+        struct shm_object *vm_shm;      /* shared memory object, or NULL */
+        paddr_t *vm_frames;             /* frame of each page, or 0 */
+        struct vm_mapping *vm_next;
+};
+#endif
 
 
 /*
@@ -58,6 +83,11 @@ struct addrspace {
         paddr_t as_pbase2;
         size_t as_npages2;
         paddr_t as_stackpbase;
+#if OPT_SHELL
+        struct lock *as_lock;           /* protects as_mappings */
+        struct vm_mapping *as_mappings; /* mmap'ed areas */
+        struct text_object *as_text;    /* shared region 1, or NULL */
+#endif
 #else
         /* Put stuff here for your VM system */
 #endif
@@ -100,6 +130,32 @@ struct addrspace {
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
  *
+ *    as_map    - add a mapping of NPAGES pages at *VADDR (or wherever
+ *                there is room, if *VADDR is 0). VN may be NULL for
+ *                anonymous memory; otherwise a reference to it is kept.
+ *                If SHM is not NULL, the pages are those of SHM (and a
+ *                reference to it is kept) instead.
+ *
+ *    as_unmap  - remove the mappings contained in a range, which must
+ *                not split any of them.
+ *
+ *    as_share_text - use the shared, already loaded copy of the text
+ *                segment of VN for the first region (see vmtext.h),
+ *                which is then mapped read-only. Called between
+ *                as_define_region and as_prepare_load; the segment
+ *                must not be loaded again afterwards.
+ *
+ *    as_translate - hand back the physical address of VADDR. Fails
+ *                with EFAULT if VADDR is not in the address space. The
+ *                caller must hold as_lock, and keep holding it for as
+ *                long as it relies on the address: once it lets go,
+ *                the page can be unmapped and its frame reused.
+ *
+ * Threads of one process share its address space, so as_lock guards
+ * the list of mappings against mmap/munmap in one thread racing a
+ * fault in another. It is a sleep lock; faults on mapped pages may
+ * read from a file while holding it.
+ *
  * Note that when using dumbvm, addrspace.c is not used and these
  * functions are found in dumbvm.c.
  */
@@ -121,6 +177,13 @@ int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
 
 #if OPT_SHELL
 int is_valid_pointer(userptr_t addr, struct addrspace *as);
+int as_map(struct addrspace *as, vaddr_t *vaddr, size_t npages,
+           int prot, int flags, struct vnode *vn, off_t offset,
+           struct shm_object *shm);
+int as_unmap(struct addrspace *as, vaddr_t vaddr, size_t npages);
+int as_share_text(struct addrspace *as, struct vnode *vn, off_t offset,
+                  vaddr_t vaddr, size_t filesize);
+int as_translate(struct addrspace *as, vaddr_t vaddr, paddr_t *ret);
 #endif
 
 
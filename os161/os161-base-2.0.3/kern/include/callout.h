@@ -0,0 +1,50 @@
+#ifndef _CALLOUT_H_
+#define _CALLOUT_H_
+
+/*
+ * Callouts: run a function a given number of hardclock ticks from now.
+ *
+ * Pending callouts are kept in a hierarchical timer wheel, so that
+ * scheduling and cancelling are constant time whatever the delay and
+ * each tick only looks at the callouts that are due (plus, now and
+ * then, one slot of a coarser level being spread over the finer ones).
+ *
+ * The function runs from the timer interrupt, so it must not sleep;
+ * waking up a wait channel is the usual thing to do. The callout
+ * struct is not touched again once the function has been called, so
+ * the function may free it or, if the callout lives on the stack of
+ * a sleeping thread, let that thread return.
+ */
+
+struct callout {
+	void (*co_func)(void *);	/* what to call */
+	void *co_arg;			/* argument for co_func */
+	unsigned co_expire;		/* tick it is due at */
+	bool co_pending;		/* on the wheel */
+	struct callout *co_next;	/* wheel slot links */
+	struct callout **co_pprev;
+};
+
+/* Set up a callout that will call FUNC(ARG). */
+void callout_init(struct callout *co, void (*func)(void *), void *arg);
+
+/*
+ * Arm CO to fire TICKS hardclocks from now (at least one). If it was
+ * already pending, it is moved.
+ */
+void callout_schedule(struct callout *co, unsigned ticks);
+
+/*
+ * Disarm CO. Returns true if it was pending, false if it had already
+ * fired (or was never armed); in the latter case its function may
+ * still be running on another CPU.
+ */
+bool callout_cancel(struct callout *co);
+
+/* Advance the wheel by one tick. Called by hardclock on one CPU. */
+void callout_tick(void);
+
+/* True if any callout is armed. */
+bool callout_pending(void);
+
+#endif /* _CALLOUT_H_ */
@@ -48,6 +48,17 @@
 void hardclock_bootstrap(void);
 void hardclock(void);
 
+/*
+ * Tickless idle. A CPU about to idle calls hardclock_stop, which
+ * stops its hardclock unless it is needed to keep time (in which case
+ * it returns false), and calls hardclock_restart when it wakes up if
+ * the clock was stopped. hardclock_wanted brings the timekeeping CPU
+ * back to ticking if it was idling without.
+ */
+bool hardclock_stop(void);
+void hardclock_restart(void);
+void hardclock_wanted(void);
+
 /*
  * timerclock() is called on one CPU once a second to allow simple
  * timed operations. (This is a fairly simpleminded interface.)
@@ -79,5 +90,11 @@ void timespec_sub(const struct timespec *t1,
  */
 void clocksleep(int seconds);
 
+/*
+ * clocksleep_ticks() does the same for a number of hardclock ticks
+ * (1/HZ of a second each).
+ */
+void clocksleep_ticks(unsigned ticks);
+
 
 #endif /* _CLOCK_H_ */
@@ -0,0 +1,50 @@
+#ifndef _ELFCACHE_H_
+#define _ELFCACHE_H_
+
+/*
+ * Parsed executables.
+ *
+ * load_elf turns the ELF header and program headers of a program into
+ * a struct elf_image: the entry point and the segments to load. The
+ * exec cache keeps the images of the last few programs run, keyed by
+ * vnode and checked against vnode_gen, so that running a program
+ * again skips reading and checking its headers. Entries hold a
+ * reference to their vnode, so a removed program would keep its disk
+ * blocks until pushed out: vfs_remove drops its entry with
+ * elfcache_forget, and elfcache_flush drops them all (e.g. before
+ * unmounting).
+ */
+
+struct vnode;
+
+/* Most loadable segments a program may have. */
+#define ELF_MAXSEGS 8
+
+struct elf_segment {
+	off_t es_offset;	/* where it is in the file */
+	vaddr_t es_vaddr;	/* where it goes in memory */
+	size_t es_memsize;
+	size_t es_filesize;
+	int es_flags;		/* PF_R, PF_W, PF_X */
+};
+
+struct elf_image {
+	vaddr_t ei_entry;	/* initial PC */
+	unsigned ei_nsegs;
+	struct elf_segment ei_segs[ELF_MAXSEGS];
+};
+
+/* Copy the cached image of VN into IMG; false if there is none. */
+bool elfcache_lookup(struct vnode *vn, struct elf_image *img);
+
+/* Remember IMG, parsed from VN when its generation was GEN. */
+void elfcache_insert(struct vnode *vn, unsigned gen,
+		     const struct elf_image *img);
+
+/* Forget VN, if it is cached. */
+void elfcache_forget(struct vnode *vn);
+
+/* Forget everything. */
+void elfcache_flush(void);
+
+#endif /* _ELFCACHE_H_ */
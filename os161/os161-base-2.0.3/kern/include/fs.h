@@ -86,6 +86,7 @@ struct fs_ops {
 
 /* Initialization functions for builtin fake file systems. */
 void semfs_bootstrap(void);
+void shmfs_bootstrap(void);
 
 
 #endif /* _FS_H_ */
@@ -0,0 +1,22 @@
+#ifndef _FUTEX_H_
+#define _FUTEX_H_
+
+/*
+ * Futexes: sleep until a word of user memory changes.
+ *
+ * Waiters are keyed by the physical address of the word, so threads
+ * of different processes meet on the same futex as long as they map
+ * the same frame (shared memory). Userland does the fast path with
+ * atomic instructions and only calls futex_wait/futex_wake when it
+ * actually has to sleep or wake someone up.
+ */
+
+struct proc;
+
+/* Set up the wait queues. */
+void futex_bootstrap(void);
+
+/* Wake every thread of P sleeping on a futex (P is exiting). */
+void futex_wakeproc(struct proc *p);
+
+#endif /* _FUTEX_H_ */
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2003, 2008
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_DIRENT_H_
+#define _KERN_DIRENT_H_
+
+/*
+ * Records returned by getdents().
+ *
+ * getdents() packs as many of these as fit into the caller's buffer.
+ * Besides the name, each record carries what a long directory listing
+ * needs, so the caller does not have to open and fstat every entry.
+ * Filesystems that cannot supply a field cheaply leave it "unknown".
+ *
+ * Records are variable-length; step through a buffer with d_reclen.
+ */
+struct dirent {
+	off_t d_size;		/* file size in bytes; -1 if unknown */
+	ino_t d_ino;		/* inode number; 0 if unknown */
+	mode_t d_type;		/* file type (_S_IFMT bits); 0 if unknown */
+	nlink_t d_nlink;	/* number of hard links; 0 if unknown */
+	__u16 d_reclen;		/* length of this record in bytes */
+	char d_name[];		/* null-terminated name */
+};
+
+/* Length of the record for a name of NAMELEN characters (8-aligned). */
+#define _DIRENT_RECLEN(namelen) \
+	((sizeof(struct dirent) + (namelen) + 1 + 7) & ~(size_t)7)
+
+#endif /* _KERN_DIRENT_H_ */
@@ -197,6 +197,16 @@
 #define SYS_reboot       119
 //#define SYS___sysctl   120
 
+//                              -- Local extensions --
+#define SYS_getdents     121
+#define SYS_spawn        122
+#define SYS___thread_create 123
+#define SYS___thread_exit   124
+#define SYS___thread_join   125
+#define SYS___futex_wait    126
+#define SYS___futex_wake    127
+#define SYS_sysstat         128
+
 /*CALLEND*/
 
 
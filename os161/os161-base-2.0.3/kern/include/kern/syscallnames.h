@@ -0,0 +1,111 @@
+#ifndef _KERN_SYSCALLNAMES_H_
+#define _KERN_SYSCALLNAMES_H_
+
+/*
+ * System call names, for printing system call statistics.
+ * This table must agree with kern/syscall.h: it has an entry for
+ * every call between the CALLBEGIN and CALLEND markers there, in the
+ * same order. Include it after <kern/syscall.h> and <kern/sysstat.h>.
+ *
+ * Since it defines syscall_names, it should only be included in one
+ * file. For the kernel, that file is syscall/sysstat.c; for userland
+ * it's testbin/sysstat/sysstat.c.
+ */
+static const char *const syscall_names[SYSSTAT_NCALLS] = {
+	[SYS_fork] = "fork",
+	[SYS_vfork] = "vfork",
+	[SYS_execv] = "execv",
+	[SYS__exit] = "_exit",
+	[SYS_waitpid] = "waitpid",
+	[SYS_getpid] = "getpid",
+	[SYS_getppid] = "getppid",
+	[SYS_sbrk] = "sbrk",
+	[SYS_mmap] = "mmap",
+	[SYS_munmap] = "munmap",
+	[SYS_mprotect] = "mprotect",
+	[SYS_umask] = "umask",
+	[SYS_issetugid] = "issetugid",
+	[SYS_getresuid] = "getresuid",
+	[SYS_setresuid] = "setresuid",
+	[SYS_getresgid] = "getresgid",
+	[SYS_setresgid] = "setresgid",
+	[SYS_getgroups] = "getgroups",
+	[SYS_setgroups] = "setgroups",
+	[SYS___getlogin] = "__getlogin",
+	[SYS___setlogin] = "__setlogin",
+	[SYS_kill] = "kill",
+	[SYS_sigaction] = "sigaction",
+	[SYS_sigpending] = "sigpending",
+	[SYS_sigprocmask] = "sigprocmask",
+	[SYS_sigsuspend] = "sigsuspend",
+	[SYS_sigreturn] = "sigreturn",
+	[SYS_open] = "open",
+	[SYS_pipe] = "pipe",
+	[SYS_dup] = "dup",
+	[SYS_dup2] = "dup2",
+	[SYS_close] = "close",
+	[SYS_read] = "read",
+	[SYS_pread] = "pread",
+	[SYS_getdirentry] = "getdirentry",
+	[SYS_write] = "write",
+	[SYS_pwrite] = "pwrite",
+	[SYS_lseek] = "lseek",
+	[SYS_flock] = "flock",
+	[SYS_ftruncate] = "ftruncate",
+	[SYS_fsync] = "fsync",
+	[SYS_fcntl] = "fcntl",
+	[SYS_ioctl] = "ioctl",
+	[SYS_select] = "select",
+	[SYS_poll] = "poll",
+	[SYS_link] = "link",
+	[SYS_remove] = "remove",
+	[SYS_mkdir] = "mkdir",
+	[SYS_rmdir] = "rmdir",
+	[SYS_mkfifo] = "mkfifo",
+	[SYS_rename] = "rename",
+	[SYS_access] = "access",
+	[SYS_chdir] = "chdir",
+	[SYS_fchdir] = "fchdir",
+	[SYS___getcwd] = "__getcwd",
+	[SYS_symlink] = "symlink",
+	[SYS_readlink] = "readlink",
+	[SYS_mount] = "mount",
+	[SYS_unmount] = "unmount",
+	[SYS_stat] = "stat",
+	[SYS_fstat] = "fstat",
+	[SYS_lstat] = "lstat",
+	[SYS_utimes] = "utimes",
+	[SYS_futimes] = "futimes",
+	[SYS_lutimes] = "lutimes",
+	[SYS_chmod] = "chmod",
+	[SYS_chown] = "chown",
+	[SYS_fchmod] = "fchmod",
+	[SYS_fchown] = "fchown",
+	[SYS_lchmod] = "lchmod",
+	[SYS_lchown] = "lchown",
+	[SYS_socket] = "socket",
+	[SYS_bind] = "bind",
+	[SYS_connect] = "connect",
+	[SYS_listen] = "listen",
+	[SYS_accept] = "accept",
+	[SYS_shutdown] = "shutdown",
+	[SYS_getsockname] = "getsockname",
+	[SYS_getpeername] = "getpeername",
+	[SYS_getsockopt] = "getsockopt",
+	[SYS_setsockopt] = "setsockopt",
+	[SYS___time] = "__time",
+	[SYS___settime] = "__settime",
+	[SYS_nanosleep] = "nanosleep",
+	[SYS_sync] = "sync",
+	[SYS_reboot] = "reboot",
+	[SYS_getdents] = "getdents",
+	[SYS_spawn] = "spawn",
+	[SYS___thread_create] = "__thread_create",
+	[SYS___thread_exit] = "__thread_exit",
+	[SYS___thread_join] = "__thread_join",
+	[SYS___futex_wait] = "__futex_wait",
+	[SYS___futex_wake] = "__futex_wake",
+	[SYS_sysstat] = "sysstat",
+};
+
+#endif /* _KERN_SYSCALLNAMES_H_ */
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2003, 2008
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_SYSSTAT_H_
+#define _KERN_SYSSTAT_H_
+
+/*
+ * Per-syscall statistics, as returned by sysstat().
+ *
+ * There is one record per system call number. The latency of a call
+ * is the time from entering the kernel to returning to user mode,
+ * sleeping included, so waitpid and read on a pipe count the time
+ * spent waiting. Histogram bucket 0 counts calls that took under a
+ * microsecond; bucket i counts calls that took from 2^(i-1) up to
+ * 2^i microseconds, except the last one, which takes everything
+ * longer. Calls that do not return (_exit, __thread_exit, and execv
+ * when it works) show up in ss_calls but not in the times.
+ */
+
+#define SYSSTAT_NCALLS		129	/* one more than the highest SYS_ number */
+#define SYSSTAT_NBUCKETS	20	/* the last one is 2^18 us (~0.26 s) on */
+
+struct sysstat {
+	__u32 ss_calls;			/* times called */
+	__u32 ss_errors;		/* times it failed */
+	__u64 ss_nsecs;			/* total time in the kernel */
+	__u32 ss_hist[SYSSTAT_NBUCKETS];	/* latency histogram */
+};
+
+#endif /* _KERN_SYSSTAT_H_ */
@@ -0,0 +1,65 @@
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention statistics. Enable with "options lockstat" in the
+ * kernel config.
+ *
+ * Every acquisition of a spinlock, ticket lock, sleep lock or
+ * semaphore is counted against its lock and call site: how many
+ * times it was taken, how many of those had to wait, the total time
+ * spent waiting and (except for semaphores, which have no owner) the
+ * longest time it was held. Times come from the realtime clock, so
+ * nothing is collected until lockstat_bootstrap has been called after
+ * the clock is attached.
+ *
+ * The "lockstat" menu command prints the most contended lock/site
+ * pairs and starts counting from zero again. Call sites are printed
+ * as addresses; look them up in the kernel with nm or addr2line.
+ */
+
+#include <kern/time.h>
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+struct lockstat_site;
+
+/* Embedded in locks that have a holder, to measure hold times. */
+struct lockstat_lockable {
+	struct lockstat_site *ls_site;	/* where the holder took it */
+	unsigned ls_gen;		/* table generation of ls_site */
+	struct timespec ls_acquired;	/* when the holder took it */
+};
+
+#define LOCKSTAT_LOCKABLE(sym)		struct lockstat_lockable sym
+#define LOCKSTAT_LOCKABLEINIT(l)	((l)->ls_site = NULL)
+
+/* Set once collection is on; checked before looking at the clock. */
+extern volatile bool lockstat_enabled;
+
+void lockstat_bootstrap(void);
+
+/*
+ * Record an acquisition of LOCK (named NAME) from PC. WAITSTART is
+ * when the caller found the lock busy, or NULL if it did not have to
+ * wait. L may be NULL for locks without a holder.
+ */
+void lockstat_acquired(struct lockstat_lockable *l, const void *lock,
+		       const char *name, const void *pc,
+		       const struct timespec *waitstart);
+
+/* Record a release, for the hold time. */
+void lockstat_released(struct lockstat_lockable *l);
+
+/* Print the N most contended lock/site pairs and reset the counts. */
+void lockstat_dump(unsigned n);
+
+#else
+
+#define LOCKSTAT_LOCKABLE(sym)
+#define LOCKSTAT_LOCKABLEINIT(l)
+
+#endif
+
+#endif /* _LOCKSTAT_H_ */
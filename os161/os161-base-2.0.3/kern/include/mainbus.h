@@ -52,6 +52,13 @@ void mainbus_interrupt(struct trapframe *);
 /* XXX this interface is not adequately MI */
 size_t mainbus_ramsize(void);
 
+/*
+ * Stop and restart the periodic hardclock interrupt of the current
+ * CPU, for idling without ticks. (Low-level; see hardclock_stop.)
+ */
+void mainbus_stop_hardclock(void);
+void mainbus_start_hardclock(void);
+
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
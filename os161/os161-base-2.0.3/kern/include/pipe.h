@@ -0,0 +1,27 @@
+#ifndef _PIPE_H_
+#define _PIPE_H_
+
+/*
+ * Anonymous pipes.
+ *
+ * A pipe is a kernel ring buffer with two vnodes in front of it: one
+ * for the read end and one for the write end. Each end is handed out
+ * through the usual openfile machinery, so fork/dup2/close work on
+ * pipes exactly as they do on regular files. Data written into a pipe
+ * never leaves kernel memory.
+ */
+
+struct vnode;
+
+/* Size of the ring buffer of each pipe (one page). */
+#define PIPE_BUFSIZE 4096
+
+/*
+ * Create a pipe. Hands back the vnode of the read end in RET_READ and
+ * the vnode of the write end in RET_WRITE, each with one reference.
+ * When the last reference to an end goes away, the other end sees
+ * EOF (reader) or EPIPE (writer).
+ */
+int pipe_create(struct vnode **ret_read, struct vnode **ret_write);
+
+#endif /* _PIPE_H_ */
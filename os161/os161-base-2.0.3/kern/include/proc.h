@@ -44,6 +44,7 @@
 struct addrspace;
 struct thread;
 struct vnode;
+struct wchan;
 
 /*
  * Process structure.
@@ -67,6 +68,18 @@ struct vnode;
 /* G.Cabodi - 2019 - implement waitpid: 
    synch with semaphore (1) or cond.var.(0) */
 #define USE_SEMAPHORE_FOR_WAITPID 1
+
+/*
+ * A user thread started by thread_create, from its creation until it
+ * has been joined. The first thread of a process has none.
+ */
+struct uthread {
+	int ut_tid;			/* thread id within the process */
+	struct thread *ut_thread;	/* the thread, NULL once exited */
+	bool ut_exited;
+	userptr_t ut_retval;		/* as passed to thread_exit */
+	struct uthread *ut_next;
+};
 #endif
 
 struct proc {
@@ -85,11 +98,25 @@ struct proc {
     /* G.Cabodi - 2019 - implement waitpid: synchro, and exit status */
     int p_status;                   /* status as obtained by exit() */
     pid_t p_pid;                    /* process pid */
+	struct proc *p_hashnext;	/* next in process table hash chain */
 	struct openfile *fileTable[OPEN_MAX];
-	struct lock *ft_lock;
+	struct rwlock *ft_lock;		/* fileTable: fd lookups read */
 
 	int p_exited;
+	bool p_orphaned;		/* parent exited first: self-reaping */
+	struct wchan *p_waitchan;	/* waitpid sleeps here for children */
 	struct proc *parent_proc;
+	/* children, linked through p_nextsib/p_prevsib */
+	struct proc *p_children;
+	struct proc *p_nextsib;
+	struct proc *p_prevsib;
+	/* set while we run on our parent's address space (vfork) */
+	struct semaphore *p_vforksem;
+	/* user threads, protected by p_lock */
+	struct uthread *p_uthreads;	/* not yet joined */
+	int p_nexttid;
+	struct wchan *p_joinchan;	/* thread_join sleeps here */
+	bool p_exiting;			/* _exit called; p_status is set */
 #if USE_SEMAPHORE_FOR_WAITPID
 	struct semaphore *p_sem;
 #else
@@ -115,8 +142,8 @@ void proc_destroy(struct proc *proc);
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
 
-/* Detach a thread from its process. */
-void proc_remthread(struct thread *t);
+/* Detach a thread from its process; true if it was the last one. */
+bool proc_remthread(struct thread *t);
 
 /* Fetch the address space of the current process. */
 struct addrspace *proc_getas(void);
@@ -129,14 +156,25 @@ struct addrspace *proc_setas(struct addrspace *);
 int proc_wait(struct proc *proc);
 /* get proc from pid */
 struct proc *proc_search_pid(pid_t pid);
+/* wait for a child (pid, or -1 for any) to exit, and reap it */
+int proc_wait_child(struct proc *parent, pid_t pid, bool nohang,
+		    int *status, pid_t *retpid);
 /* signal end/exit of process */
 void proc_signal_end(struct proc *proc);
 /* copy file table from proc psrc to proc pdest */
 void proc_file_table_copy(struct proc *psrc, struct proc *pdest);
 /* return true if process table is full */
 bool is_proc_table_full(void);
+/* Make child a child of parent */
+void proc_add_child(struct proc *parent, struct proc *child);
 /* Remove the link to the parent (if it exits) from children processes */
-void proc_rm_parent_link(pid_t pid);
+void proc_rm_parent_link(struct proc *proc);
+/* Give a vforked process's parent its address space back */
+bool proc_vfork_release(struct proc *proc, bool exiting);
+/* Make the current process exit with wait status STATUS */
+__DEAD void proc_exit(int status);
+/* Take the current thread out of its process; the last one ends it */
+__DEAD void proc_exit_thread(void);
 
 #endif
 #endif /* _PROC_H_ */
@@ -0,0 +1,34 @@
+#ifndef _PROF_H_
+#define _PROF_H_
+
+/*
+ * Sampling kernel profiler.
+ *
+ * While it is on, every hardclock records where the CPU was: the
+ * interrupted PC and the return address register, which for a leaf
+ * function (or one that has not made a call yet) is its caller. A
+ * tick that interrupted user code is only counted as such. Samples go
+ * into a buffer per CPU, so taking one costs no locking.
+ *
+ * "prof on", "prof off" and "prof dump" in the kernel menu drive it.
+ * The dump is one line per distinct sample with its count, in raw
+ * addresses; testscripts/profsym.py turns it into function names (or
+ * into folded stacks for flame graph tools) using the kernel ELF.
+ */
+
+/* Called by the timer interrupt with the interrupted PC and RA. */
+void prof_tick(vaddr_t pc, vaddr_t ra, bool user);
+
+/* Start collecting, discarding earlier samples. Returns an errno. */
+int prof_start(void);
+
+/* Stop collecting; samples being taken on other CPUs finish first. */
+void prof_stop(void);
+
+/* Print the samples collected (stopping first if needed). */
+void prof_dump(void);
+
+/* Print whether it is on and how much it has collected. */
+void prof_status(void);
+
+#endif /* _PROF_H_ */
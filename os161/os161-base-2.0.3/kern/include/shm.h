@@ -0,0 +1,34 @@
+#ifndef _SHM_H_
+#define _SHM_H_
+
+/*
+ * Shared memory objects.
+ *
+ * A shm object is a set of physical frames that several address
+ * spaces can map at the same time (see struct vm_mapping). It is
+ * created either by mmap(MAP_SHARED|MAP_ANON), in which case it is
+ * shared with the children forked afterwards, or through a name in
+ * the "shm:" filesystem. Frames are allocated zero-filled the first
+ * time any process touches a page, and freed when the last reference
+ * to the object goes away.
+ */
+
+struct shm_object;
+
+/* Create an object of NPAGES pages, with one reference. */
+struct shm_object *shm_create(size_t npages);
+
+/* Reference counting. */
+void shm_incref(struct shm_object *shm);
+void shm_decref(struct shm_object *shm);
+
+/* Current size in pages. */
+size_t shm_npages(struct shm_object *shm);
+
+/* Change the size; fails with EBUSY if anyone else holds a reference. */
+int shm_resize(struct shm_object *shm, size_t npages);
+
+/* Get the frame of page IDX, allocating it if needed. */
+int shm_getpage(struct shm_object *shm, unsigned idx, paddr_t *ret);
+
+#endif /* _SHM_H_ */
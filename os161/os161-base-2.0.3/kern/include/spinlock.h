@@ -37,6 +37,7 @@
 
 #include <cdefs.h>
 #include <hangman.h>
+#include <lockstat.h>
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -59,16 +60,21 @@ struct spinlock {
 	volatile spinlock_data_t splk_lock; /* Memory word where we spin. */
 	struct cpu *splk_holder;	    /* CPU holding this lock. */
 	HANGMAN_LOCKABLE(splk_hangman);     /* Deadlock detector hook. */
+	LOCKSTAT_LOCKABLE(splk_stat);       /* Contention statistics. */
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
+ * (The lockstat hook, if any, is left zeroed; the designators keep
+ * gcc from complaining about that.)
  */
 #ifdef OPT_HANGMAN
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, \
+#define SPINLOCK_INITIALIZER	{ .splk_lock = SPINLOCK_DATA_INITIALIZER, \
+				  .splk_holder = NULL, \
 				  HANGMAN_LOCKABLE_INITIALIZER }
 #else
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#define SPINLOCK_INITIALIZER	{ .splk_lock = SPINLOCK_DATA_INITIALIZER, \
+				  .splk_holder = NULL }
 #endif
 
 /*
@@ -92,4 +98,47 @@ void spinlock_release(struct spinlock *lk);
 bool spinlock_do_i_hold(struct spinlock *lk);
 
 
+/*
+ * Ticket lock.
+ *
+ * A spinlock that is granted in FIFO order: each CPU that wants the
+ * lock takes the next ticket and waits for its number to come up, so
+ * nobody can be overtaken. Waiters only read the lock while they
+ * wait, and the holder hands it on with a single store, which keeps
+ * the bus quiet when the lock is hot.
+ *
+ * Otherwise it behaves like a spinlock: it is held by a CPU, and
+ * interrupts are off while it is held. It cannot be passed to
+ * wchan_sleep and friends; use it for locks that are only ever
+ * acquired and released.
+ */
+struct ticketlock {
+	volatile spinlock_data_t tl_next;	/* next ticket to hand out */
+	volatile spinlock_data_t tl_serving;	/* ticket now holding it */
+	struct cpu *tl_holder;			/* CPU holding this lock. */
+	HANGMAN_LOCKABLE(tl_hangman);		/* Deadlock detector hook. */
+	LOCKSTAT_LOCKABLE(tl_stat);		/* Contention statistics. */
+};
+
+#ifdef OPT_HANGMAN
+#define TICKETLOCK_INITIALIZER	{ .tl_next = SPINLOCK_DATA_INITIALIZER, \
+				  .tl_serving = SPINLOCK_DATA_INITIALIZER, \
+				  .tl_holder = NULL, \
+				  HANGMAN_LOCKABLE_INITIALIZER }
+#else
+#define TICKETLOCK_INITIALIZER	{ .tl_next = SPINLOCK_DATA_INITIALIZER, \
+				  .tl_serving = SPINLOCK_DATA_INITIALIZER, \
+				  .tl_holder = NULL }
+#endif
+
+/* Same as the spinlock functions. */
+void ticketlock_init(struct ticketlock *lk);
+void ticketlock_cleanup(struct ticketlock *lk);
+
+void ticketlock_acquire(struct ticketlock *lk);
+void ticketlock_release(struct ticketlock *lk);
+
+bool ticketlock_do_i_hold(struct ticketlock *lk);
+
+
 #endif /* _SPINLOCK_H_ */
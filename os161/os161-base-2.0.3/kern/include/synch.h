@@ -95,6 +95,8 @@ struct lock {
 #endif
 	struct spinlock lk_lock;
         volatile struct thread *lk_owner;
+	struct cpu *volatile lk_ownercpu; /* where lk_owner took it */
+	LOCKSTAT_LOCKABLE(lk_stat);	/* for lockstat; see lockstat.h */
 #else
         HANGMAN_LOCKABLE(lk_hangman);   /* Deadlock detector hook. */
 #endif
@@ -164,4 +166,67 @@ void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers can hold the lock at the same time, or else a
+ * single writer. A reader that arrives while a writer holds the lock
+ * or waits for it queues up, so a stream of readers cannot starve
+ * writers. What happens when a writer releases the lock depends on
+ * the mode:
+ *
+ *    RWLOCK_WRITERPREF - the next waiting writer goes first; waiting
+ *                        readers only get in when no writer is left.
+ *                        Readers can starve under a steady stream of
+ *                        writers.
+ *    RWLOCK_FAIR       - all the readers waiting at that point get in
+ *                        together, then the next writer. Nobody
+ *                        starves.
+ *
+ * Readers that were queued are always let in as a group by the
+ * releasing writer, so they do not have to race for the lock.
+ *
+ * The name field is for easier debugging. A copy of the name is made
+ * internally.
+ */
+#define RWLOCK_WRITERPREF	0
+#define RWLOCK_FAIR		1
+
+struct rwlock {
+	char *rw_name;
+	struct spinlock rw_lock;
+	struct wchan *rw_rwchan;		/* readers wait here */
+	struct wchan *rw_wwchan;		/* writers wait here */
+	int rw_mode;
+	volatile unsigned rw_readers;		/* readers inside */
+	volatile unsigned rw_rwait;		/* readers queued */
+	volatile unsigned rw_wwait;		/* writers queued */
+	volatile unsigned rw_rgen;		/* bumped when readers are let in */
+	volatile struct thread *rw_writer;	/* writer inside, if any */
+};
+
+struct rwlock *rwlock_create(const char *name, int mode);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read   - Get the lock shared.
+ *    rwlock_release_read   - Drop a shared hold.
+ *    rwlock_acquire_write  - Get the lock exclusive.
+ *    rwlock_release_write  - Drop the exclusive hold. Only the writer
+ *                            may do this.
+ *    rwlock_do_i_hold_write - Return true if the current thread holds
+ *                            the lock exclusive. (Readers are not
+ *                            tracked individually.)
+ *
+ * A reader must not try to upgrade to writer: it would wait for
+ * itself.
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
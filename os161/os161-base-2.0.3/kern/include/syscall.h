@@ -37,6 +37,7 @@
 #include <synch.h>
 
 struct trapframe; /* from <machine/trapframe.h> */
+struct proc;      /* from <proc.h> */
 
 /*
  * The system call dispatcher.
@@ -51,6 +52,9 @@ void syscall(struct trapframe *tf);
 /* Helper for fork(). You write this. */
 void enter_forked_process(struct trapframe *tf);
 
+/* Helper for thread_create: TF is kmalloc'd and freed here. */
+__DEAD void enter_new_thread(struct trapframe *tf);
+
 /* Enter user mode. Does not return. */
 __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 		       vaddr_t stackptr, vaddr_t entrypoint);
@@ -62,6 +66,8 @@ __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(userptr_t req, userptr_t rem);
+int sys_sysstat(userptr_t buf, unsigned ncalls, int32_t *retval);
 #if OPT_SHELL
 /* system open file table */
 struct openfile {
@@ -73,7 +79,10 @@ struct openfile {
 };
 void sft_init(void);
 void openfileIncrRefCount(struct openfile *of);
+int openfileDecrRefCount(struct openfile *of);
 int std_open(int fileno);
+int proc_fd_close(struct proc *p, int fd);
+int proc_fd_dup2(struct proc *p, int oldfd, int newfd);
 int sys_open(userptr_t path, int openflags, mode_t mode, int *errp);
 int sys_close(int fd, int *errp);
 int sys_write(int fd, userptr_t buf_ptr, size_t size, int *errp);
@@ -82,6 +91,9 @@ void sys__exit(int status);
 int sys_waitpid(pid_t pid, int* statusp, int options, int *errp, bool is_kernel);
 pid_t sys_getpid(void);
 int sys_fork(struct trapframe *ctf, pid_t *retval);
+int sys_vfork(struct trapframe *ctf, pid_t *retval);
+int sys_spawn(userptr_t path, userptr_t args, userptr_t actions, int nactions,
+              pid_t *retval);
 off_t sys_lseek(int fd, off_t pos, int whence, int *errp);
 int sys_dup2(int oldfd, int newfd, int *errp);
 int sys_chdir(userptr_t path, int *errp);
@@ -89,6 +101,19 @@ int sys___getcwd(userptr_t buf_ptr, size_t buflen, int *errp);
 int sys_execv(userptr_t program, userptr_t args, int *errp);
 int sys_fstat(int fd, struct stat *statbuf, int *errp);
 int sys_getdirentry(int fd, char *buf, size_t buflen, int* errp);
+int sys_getdents(int fd, userptr_t buf, size_t buflen, int *errp);
+int sys_pipe(userptr_t fds, int *errp);
+int sys_ftruncate(int fd, off_t len, int *errp);
+int sys_remove(userptr_t path, int *errp);
+vaddr_t sys_mmap(vaddr_t addr, size_t len, int prot, int flags, int fd,
+                 off_t offset, int *errp);
+int sys_munmap(vaddr_t addr, size_t len, int *errp);
+int sys_thread_create(struct trapframe *ctf, vaddr_t entry, vaddr_t arg,
+                      vaddr_t stack, int *retval);
+__DEAD void sys_thread_exit(userptr_t retval);
+int sys_thread_join(int tid, userptr_t retvalp);
+int sys_futex_wait(userptr_t uaddr, int val);
+int sys_futex_wake(userptr_t uaddr, int n, int *errp);
 #endif
 
 #endif /* _SYSCALL_H_ */
@@ -0,0 +1,37 @@
+#ifndef _SYSSTAT_H_
+#define _SYSSTAT_H_
+
+/*
+ * Per-syscall call counts, error counts and latency histograms.
+ *
+ * syscall() reports every call here. Each CPU keeps its own table and
+ * updates it with interrupts off, so the syscall path never takes a
+ * lock; readers add the tables up. The records are struct sysstat
+ * (see kern/sysstat.h), which is also what the sysstat() system call
+ * hands to user programs.
+ *
+ * "sysstat" in the kernel menu prints the totals and "sysstat reset"
+ * starts them over.
+ */
+
+#include <kern/sysstat.h>
+
+struct timespec;
+
+/* Set up the per-CPU tables. Call once all CPUs are known. */
+void sysstat_bootstrap(void);
+
+/* Called by syscall() on entry, and on the way out with the result. */
+void sysstat_enter(int callno);
+void sysstat_exit(int callno, int err, const struct timespec *start);
+
+/* Add up the tables for CALLNO into SS. */
+void sysstat_get(int callno, struct sysstat *ss);
+
+/* Print the calls made so far. */
+void sysstat_dump(void);
+
+/* Zero the counts. */
+void sysstat_reset(void);
+
+#endif /* _SYSSTAT_H_ */
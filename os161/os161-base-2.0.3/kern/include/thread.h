@@ -83,6 +83,8 @@ struct thread {
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
+	unsigned t_prio;		/* Scheduling level, 0 is highest */
+	unsigned t_ticks;		/* Hardclocks used at this level */
 	HANGMAN_ACTOR(t_hangman);	/* Deadlock detector hook */
 
 	/*
@@ -159,15 +161,16 @@ __DEAD void thread_exit(void);
 void thread_yield(void);
 
 /*
- * Reshuffle the run queue. Called from the timer interrupt.
+ * Charge a tick to the current thread and preempt it if its quantum
+ * is used up or a higher-priority thread is ready. Called from the
+ * timer interrupt on every tick.
  */
-void schedule(void);
+void thread_timeslice(void);
 
 /*
- * Potentially migrate ready threads to other CPUs. Called from the
- * timer interrupt.
+ * Reshuffle the run queue. Called from the timer interrupt.
  */
-void thread_consider_migration(void);
+void schedule(void);
 
 
 #endif /* _THREAD_H_ */
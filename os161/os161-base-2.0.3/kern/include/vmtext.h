@@ -0,0 +1,54 @@
+#ifndef _VMTEXT_H_
+#define _VMTEXT_H_
+
+/*
+ * Shared program text.
+ *
+ * The read-only executable segment of a program is loaded once per
+ * vnode and the same frames are mapped, read-only, into every address
+ * space running that program. A text object lives as long as some
+ * address space uses it, so memory goes with the number of distinct
+ * programs running rather than with the number of processes. While
+ * it exists its file cannot be opened for writing (ETXTBSY), and
+ * while its file is open for writing it is not shared: exec loads a
+ * private copy instead.
+ *
+ * Writers are the files opened through open() and pipe(), which call
+ * text_write_begin/text_write_end. Opens made from inside the kernel
+ * (vfs_open directly, as the fstest menu tests do) are only refused
+ * while the program is running; they are not counted as writers.
+ */
+
+struct vnode;
+struct text_object;
+
+/* Call once during system startup. */
+void text_bootstrap(void);
+
+/*
+ * Get (with a new reference) the text whose NPAGES pages are loaded
+ * from FILESIZE bytes of VN at OFFSET, placed at VADDR. Reads it in
+ * if nobody is running it yet. Fails with ETXTBSY if VN is open for
+ * writing.
+ */
+int text_get(struct vnode *vn, off_t offset, vaddr_t vaddr,
+	     size_t filesize, size_t npages, struct text_object **ret);
+
+/* Reference counting. */
+void text_incref(struct text_object *tx);
+void text_decref(struct text_object *tx);
+
+/* Physical address of the first page (the frames are contiguous). */
+paddr_t text_pbase(struct text_object *tx);
+
+/* True if some process is running the program in VN. */
+bool text_busy(struct vnode *vn);
+
+/*
+ * Open file VN for writing (ETXTBSY if some process is running it),
+ * and close it again.
+ */
+int text_write_begin(struct vnode *vn);
+void text_write_end(struct vnode *vn);
+
+#endif /* _VMTEXT_H_ */
@@ -33,6 +33,7 @@
 #include <spinlock.h>
 struct uio;
 struct stat;
+struct shm_object;
 
 
 /*
@@ -50,7 +51,8 @@ struct stat;
  */
 struct vnode {
 	int vn_refcount;                /* Reference count */
-	struct spinlock vn_countlock;   /* Lock for vn_refcount */
+	unsigned vn_gen;                /* Bumped when contents change */
+	struct spinlock vn_countlock;   /* Lock for vn_refcount, vn_gen */
 
 	struct fs *vn_fs;               /* Filesystem vnode belongs to */
 
@@ -98,6 +100,18 @@ struct vnode {
  *                      handled in the normal fashion.
  *                      On non-directory objects, return ENOTDIR.
  *
+ *    vop_getdirents  - Like vop_getdirentry, but pack as many struct
+ *                      dirent records (see kern/dirent.h) into the
+ *                      uio as fit, starting at the entry named by the
+ *                      offset field and updating that field past the
+ *                      last entry copied out. Stop at a record that
+ *                      does not fit; if not even one fits, return
+ *                      EINVAL. At end of directory, copy nothing.
+ *                      Filesystems without a native version can use
+ *                      vnode_getdirents_generic, which is built on
+ *                      vop_getdirentry and reports only the names.
+ *                      On non-directory objects, return ENOTDIR.
+ *
  *    vop_write       - Write data from uio to file at offset specified
  *                      in the uio, updating uio_resid to reflect the
  *                      amount written, and updating uio_offset to match.
@@ -113,6 +127,10 @@ struct vnode {
  *    vop_gettype     - Return type of file. The values for file types
  *                      are in kern/stattypes.h.
  *
+ *    vop_getsize     - Return the current size of the file in bytes.
+ *                      Should be cheap (no full stat, preferably no
+ *                      I/O); used for SEEK_END and O_APPEND.
+ *
  *    vop_isseekable  - Check if this file is seekable. All regular files
  *                      and directories are seekable, but some devices are
  *                      not.
@@ -120,9 +138,12 @@ struct vnode {
  *    vop_fsync       - Force any dirty buffers associated with this file
  *                      to stable storage.
  *
- *    vop_mmap        - Map file into memory. If you implement this
- *                      feature, you're responsible for choosing the
- *                      arguments for this operation.
+ *    vop_mmap        - Check whether the file can be mapped into memory
+ *                      with protection PROT and mapping flags FLAGS (see
+ *                      <kern/mman.h>). Files that are memory objects
+ *                      hand back the shm object to map in RET, with a
+ *                      reference; others set RET to NULL, and pages are
+ *                      then read on demand with vop_read by the VM system.
  *
  *    vop_truncate    - Forcibly set size of file to the length passed
  *                      in, discarding any excess blocks.
@@ -187,13 +208,16 @@ struct vnode_ops {
 	int (*vop_read)(struct vnode *file, struct uio *uio);
 	int (*vop_readlink)(struct vnode *link, struct uio *uio);
 	int (*vop_getdirentry)(struct vnode *dir, struct uio *uio);
+	int (*vop_getdirents)(struct vnode *dir, struct uio *uio);
 	int (*vop_write)(struct vnode *file, struct uio *uio);
 	int (*vop_ioctl)(struct vnode *object, int op, userptr_t data);
 	int (*vop_stat)(struct vnode *object, struct stat *statbuf);
 	int (*vop_gettype)(struct vnode *object, mode_t *result);
+	int (*vop_getsize)(struct vnode *object, off_t *result);
 	bool (*vop_isseekable)(struct vnode *object);
 	int (*vop_fsync)(struct vnode *object);
-	int (*vop_mmap)(struct vnode *file /* add stuff */);
+	int (*vop_mmap)(struct vnode *file, int prot, int flags,
+			struct shm_object **ret);
 	int (*vop_truncate)(struct vnode *file, off_t len);
 	int (*vop_namefile)(struct vnode *file, struct uio *uio);
 
@@ -231,13 +255,15 @@ struct vnode_ops {
 #define VOP_READ(vn, uio)               (__VOP(vn, read)(vn, uio))
 #define VOP_READLINK(vn, uio)           (__VOP(vn, readlink)(vn, uio))
 #define VOP_GETDIRENTRY(vn, uio)        (__VOP(vn,getdirentry)(vn, uio))
+#define VOP_GETDIRENTS(vn, uio)         (__VOP(vn, getdirents)(vn, uio))
 #define VOP_WRITE(vn, uio)              (__VOP(vn, write)(vn, uio))
 #define VOP_IOCTL(vn, code, buf)        (__VOP(vn, ioctl)(vn,code,buf))
 #define VOP_STAT(vn, ptr) 	        (__VOP(vn, stat)(vn, ptr))
 #define VOP_GETTYPE(vn, result)         (__VOP(vn, gettype)(vn, result))
+#define VOP_GETSIZE(vn, result)         (__VOP(vn, getsize)(vn, result))
 #define VOP_ISSEEKABLE(vn)              (__VOP(vn, isseekable)(vn))
 #define VOP_FSYNC(vn)                   (__VOP(vn, fsync)(vn))
-#define VOP_MMAP(vn /*add stuff */)     (__VOP(vn, mmap)(vn /*add stuff */))
+#define VOP_MMAP(vn, prot, flags, ret)  (__VOP(vn, mmap)(vn, prot, flags, ret))
 #define VOP_TRUNCATE(vn, pos)           (__VOP(vn, truncate)(vn, pos))
 #define VOP_NAMEFILE(vn, uio)           (__VOP(vn, namefile)(vn, uio))
 
@@ -279,6 +305,29 @@ int vnode_init(struct vnode *, const struct vnode_ops *ops,
  */
 void vnode_cleanup(struct vnode *);
 
+/*
+ * Generation number of the contents, for caches of things derived
+ * from them: vnode_modified is called after every change made through
+ * the syscall layer (write, truncate), and vnode_gen reads it.
+ */
+void vnode_modified(struct vnode *vn);
+unsigned vnode_gen(struct vnode *vn);
+
+/*
+ * Helpers for vop_getdirents (in vfs/vfsdirent.c).
+ *
+ * vnode_emitdirent appends one record to UIO, or returns ENOSPC
+ * without copying anything if the record does not fit.
+ */
+int vnode_emitdirent(struct uio *uio, ino_t ino, mode_t type,
+		     nlink_t nlink, off_t size, const char *name);
+int vnode_getdirents_generic(struct vnode *dir, struct uio *uio);
+
+/*
+ * vop_getsize for filesystems with no cheaper way than vop_stat.
+ */
+int vnode_getsize_bystat(struct vnode *vn, off_t *result);
+
 /*
  * Common stubs for vnode functions that just fail, in various ways.
  */
@@ -286,9 +335,12 @@ int vopfail_uio_notdir(struct vnode *vn, struct uio *uio);
 int vopfail_uio_isdir(struct vnode *vn, struct uio *uio);
 int vopfail_uio_inval(struct vnode *vn, struct uio *uio);
 int vopfail_uio_nosys(struct vnode *vn, struct uio *uio);
-int vopfail_mmap_isdir(struct vnode *vn /* add stuff */);
-int vopfail_mmap_perm(struct vnode *vn /* add stuff */);
-int vopfail_mmap_nosys(struct vnode *vn /* add stuff */);
+int vopfail_mmap_isdir(struct vnode *vn, int prot, int flags,
+		       struct shm_object **ret);
+int vopfail_mmap_perm(struct vnode *vn, int prot, int flags,
+		      struct shm_object **ret);
+int vopfail_mmap_nosys(struct vnode *vn, int prot, int flags,
+		       struct shm_object **ret);
 int vopfail_truncate_isdir(struct vnode *vn, off_t pos);
 int vopfail_creat_notdir(struct vnode *vn, const char *name, bool excl,
 			 mode_t mode, struct vnode **result);
@@ -50,6 +50,12 @@
 #include <test.h>
 #include <version.h>
 #include "autoconf.h"  // for pseudoconfig
+#include "opt-shell.h"
+#if OPT_SHELL
+#include <futex.h>
+#endif
+#include <lockstat.h>
+#include <sysstat.h>
 
 
 /*
@@ -125,7 +131,14 @@ boot(void)
 
 	/* Late phase of initialization. */
 	vm_bootstrap();
+#if OPT_SHELL
+	futex_bootstrap();
+#endif
 	kprintf_bootstrap();
+#if OPT_LOCKSTAT
+	lockstat_bootstrap();
+#endif
+	sysstat_bootstrap();
 	thread_start_cpus();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
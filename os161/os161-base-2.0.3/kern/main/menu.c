@@ -45,8 +45,12 @@
 #include <test.h>
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-lockstat.h"
 #include <syscall.h>
 #include <current.h>
+#include <lockstat.h>
+#include <prof.h>
+#include <sysstat.h>
 
 /*
  * In-kernel menu and command dispatcher.
@@ -521,6 +525,83 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Command for the sampling profiler.
+ */
+static
+int
+cmd_prof(int nargs, char **args)
+{
+	int result;
+
+	if (nargs == 1) {
+		prof_status();
+		return 0;
+	}
+	if (nargs == 2 && !strcmp(args[1], "on")) {
+		result = prof_start();
+		if (result) {
+			kprintf("prof on: %s\n", strerror(result));
+		}
+		return result;
+	}
+	if (nargs == 2 && !strcmp(args[1], "off")) {
+		prof_stop();
+		prof_status();
+		return 0;
+	}
+	if (nargs == 2 && !strcmp(args[1], "dump")) {
+		prof_dump();
+		return 0;
+	}
+	kprintf("Usage: prof [on | off | dump]\n");
+	return EINVAL;
+}
+
+/*
+ * Command for printing the system call statistics, or with "reset",
+ * for starting them over.
+ */
+static
+int
+cmd_sysstat(int nargs, char **args)
+{
+	if (nargs == 1) {
+		sysstat_dump();
+		return 0;
+	}
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		sysstat_reset();
+		return 0;
+	}
+	kprintf("Usage: sysstat [reset]\n");
+	return EINVAL;
+}
+
+#if OPT_LOCKSTAT
+/*
+ * Command for printing the most contended locks. The counts start
+ * over afterwards, so run it once, run the workload, run it again.
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	int n = 10;
+
+	if (nargs == 2) {
+		n = atoi(args[1]);
+	}
+	if (nargs > 2 || n <= 0) {
+		kprintf("Usage: lockstat [count]\n");
+		return EINVAL;
+	}
+
+	lockstat_dump(n);
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -597,6 +678,9 @@ static const char *testmenu[] = {
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
 	"[sy4] CV test #2            (1)     ",
+	"[sy5] RW lock test                  ",
+	"[sy6] RW lock test #2               ",
+	"[spb] Spinlock benchmark            ",
 	"[semu1-22] Semaphore unit tests     ",
 	"[fs1] Filesystem test               ",
 	"[fs2] FS read stress                ",
@@ -628,6 +712,11 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+	"[prof] Kernel profiler on/off/dump  ",
+	"[sysstat] System call stats [reset] ",
+#if OPT_LOCKSTAT
+	"[lockstat] Most contended locks     ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -679,6 +768,11 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "prof",       cmd_prof },
+	{ "sysstat",    cmd_sysstat },
+#if OPT_LOCKSTAT
+	{ "lockstat",   cmd_lockstat },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -701,6 +795,9 @@ static struct {
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "sy5",	rwtest },
+	{ "sy6",	rwtest2 },
+	{ "spb",	spinbench },
 
 	/* semaphore unit tests */
 	{ "semu1",	semu1 },
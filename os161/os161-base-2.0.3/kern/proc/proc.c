@@ -49,19 +49,52 @@
 #include <addrspace.h>
 #include <vnode.h>
 #include <syscall.h>
+#include <kern/errno.h>
 #include <kern/unistd.h>
 #include <vfs.h>
 #include <synch.h>
+#include <wchan.h>
+#include <thread.h>
+#include <kern/wait.h>
+#include <futex.h>
 
 #if OPT_SHELL
-#define MAX_PROC 100
+/*
+ * Process table.
+ *
+ * PIDs are handed out from a bitmap covering PID_MIN..PID_MAX. The
+ * search starts after the last PID given out, so that a PID is not
+ * reused right after its process goes away, and skips full words 32
+ * PIDs at a time. Live processes are found by PID through a chained
+ * hash table, which doubles whenever it holds more than two processes
+ * per bucket on average.
+ */
+#define PT_MINBUCKETS 64
+#define PT_MAPWORDS ((PID_MAX + 32) / 32)
+
+static struct proc *pt_initbuckets[PT_MINBUCKETS];
+
 static struct _processTable {
-  // int active;           /* initial value 0 */
-  struct proc *proc[MAX_PROC+1]; /* [0] not used. pids are >= 1 */
-  int last_i;           /* index of last allocated pid */
-  struct spinlock lk;	/* Lock for this table */
+  uint32_t pidmap[PT_MAPWORDS];	/* bit set = PID in use */
+  pid_t last_pid;		/* last PID handed out */
+  struct proc **buckets;	/* hash chains, linked by p_hashnext */
+  unsigned nbuckets;		/* power of two */
+  unsigned nprocs;		/* processes in the table */
+  struct ticketlock lk;	/* Lock for this table */
   bool is_full;
-} processTable;
+} processTable = {
+  .last_pid = PID_MIN - 1,
+  .buckets = pt_initbuckets,
+  .nbuckets = PT_MINBUCKETS,
+  .lk = TICKETLOCK_INITIALIZER,
+};
+
+/*
+ * Protects the parent/child links of all processes (parent_proc and
+ * the child lists), p_exited and p_orphaned. Held for O(1) work at
+ * exit and O(children) work in waitpid and when orphaning children.
+ */
+static struct spinlock familylk = SPINLOCK_INITIALIZER;
 
 struct lock *ft_copy_lock;
 #endif
@@ -76,29 +109,123 @@ struct proc *kproc;
 bool
 is_proc_table_full(void){
 	bool tmp;
-	spinlock_acquire(&processTable.lk);
+	ticketlock_acquire(&processTable.lk);
 	tmp = processTable.is_full;
-	spinlock_release(&processTable.lk);
+	ticketlock_release(&processTable.lk);
 	return tmp;
 }
 
-/* Remove the link to the parent (if it exits) from children processes */
-void proc_rm_parent_link(pid_t pid) {
-	int i;
-	struct proc *p;
+/*
+ * Make child a child of parent.
+ */
+void
+proc_add_child(struct proc *parent, struct proc *child) {
+	spinlock_acquire(&familylk);
+	child->parent_proc = parent;
+	child->p_prevsib = NULL;
+	child->p_nextsib = parent->p_children;
+	if (parent->p_children != NULL)
+		parent->p_children->p_prevsib = child;
+	parent->p_children = child;
+	spinlock_release(&familylk);
+}
+
+/* Take proc off its parent's child list. Called with familylk held. */
+static void
+proc_unlink_child_locked(struct proc *proc) {
+	struct proc *parent = proc->parent_proc;
+
+	KASSERT(spinlock_do_i_hold(&familylk));
+	if (parent == NULL)
+		return;
+	if (proc->p_prevsib != NULL)
+		proc->p_prevsib->p_nextsib = proc->p_nextsib;
+	else
+		parent->p_children = proc->p_nextsib;
+	if (proc->p_nextsib != NULL)
+		proc->p_nextsib->p_prevsib = proc->p_prevsib;
+	proc->parent_proc = NULL;
+	proc->p_nextsib = proc->p_prevsib = NULL;
+}
+
+static void
+proc_unlink_child(struct proc *proc) {
+	spinlock_acquire(&familylk);
+	proc_unlink_child_locked(proc);
+	spinlock_release(&familylk);
+}
 
-	KASSERT(!(pid < PID_MIN || pid > MAX_PROC));
+/*
+ * Remove the link to the parent (if it exits) from children processes.
+ * Children that have already exited are reaped here, since nobody is
+ * left to wait for them; the others reap themselves when they exit.
+ */
+void proc_rm_parent_link(struct proc *proc) {
+	struct proc *c, *next, *zombies = NULL;
+
+	spinlock_acquire(&familylk);
+	for (c = proc->p_children; c != NULL; c = next) {
+		next = c->p_nextsib;
+		c->parent_proc = NULL;
+		c->p_orphaned = true;
+		c->p_prevsib = NULL;
+		c->p_nextsib = NULL;
+		if (c->p_exited) {
+			c->p_nextsib = zombies;
+			zombies = c;
+		}
+	}
+	proc->p_children = NULL;
+	spinlock_release(&familylk);
 
-	spinlock_acquire(&processTable.lk);
-	for (i = 1; i <= MAX_PROC; i++) {
-		/* 	If the pointer to the parent process of the current element
-			has the same pid of the parameter, it must be a children */
-		p = processTable.proc[i];
-		if (p != NULL && p->parent_proc != NULL && p->parent_proc->p_pid == pid)
-			p->parent_proc = NULL;
+	for (c = zombies; c != NULL; c = next) {
+		next = c->p_nextsib;
+		c->p_nextsib = NULL;
+		proc_destroy(c);
 	}
-	spinlock_release(&processTable.lk);
 }
+
+/*
+ * Wait for a child of parent to exit and reap it. pid is a specific
+ * child, or -1 for any child. With nohang, return 0 in *retpid
+ * instead of sleeping if no such child has exited yet.
+ */
+int
+proc_wait_child(struct proc *parent, pid_t pid, bool nohang,
+		int *status, pid_t *retpid) {
+	struct proc *c;
+
+	spinlock_acquire(&familylk);
+	while (1) {
+		for (c = parent->p_children; c != NULL; c = c->p_nextsib) {
+			if (pid == -1 ? c->p_exited : c->p_pid == pid)
+				break;
+		}
+		if (c == NULL && (pid != -1 || parent->p_children == NULL)) {
+			/* no such child */
+			spinlock_release(&familylk);
+			if (pid != -1 && proc_search_pid(pid) == NULL)
+				return ESRCH;
+			return ECHILD;
+		}
+		if (c != NULL && c->p_exited)
+			break;
+		if (nohang) {
+			spinlock_release(&familylk);
+			*retpid = 0;
+			return 0;
+		}
+		wchan_sleep(parent->p_waitchan, &familylk);
+	}
+	proc_unlink_child_locked(c);
+	spinlock_release(&familylk);
+
+	*status = c->p_status;
+	*retpid = c->p_pid;
+	proc_destroy(c);
+	return 0;
+}
+
 /*
  * G.Cabodi - 2019
  * Initialize support for pid/waitpid.
@@ -108,51 +235,129 @@ proc_search_pid(pid_t pid) {
   struct proc *p;
   
   // Check if the pid argument is valid (pid 0 is not used)
-  // The upper bound is MAX_PROC > PID_MAX
-  if (pid < PID_MIN || pid > MAX_PROC)
+  if (pid < PID_MIN || pid > PID_MAX)
 	return NULL;
 
-  // KASSERT(pid>=0 && pid<MAX_PROC);
-
-  spinlock_acquire(&processTable.lk);
-  p = processTable.proc[pid];
-  spinlock_release(&processTable.lk);
-  if(p!=NULL)
-  	KASSERT(p->p_pid==pid);
+  ticketlock_acquire(&processTable.lk);
+  p = processTable.buckets[pid & (processTable.nbuckets - 1)];
+  while (p != NULL && p->p_pid != pid)
+	p = p->p_hashnext;
+  ticketlock_release(&processTable.lk);
 
   return p;
 }
 
+/*
+ * Take the next free PID, or return 0 if there is none.
+ * Called with the table lock held.
+ */
+static pid_t
+pid_alloc(void) {
+  pid_t pid = processTable.last_pid;
+  uint32_t word, bit;
+
+  if (processTable.nprocs == PID_MAX - PID_MIN + 1)
+	return 0;
+
+  /* there is a free PID, so this terminates */
+  while (1) {
+	pid++;
+	if (pid > PID_MAX)
+	  pid = PID_MIN;
+	word = processTable.pidmap[pid / 32];
+	if (word == 0xffffffff) {
+	  /* whole word in use: go on from the last PID it covers */
+	  pid |= 31;
+	  continue;
+	}
+	bit = (uint32_t)1 << (pid % 32);
+	if ((word & bit) == 0) {
+	  processTable.pidmap[pid / 32] = word | bit;
+	  processTable.last_pid = pid;
+	  return pid;
+	}
+  }
+}
+
+/*
+ * Double the hash table if it has become too crowded. The new bucket
+ * array is allocated without the table lock; if someone else resized
+ * the table meanwhile, just drop it.
+ */
+static void
+pt_grow(void) {
+  struct proc **newb, **oldb, *p;
+  unsigned n, i, h;
+
+  ticketlock_acquire(&processTable.lk);
+  n = processTable.nbuckets;
+  if (processTable.nprocs <= 2 * n) {
+	ticketlock_release(&processTable.lk);
+	return;
+  }
+  ticketlock_release(&processTable.lk);
+
+  newb = kmalloc(2 * n * sizeof(struct proc *));
+  if (newb == NULL)
+	return;		/* longer chains, still correct */
+  bzero(newb, 2 * n * sizeof(struct proc *));
+
+  ticketlock_acquire(&processTable.lk);
+  if (processTable.nbuckets != n) {
+	ticketlock_release(&processTable.lk);
+	kfree(newb);
+	return;
+  }
+  oldb = processTable.buckets;
+  for (i = 0; i < n; i++) {
+	while ((p = oldb[i]) != NULL) {
+	  oldb[i] = p->p_hashnext;
+	  h = p->p_pid & (2 * n - 1);
+	  p->p_hashnext = newb[h];
+	  newb[h] = p;
+	}
+  }
+  processTable.buckets = newb;
+  processTable.nbuckets = 2 * n;
+  ticketlock_release(&processTable.lk);
+
+  if (oldb != pt_initbuckets)
+	kfree(oldb);
+}
+
 /*
  * G.Cabodi - 2019
  * Initialize support for pid/waitpid.
  */
 static void
 proc_init_waitpid(struct proc *proc, const char *name) {
-  /* search a free index in table using a circular strategy */
-  int i;
-  spinlock_acquire(&processTable.lk);
-  i = processTable.last_i+1;
-  proc->p_pid = 0;
-  if (i>MAX_PROC) i=1;
-  while (i!=processTable.last_i) {
-    if (processTable.proc[i] == NULL) {
-      processTable.proc[i] = proc;
-      processTable.last_i = i;
-      proc->p_pid = i;
-      break;
-    }
-    i++;
-    if (i>MAX_PROC) i=1;
+  struct proc **bucket;
+
+  proc->p_hashnext = NULL;
+  if (kproc == NULL) {
+	/* the kernel process stays out of the table and out of reach
+	   of waitpid; it gets a pid below PID_MIN */
+	proc->p_pid = PID_MIN - 1;
   }
-  if (proc->p_pid==0) {
-    // panic("too many processes. proc table is full\n");
-	processTable.is_full = true;
-	spinlock_release(&processTable.lk);
-	return;
+  else {
+	ticketlock_acquire(&processTable.lk);
+	proc->p_pid = pid_alloc();
+	if (proc->p_pid == 0) {
+	  // panic("too many processes. proc table is full\n");
+	  processTable.is_full = true;
+	  ticketlock_release(&processTable.lk);
+	  return;
+	}
+	bucket = &processTable.buckets[proc->p_pid & (processTable.nbuckets - 1)];
+	proc->p_hashnext = *bucket;
+	*bucket = proc;
+	processTable.nprocs++;
+	ticketlock_release(&processTable.lk);
+	pt_grow();
   }
-  spinlock_release(&processTable.lk);
   proc->p_status = 0;
+  proc->p_waitchan = wchan_create(name);
+  proc->p_joinchan = wchan_create(name);
 #if USE_SEMAPHORE_FOR_WAITPID
   proc->p_sem = sem_create(name, 0);
 #else
@@ -168,14 +373,26 @@ proc_init_waitpid(struct proc *proc, const char *name) {
 static void
 proc_end_waitpid(struct proc *proc) {
   /* remove the process from the table */
-  int i;
-  spinlock_acquire(&processTable.lk);
-  i = proc->p_pid;
-  KASSERT(i>0 && i<=MAX_PROC);
-  processTable.proc[i] = NULL;
-  processTable.is_full = false;
-  spinlock_release(&processTable.lk);
+  struct proc **pp;
+  pid_t pid = proc->p_pid;
+
+  if (pid >= PID_MIN) {
+	KASSERT(pid <= PID_MAX);
+	ticketlock_acquire(&processTable.lk);
+	pp = &processTable.buckets[pid & (processTable.nbuckets - 1)];
+	while (*pp != proc) {
+	  KASSERT(*pp != NULL);
+	  pp = &(*pp)->p_hashnext;
+	}
+	*pp = proc->p_hashnext;
+	processTable.pidmap[pid / 32] &= ~((uint32_t)1 << (pid % 32));
+	processTable.nprocs--;
+	processTable.is_full = false;
+	ticketlock_release(&processTable.lk);
+  }
 
+  wchan_destroy(proc->p_waitchan);
+  wchan_destroy(proc->p_joinchan);
 #if USE_SEMAPHORE_FOR_WAITPID
   sem_destroy(proc->p_sem);
 #else
@@ -215,14 +432,22 @@ proc_create(const char *name)
 #if OPT_SHELL
 	// New fields
 	proc->p_exited = 0;
+	proc->p_orphaned = false;
 	proc->parent_proc = NULL;
-	proc->ft_lock = lock_create(proc->p_name);
+	proc->p_children = NULL;
+	proc->p_nextsib = NULL;
+	proc->p_prevsib = NULL;
+	proc->p_vforksem = NULL;
+	proc->p_uthreads = NULL;
+	proc->p_nexttid = 1;
+	proc->p_exiting = false;
+	proc->ft_lock = rwlock_create(proc->p_name, RWLOCK_FAIR);
 
 	proc_init_waitpid(proc,name);
-	if(is_proc_table_full()){
+	if(proc->p_pid == 0){
 		kfree(proc->p_name);
 		spinlock_cleanup(&proc->p_lock);
-		lock_destroy(proc->ft_lock);
+		rwlock_destroy(proc->ft_lock);
 		kfree(proc);
 		return NULL;
 	}
@@ -252,6 +477,11 @@ proc_destroy(struct proc *proc)
 	KASSERT(proc != NULL);
 	KASSERT(proc != kproc);
 
+#if OPT_SHELL
+	proc_unlink_child(proc);
+	KASSERT(proc->p_children == NULL);
+#endif
+
 	/*
 	 * We don't take p_lock in here because we must have the only
 	 * reference to this structure. (Otherwise it would be
@@ -320,23 +550,20 @@ proc_destroy(struct proc *proc)
 	for (int fd=0; fd<OPEN_MAX; fd++) {
 		struct openfile *of = proc->fileTable[fd];
 		if (of != NULL) {
-			lock_acquire(of->of_lock);
-			if (--of->countRef == 0){
-				if (of->vn != NULL){
-					vfs_close(of->vn);
-				}
-				lock_release(of->of_lock);
-				lock_destroy(of->of_lock);
-			}
-			else{
-				lock_release(of->of_lock);
-			}
+			openfileDecrRefCount(of);
 		}
 		
 		proc->fileTable[fd] = NULL;
 	}
 	
-	lock_destroy(proc->ft_lock);
+	rwlock_destroy(proc->ft_lock);
+
+	/* threads nobody joined */
+	while (proc->p_uthreads != NULL) {
+		struct uthread *ut = proc->p_uthreads;
+		proc->p_uthreads = ut->ut_next;
+		kfree(ut);
+	}
 	#endif
 
 	kfree(proc->p_name);
@@ -354,9 +581,7 @@ proc_bootstrap(void)
 		panic("proc_create for kproc failed\n");
 	}
 #if OPT_SHELL
-	spinlock_init(&processTable.lk);
-	processTable.is_full = false;
-	/* kernel process is not registered in the table */
+	/* the table is statically initialized; kproc is not in it */
 	// processTable.active = 1;
 	sft_init();
 	ft_copy_lock = lock_create("File Table Copy");
@@ -436,10 +661,11 @@ proc_addthread(struct proc *proc, struct thread *t)
  * the timer interrupt context switch, and any other implicit uses
  * of "curproc".
  */
-void
+bool
 proc_remthread(struct thread *t)
 {
 	struct proc *proc;
+	bool last;
 	int spl;
 
 	proc = t->t_proc;
@@ -448,11 +674,14 @@ proc_remthread(struct thread *t)
 	spinlock_acquire(&proc->p_lock);
 	KASSERT(proc->p_numthreads > 0);
 	proc->p_numthreads--;
+	last = proc->p_numthreads == 0;
 	spinlock_release(&proc->p_lock);
 
 	spl = splhigh();
 	t->t_proc = NULL;
 	splx(spl);
+
+	return last;
 }
 
 /*
@@ -522,10 +751,32 @@ proc_wait(struct proc *proc)
 }
 
 
-/* G.Cabodi - 2019 - support for waitpid */
+/*
+ * G.Cabodi - 2019 - support for waitpid
+ * Called by the exiting thread once it has left the process. From
+ * here on the process may be reaped at any time, so it must not be
+ * touched after waking up whoever is going to reap it.
+ */
 void
 proc_signal_end(struct proc *proc)
 {
+  struct proc *parent;
+  bool reap;
+
+  spinlock_acquire(&familylk);
+  proc->p_exited = 1;
+  parent = proc->parent_proc;
+  reap = proc->p_orphaned;
+  if (parent != NULL)
+    wchan_wakeall(parent->p_waitchan, &familylk);
+  spinlock_release(&familylk);
+
+  if (reap) {
+    /* the parent is gone: nobody will wait for us */
+    proc_destroy(proc);
+  }
+  else if (parent == NULL) {
+    /* started by the kernel (menu), which waits through proc_wait */
 #if USE_SEMAPHORE_FOR_WAITPID
       V(proc->p_sem);
 #else
@@ -533,25 +784,104 @@ proc_signal_end(struct proc *proc)
       cv_signal(proc->p_cv);
       lock_release(proc->p_cv_lock);
 #endif
+  }
+}
+
+/*
+ * Called by a process created with vfork, on its own thread, when it
+ * stops using its parent's address space: from execv once the new
+ * image is in place, or on the way out (EXITING), in which case the
+ * borrowed address space is detached so that proc_destroy leaves it
+ * alone. Wakes the parent, which is asleep in sys_vfork. Returns
+ * false if the process was not borrowing anything.
+ */
+bool
+proc_vfork_release(struct proc *proc, bool exiting)
+{
+  struct semaphore *sem;
+
+  KASSERT(proc == curproc);
+
+  spinlock_acquire(&proc->p_lock);
+  sem = proc->p_vforksem;
+  proc->p_vforksem = NULL;
+  if (sem != NULL && exiting) {
+    proc->p_addrspace = NULL;
+  }
+  spinlock_release(&proc->p_lock);
+
+  if (sem == NULL) {
+    return false;
+  }
+  if (exiting) {
+    /* nothing in the MMU may keep referring to it on our behalf */
+    as_deactivate();
+  }
+  V(sem);
+  return true;
+}
+
+/*
+ * Exit the current process with STATUS, unless another of its threads
+ * already did. The other threads leave when they next head back to
+ * user mode (see mips_trap) or give up waiting in thread_join; the
+ * last one out ends the process.
+ */
+void
+proc_exit(int status)
+{
+  struct proc *p = curproc;
+
+  spinlock_acquire(&p->p_lock);
+  if (!p->p_exiting) {
+    p->p_exiting = true;
+    p->p_status = status;
+  }
+  wchan_wakeall(p->p_joinchan, &p->p_lock);
+  spinlock_release(&p->p_lock);
+  futex_wakeproc(p);
+
+  proc_exit_thread();
+}
+
+void
+proc_exit_thread(void)
+{
+  struct proc *p = curproc;
+
+  if (proc_remthread(curthread)) {
+    spinlock_acquire(&p->p_lock);
+    if (!p->p_exiting) {
+      /* every thread called thread_exit */
+      p->p_exiting = true;
+      p->p_status = _MKWAIT_EXIT(0);
+    }
+    spinlock_release(&p->p_lock);
+
+    proc_rm_parent_link(p);  // remove the link to this process in his childrens
+    proc_signal_end(p);
+  }
+  thread_exit();
 }
 
 void 
 proc_file_table_copy(struct proc *psrc, struct proc *pdest) {
   int fd;
   lock_acquire(ft_copy_lock);
-  lock_acquire(psrc->ft_lock);
-  lock_acquire(pdest->ft_lock);
+  rwlock_acquire_read(psrc->ft_lock);
+  rwlock_acquire_write(pdest->ft_lock);
   for (fd=0; fd<OPEN_MAX; fd++) {
     struct openfile *of = psrc->fileTable[fd];
     pdest->fileTable[fd] = of;
     if (of != NULL) {
-      /* incr reference count */
-	  VOP_INCREF(of->vn);
+      /* incr reference count (the vnode reference belongs to the openfile) */
+      lock_acquire(of->of_lock);
       openfileIncrRefCount(of);
+      lock_release(of->of_lock);
     }
   }
-  lock_release(pdest->ft_lock);
-  lock_release(psrc->ft_lock);
+  rwlock_release_write(pdest->ft_lock);
+  rwlock_release_read(psrc->ft_lock);
   lock_release(ft_copy_lock);
 }
 
@@ -0,0 +1,126 @@
+/*
+ * Exec cache. See elfcache.h.
+ *
+ * A handful of entries replaced in LRU order. Images are small and
+ * are copied in and out under a spinlock; vnode references are only
+ * dropped after releasing it, since that may reclaim the vnode.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <vnode.h>
+#include <elfcache.h>
+
+#define ELFCACHE_SIZE 16
+
+struct elfcache_entry {
+	struct vnode *ce_vn;		/* NULL if unused */
+	unsigned ce_gen;		/* vnode_gen when parsed */
+	unsigned ce_stamp;		/* last use, for LRU */
+	struct elf_image ce_img;
+};
+
+static struct spinlock elfcache_lock = SPINLOCK_INITIALIZER;
+static struct elfcache_entry elfcache[ELFCACHE_SIZE];
+static unsigned elfcache_clock;
+
+bool
+elfcache_lookup(struct vnode *vn, struct elf_image *img)
+{
+	unsigned gen, i;
+	bool hit = false;
+
+	gen = vnode_gen(vn);
+
+	spinlock_acquire(&elfcache_lock);
+	for (i=0; i<ELFCACHE_SIZE; i++) {
+		if (elfcache[i].ce_vn == vn) {
+			/* if stale, the caller reparses and replaces it */
+			if (elfcache[i].ce_gen == gen) {
+				*img = elfcache[i].ce_img;
+				elfcache[i].ce_stamp = ++elfcache_clock;
+				hit = true;
+			}
+			break;
+		}
+	}
+	spinlock_release(&elfcache_lock);
+	return hit;
+}
+
+void
+elfcache_insert(struct vnode *vn, unsigned gen, const struct elf_image *img)
+{
+	struct elfcache_entry *e, *victim = NULL;
+	struct vnode *old = NULL;
+	unsigned i;
+
+	spinlock_acquire(&elfcache_lock);
+	for (i=0; i<ELFCACHE_SIZE; i++) {
+		e = &elfcache[i];
+		if (e->ce_vn == vn) {
+			victim = e;
+			break;
+		}
+		if (victim == NULL || (victim->ce_vn != NULL &&
+		    (e->ce_vn == NULL || e->ce_stamp < victim->ce_stamp))) {
+			victim = e;
+		}
+	}
+
+	if (victim->ce_vn != vn) {
+		old = victim->ce_vn;
+		VOP_INCREF(vn);
+		victim->ce_vn = vn;
+	}
+	victim->ce_gen = gen;
+	victim->ce_stamp = ++elfcache_clock;
+	victim->ce_img = *img;
+	spinlock_release(&elfcache_lock);
+
+	if (old != NULL) {
+		VOP_DECREF(old);
+	}
+}
+
+void
+elfcache_forget(struct vnode *vn)
+{
+	bool found = false;
+	unsigned i;
+
+	spinlock_acquire(&elfcache_lock);
+	for (i=0; i<ELFCACHE_SIZE; i++) {
+		if (elfcache[i].ce_vn == vn) {
+			elfcache[i].ce_vn = NULL;
+			found = true;
+			break;
+		}
+	}
+	spinlock_release(&elfcache_lock);
+
+	if (found) {
+		VOP_DECREF(vn);
+	}
+}
+
+void
+elfcache_flush(void)
+{
+	struct vnode *vns[ELFCACHE_SIZE];
+	unsigned i;
+
+	spinlock_acquire(&elfcache_lock);
+	for (i=0; i<ELFCACHE_SIZE; i++) {
+		vns[i] = elfcache[i].ce_vn;
+		elfcache[i].ce_vn = NULL;
+	}
+	spinlock_release(&elfcache_lock);
+
+	for (i=0; i<ELFCACHE_SIZE; i++) {
+		if (vns[i] != NULL) {
+			VOP_DECREF(vns[i]);
+		}
+	}
+}
@@ -23,6 +23,8 @@
 #include <addrspace.h>
 #include <kern/seek.h>
 #include <kern/stat.h>
+#include <pipe.h>
+#include <vmtext.h>
 
 /* max num of system wide open files */
 #define SYSTEM_OPEN_MAX (10*OPEN_MAX)
@@ -41,11 +43,144 @@ void openfileIncrRefCount(struct openfile *of) {
     of->countRef++;
 }
 
+/*
+ * Drop one reference to an open file. The openfile owns a single
+ * reference to its vnode, which is released together with the slot
+ * of the system open file table when the last reference goes away.
+ */
+int openfileDecrRefCount(struct openfile *of) {
+  struct vnode *vn;
+  struct lock *lk;
+  bool writing;
+
+  lock_acquire(of->of_lock);
+  if (--of->countRef > 0){
+    lock_release(of->of_lock);
+    return 0; // just decrement ref cnt
+  }
+
+  vn = of->vn;
+  lk = of->of_lock;
+  writing = (of->openflags & O_ACCMODE) != O_RDONLY;
+  lock_release(lk);
+  if (vn == NULL) {
+    return EIO;
+  }
+
+  /* the slot can be reused as soon as vn is NULL */
+  lock_acquire(systemFileTable.lk);
+  of->vn = NULL;
+  of->of_lock = NULL;
+  lock_release(systemFileTable.lk);
+
+  if (writing)
+    text_write_end(vn);
+  vfs_close(vn);
+  lock_destroy(lk);
+  return 0;
+}
+
+/*
+ * Take a free slot of the system open file table for vnode v.
+ * Returns ENFILE if the table is full, ETXTBSY if v is opened for
+ * writing while some process is running it (see vmtext.h).
+ */
+static int
+sft_alloc(struct vnode *v, int openflags, struct openfile **ret){
+  struct openfile *of = NULL;
+  struct lock *lk;
+  bool writing = (openflags & O_ACCMODE) != O_RDONLY;
+  int i, result;
+
+  lk = lock_create("of");
+  if (lk == NULL)
+    return ENOMEM;
+  if (writing) {
+    result = text_write_begin(v);
+    if (result) {
+      lock_destroy(lk);
+      return result;
+    }
+  }
+
+  lock_acquire(systemFileTable.lk);
+  for (i=0; i<SYSTEM_OPEN_MAX; i++) {
+    if ((systemFileTable.ft)[i].vn==NULL) {
+      of = &(systemFileTable.ft)[i];
+      of->vn = v;
+      of->offset = 0; // O_APPEND writes reposition in of_write
+      of->countRef = 1;
+      of->openflags = openflags;
+      of->of_lock = lk;
+      break;
+    }
+  }
+  lock_release(systemFileTable.lk);
+  if (of == NULL) {
+    if (writing)
+      text_write_end(v);
+    lock_destroy(lk);
+    return ENFILE;
+  }
+  *ret = of;
+  return 0;
+}
+
+/*
+ * Put of in the first free slot of the current process file table
+ * (stdin/stdout/stderr excluded). Returns -1 if the table is full.
+ */
+static int
+fd_alloc(struct openfile *of){
+  int fd;
+
+  rwlock_acquire_write(curproc->ft_lock);
+  for (fd=STDERR_FILENO+1; fd<OPEN_MAX; fd++) {
+    if (curproc->fileTable[fd] == NULL) {
+      curproc->fileTable[fd] = of;
+      rwlock_release_write(curproc->ft_lock);
+      return fd;
+    }
+  }
+  rwlock_release_write(curproc->ft_lock);
+  return -1;
+}
+
 void sft_init(void){
   systemFileTable.lk = lock_create("System File Table");
   // systemFileTable.active = 1;
 }
 
+/*
+ * Write u through of, at u->uio_offset or, with O_APPEND, at the
+ * current end of file. For O_APPEND the size query and the write are
+ * done under vfs_biglock, so appends through different openfiles of
+ * the same file cannot interleave (SFS does its I/O under the same
+ * lock). Called with of->of_lock held.
+ */
+static int
+of_write(struct openfile *of, struct uio *u)
+{
+  off_t size;
+  int result;
+
+  if ((of->openflags & O_APPEND) == 0 || !VOP_ISSEEKABLE(of->vn)) {
+    result = VOP_WRITE(of->vn, u);
+  }
+  else {
+    vfs_biglock_acquire();
+    result = VOP_GETSIZE(of->vn, &size);
+    if (!result) {
+      u->uio_offset = size;
+      result = VOP_WRITE(of->vn, u);
+    }
+    vfs_biglock_release();
+  }
+  /* even a failed write may have changed something */
+  vnode_modified(of->vn);
+  return result;
+}
+
 #if USE_KERNEL_BUFFER
 
 static int
@@ -61,9 +196,9 @@ file_read(int fd, userptr_t buf_ptr, size_t size, int *errp) {
     *errp = EBADF;
     return -1;
   }
-  lock_acquire(curproc->ft_lock);
+  rwlock_acquire_read(curproc->ft_lock);
   of = curproc->fileTable[fd];
-  lock_release(curproc->ft_lock);
+  rwlock_release_read(curproc->ft_lock);
   if (of==NULL) {
     *errp = EBADF;
     return -1;
@@ -116,9 +251,9 @@ file_write(int fd, userptr_t buf_ptr, size_t size, int *errp) {
     *errp = EBADF;
     return -1;
   }
-  lock_acquire(curproc->ft_lock);
+  rwlock_acquire_read(curproc->ft_lock);
   of = curproc->fileTable[fd];
-  lock_release(curproc->ft_lock);
+  rwlock_release_read(curproc->ft_lock);
   if (of==NULL) {
     *errp = EBADF;
     return -1;
@@ -145,7 +280,7 @@ file_write(int fd, userptr_t buf_ptr, size_t size, int *errp) {
   kbuf = kmalloc(size);
   copyin(buf_ptr,kbuf,size);
   uio_kinit(&iov, &ku, kbuf, size, of->offset, UIO_WRITE);
-  result = VOP_WRITE(vn, &ku);
+  result = of_write(of, &ku);
   if (result) {
     lock_release(of->of_lock);
     *errp = result;
@@ -172,9 +307,9 @@ file_read(int fd, userptr_t buf_ptr, size_t size, int *errp) {
     *errp = EBADF;
     return -1;
   } 
-  lock_acquire(curproc->ft_lock); 
+  rwlock_acquire_read(curproc->ft_lock); 
   of = curproc->fileTable[fd];
-  lock_release(curproc->ft_lock);
+  rwlock_release_read(curproc->ft_lock);
   if (of==NULL){
     *errp = EBADF;
     return -1;
@@ -233,9 +368,9 @@ file_write(int fd, userptr_t buf_ptr, size_t size, int *errp) {
     *errp = EBADF;
     return -1;
   }
-  lock_acquire(curproc->ft_lock); 
+  rwlock_acquire_read(curproc->ft_lock); 
   of = curproc->fileTable[fd];
-  lock_release(curproc->ft_lock);
+  rwlock_release_read(curproc->ft_lock);
   
   if (of==NULL){
     *errp = EBADF;
@@ -272,7 +407,7 @@ file_write(int fd, userptr_t buf_ptr, size_t size, int *errp) {
   u.uio_rw = UIO_WRITE;
   u.uio_space = proc_getas();
 
-  result = VOP_WRITE(vn, &u);
+  result = of_write(of, &u);
   if (result) {
     lock_release(of->of_lock);
     *errp = result;
@@ -292,7 +427,7 @@ file_write(int fd, userptr_t buf_ptr, size_t size, int *errp) {
 int
 sys_open(userptr_t path, int openflags, mode_t mode, int *errp)
 {
-  int fd, i;
+  int fd;
   struct vnode *v;
   struct openfile *of=NULL;; 	
   int result;
@@ -330,36 +465,22 @@ sys_open(userptr_t path, int openflags, mode_t mode, int *errp)
     return -1;
   }
   /* search system open file table */
-  lock_acquire(systemFileTable.lk);
-  for (i=0; i<SYSTEM_OPEN_MAX; i++) {
-    if ((systemFileTable.ft)[i].vn==NULL) {
-      of = &(systemFileTable.ft)[i];
-      of->vn = v;
-      of->offset = 0; // TODO: handle offset with append
-      of->countRef = 1;
-      of->openflags = openflags;
-      of->of_lock = lock_create("of");
-      break;
-    }
-  }
-  lock_release(systemFileTable.lk);
-  if (of==NULL) { 
-    // no free slot in system open file table
-    *errp = ENFILE;
+  result = sft_alloc(v, openflags, &of);
+  if (result) {
+    // no free slot in system open file table, or text busy
+    *errp = result;
   }
   else {
-    lock_acquire(curproc->ft_lock);
-    for (fd=STDERR_FILENO+1; fd<OPEN_MAX; fd++) {
-      if (curproc->fileTable[fd] == NULL) {
-	      curproc->fileTable[fd] = of;
-        lock_release(curproc->ft_lock);
-        kfree(kbuf);
-	      return fd;
-      }
+    fd = fd_alloc(of);
+    if (fd >= 0) {
+      kfree(kbuf);
+      return fd;
     }
-    lock_release(curproc->ft_lock);
     // no free slot in process open file table
     *errp = EMFILE;
+    openfileDecrRefCount(of);
+    kfree(kbuf);
+    return -1;
   }
   kfree(kbuf);
   vfs_close(v);
@@ -369,45 +490,41 @@ sys_open(userptr_t path, int openflags, mode_t mode, int *errp)
 /*
  * file system calls for open/close
  */
-int sys_close(int fd, int *errp) {
+/*
+ * Close fd in the file table of p.
+ */
+int
+proc_fd_close(struct proc *p, int fd) {
   struct openfile *of = NULL; 
-  struct vnode *vn;
 
-  *errp = 0;
   // In order to pass testbin/badcall tests, fd==OPEN_MAX should return an error
   if (fd < 0 || fd >= OPEN_MAX) {
-    *errp = EBADF;
-    return -1;
+    return EBADF;
   }
 
-  KASSERT(curproc!=NULL);
-  lock_acquire(curproc->ft_lock);
-  of = curproc->fileTable[fd];
+  KASSERT(p!=NULL);
+  rwlock_acquire_write(p->ft_lock);
+  of = p->fileTable[fd];
   if (of == NULL) {
-    lock_release(curproc->ft_lock);
-    *errp = EBADF;
-    return -1;
+    rwlock_release_write(p->ft_lock);
+    return EBADF;
   }
 
-  curproc->fileTable[fd] = NULL;
+  p->fileTable[fd] = NULL;
 
-  lock_release(curproc->ft_lock);
-  lock_acquire(of->of_lock);
-  if (--of->countRef > 0){
-    lock_release(of->of_lock);
-    return 0; // just decrement ref cnt
-  }
-  
-  vn = of->vn;
-  of->vn = NULL;
-  lock_release(of->of_lock);
-  if (vn == NULL) {
-    *errp = EIO;
+  rwlock_release_write(p->ft_lock);
+  return openfileDecrRefCount(of);
+}
+
+int sys_close(int fd, int *errp) {
+  int result;
+
+  *errp = 0;
+  result = proc_fd_close(curproc, fd);
+  if (result) {
+    *errp = result;
     return -1;
   }
-
-  vfs_close(vn); 
-  lock_destroy(of->of_lock);	
   return 0;
 }
 
@@ -434,7 +551,7 @@ off_t
 sys_lseek(int fd, off_t pos, int whence, int *errp){
   struct openfile *of;
   off_t new_offset = 0;
-  struct stat st;
+  off_t size;
   int result;
 
   if(fd < 0 || fd >= OPEN_MAX){
@@ -447,9 +564,9 @@ sys_lseek(int fd, off_t pos, int whence, int *errp){
     return -1;
   }
 
-  lock_acquire(curproc->ft_lock);
+  rwlock_acquire_read(curproc->ft_lock);
   of = curproc->fileTable[fd];
-  lock_release(curproc->ft_lock);
+  rwlock_release_read(curproc->ft_lock);
 
   if(of==NULL){
     *errp = EBADF;
@@ -481,24 +598,26 @@ sys_lseek(int fd, off_t pos, int whence, int *errp){
       }
       new_offset = of->offset + pos;
       if((new_offset < of->offset) && (pos > 0)){
+        lock_release(of->of_lock);
         *errp = EOVERFLOW;
         return -1;
       }
       break;
     case SEEK_END:
-      result = VOP_STAT(of->vn, &st);
+      result = VOP_GETSIZE(of->vn, &size);
       if(result){
         lock_release(of->of_lock);
         *errp = result;
         return -1;
       }
-      if((st.st_size + pos)<0){
+      if((size + pos)<0){
         lock_release(of->of_lock);
         *errp = EINVAL;
         return -1;
       }
-      new_offset = st.st_size + pos;
-      if((new_offset < st.st_size) && (pos > 0)){
+      new_offset = size + pos;
+      if((new_offset < size) && (pos > 0)){
+        lock_release(of->of_lock);
         *errp = EOVERFLOW;
         return -1;
       }
@@ -514,63 +633,68 @@ sys_lseek(int fd, off_t pos, int whence, int *errp){
   return new_offset;
 }
 
-int 
-sys_dup2(int oldfd, int newfd, int *errp){
+/*
+ * Make newfd refer to the same open file as oldfd in the file table
+ * of p, closing whatever newfd referred to before.
+ */
+int
+proc_fd_dup2(struct proc *p, int oldfd, int newfd){
   struct openfile *old_of, *new_of;
-  struct vnode *vn;
+  int result;
 
   if(oldfd < 0 || newfd < 0 || oldfd >= OPEN_MAX || newfd >= OPEN_MAX){
-    *errp = EBADF;
-    return -1;
+    return EBADF;
   }
 
-  if(oldfd == newfd)
-    return newfd;
-  
-  lock_acquire(curproc->ft_lock);
-  old_of = curproc->fileTable[oldfd];
-  new_of = curproc->fileTable[newfd];
+  rwlock_acquire_write(p->ft_lock);
+  old_of = p->fileTable[oldfd];
+  new_of = p->fileTable[newfd];
 
   if(old_of == NULL){
-    lock_release(curproc->ft_lock);
-    *errp = EBADF;
-    return -1;
+    rwlock_release_write(p->ft_lock);
+    return EBADF;
+  }
+
+  if(oldfd == newfd){
+    rwlock_release_write(p->ft_lock);
+    return 0;
   }
 
   if(new_of != NULL){
     // close the file
-    curproc->fileTable[newfd] = NULL;
-    lock_acquire(new_of->of_lock);
-    if (--new_of->countRef > 0){
-      lock_release(new_of->of_lock);
-    } else{
-      vn = new_of->vn;
-      new_of->vn = NULL;
-      lock_release(new_of->of_lock);
-      if (vn == NULL) {
-        lock_release(curproc->ft_lock);
-        *errp = EIO;
-        return -1;
-      }
-      vfs_close(vn); 
-      lock_destroy(new_of->of_lock);	
+    p->fileTable[newfd] = NULL;
+    result = openfileDecrRefCount(new_of);
+    if (result) {
+      rwlock_release_write(p->ft_lock);
+      return result;
     }
   }
   
-  curproc->fileTable[newfd] = old_of;
-  lock_release(curproc->ft_lock);
+  p->fileTable[newfd] = old_of;
+  rwlock_release_write(p->ft_lock);
   lock_acquire(old_of->of_lock);
+  /* the vnode reference is owned by the openfile: no VOP_INCREF here */
   openfileIncrRefCount(old_of);
-  VOP_INCREF(old_of->vn);
-
   lock_release(old_of->of_lock);
+  return 0;
+}
+
+int 
+sys_dup2(int oldfd, int newfd, int *errp){
+  int result;
+
+  result = proc_fd_dup2(curproc, oldfd, newfd);
+  if(result){
+    *errp = result;
+    return -1;
+  }
   return newfd;
 }
 
 
 int
 std_open(int fileno){
-  int fd, openflags, i;
+  int fd, openflags;
   mode_t mode;
   struct vnode *v;
   struct openfile *of=NULL;; 	
@@ -606,28 +730,16 @@ std_open(int fileno){
     return -1;
   }
   /* search system open file table */
-  lock_acquire(systemFileTable.lk);
-  for (i=0; i<SYSTEM_OPEN_MAX; i++) {
-    if ((systemFileTable.ft)[i].vn==NULL) {
-      of = &(systemFileTable.ft)[i];
-      of->vn = v;
-      of->offset = 0; // TODO: handle offset with append
-      of->countRef = 1;
-      of->openflags = openflags;
-      of->of_lock = lock_create("of");
-      break;
-    }
-  }
-  lock_release(systemFileTable.lk);
-  if (of==NULL) { 
+  result = sft_alloc(v, openflags, &of);
+  if (result) {
     vfs_close(v);
     return -1;
   }
 
 
-  lock_acquire(curproc->ft_lock);
+  rwlock_acquire_write(curproc->ft_lock);
   curproc->fileTable[fd] = of;
-  lock_release(curproc->ft_lock);
+  rwlock_release_write(curproc->ft_lock);
   return fd;
 
 }
@@ -647,9 +759,9 @@ sys_fstat(int fd, struct stat *statbuf, int *errp){
     return -1;
   }
 
-  lock_acquire(curproc->ft_lock);
+  rwlock_acquire_read(curproc->ft_lock);
   of = curproc->fileTable[fd];
-  lock_release(curproc->ft_lock);
+  rwlock_release_read(curproc->ft_lock);
 
   if(of==NULL){
     *errp = EBADF;
@@ -667,8 +779,13 @@ sys_fstat(int fd, struct stat *statbuf, int *errp){
   return 0;
 } 
 
-int
-sys_getdirentry(int fd, char *buf, size_t buflen, int* errp)
+/*
+ * Common part of getdirentry and getdents: read from directory FD at
+ * its current offset into the user buffer, with either one name
+ * (VOP_GETDIRENTRY) or a batch of dirent records (VOP_GETDIRENTS).
+ */
+static int
+dir_read(int fd, userptr_t buf, size_t buflen, bool batch, int *errp)
 {
     int result;
     struct uio u;
@@ -679,9 +796,9 @@ sys_getdirentry(int fd, char *buf, size_t buflen, int* errp)
       *errp = EBADF;
       return -1;
     } 
-    lock_acquire(curproc->ft_lock);
+    rwlock_acquire_read(curproc->ft_lock);
     of = curproc->fileTable[fd];
-    lock_release(curproc->ft_lock);
+    rwlock_release_read(curproc->ft_lock);
     if (of==NULL){
       *errp = EBADF;
       return -1;
@@ -694,13 +811,13 @@ sys_getdirentry(int fd, char *buf, size_t buflen, int* errp)
       return -1;
     }
 
-    if(!is_valid_pointer((userptr_t)buf, proc_getas())){
+    if(!is_valid_pointer(buf, proc_getas())){
       lock_release(of->of_lock);
       *errp = EFAULT;
       return -1;
     }
 
-    iov.iov_ubase = (userptr_t)buf;
+    iov.iov_ubase = buf;
     iov.iov_len = buflen;
 
     u.uio_iov = &iov;
@@ -711,15 +828,182 @@ sys_getdirentry(int fd, char *buf, size_t buflen, int* errp)
     u.uio_rw = UIO_READ;
     u.uio_space = proc_getas();
 
-    result = VOP_GETDIRENTRY(of->vn, &u);
+    if (batch) {
+      result = VOP_GETDIRENTS(of->vn, &u);
+    }
+    else {
+      result = VOP_GETDIRENTRY(of->vn, &u);
+    }
     if(result){
       lock_release(of->of_lock);
       *errp = result;
       return -1;
     }
 
-    //return 0;
     of->offset = u.uio_offset;
     lock_release(of->of_lock);
     return (buflen - u.uio_resid);
 }
+
+int
+sys_getdirentry(int fd, char *buf, size_t buflen, int* errp)
+{
+    return dir_read(fd, (userptr_t)buf, buflen, false, errp);
+}
+
+/*
+ * Batched getdirentry: fill BUF with as many struct dirent records as
+ * fit. Returns the number of bytes used, 0 at end of directory.
+ */
+int
+sys_getdents(int fd, userptr_t buf, size_t buflen, int *errp)
+{
+    return dir_read(fd, buf, buflen, true, errp);
+}
+
+/*
+ * Undo fd_alloc for a descriptor that was never handed to userland.
+ */
+static void
+fd_release(int fd){
+  rwlock_acquire_write(curproc->ft_lock);
+  curproc->fileTable[fd] = NULL;
+  rwlock_release_write(curproc->ft_lock);
+}
+
+/*
+ * pipe(): create an anonymous pipe. The read end is returned in
+ * fds[0] and the write end in fds[1].
+ */
+int
+sys_pipe(userptr_t fds, int *errp)
+{
+  struct vnode *rv, *wv;
+  struct openfile *rof, *wof;
+  int kfds[2];
+  int result;
+
+  if (fds == NULL || !is_valid_pointer(fds, proc_getas())){
+    *errp = EFAULT;
+    return -1;
+  }
+
+  result = pipe_create(&rv, &wv);
+  if (result){
+    *errp = result;
+    return -1;
+  }
+
+  result = sft_alloc(rv, O_RDONLY, &rof);
+  if (result){
+    vfs_close(rv);
+    vfs_close(wv);
+    *errp = result;
+    return -1;
+  }
+  result = sft_alloc(wv, O_WRONLY, &wof);
+  if (result){
+    openfileDecrRefCount(rof);
+    vfs_close(wv);
+    *errp = result;
+    return -1;
+  }
+
+  kfds[0] = fd_alloc(rof);
+  if (kfds[0] < 0){
+    openfileDecrRefCount(rof);
+    openfileDecrRefCount(wof);
+    *errp = EMFILE;
+    return -1;
+  }
+  kfds[1] = fd_alloc(wof);
+  if (kfds[1] < 0){
+    fd_release(kfds[0]);
+    openfileDecrRefCount(rof);
+    openfileDecrRefCount(wof);
+    *errp = EMFILE;
+    return -1;
+  }
+
+  result = copyout(kfds, fds, sizeof(kfds));
+  if (result){
+    fd_release(kfds[0]);
+    fd_release(kfds[1]);
+    openfileDecrRefCount(rof);
+    openfileDecrRefCount(wof);
+    *errp = result;
+    return -1;
+  }
+
+  return 0;
+}
+
+int
+sys_ftruncate(int fd, off_t len, int *errp)
+{
+  struct openfile *of;
+  int result;
+
+  if(fd < 0 || fd >= OPEN_MAX){
+    *errp = EBADF;
+    return -1;
+  }
+  if(len < 0){
+    *errp = EINVAL;
+    return -1;
+  }
+
+  rwlock_acquire_read(curproc->ft_lock);
+  of = curproc->fileTable[fd];
+  rwlock_release_read(curproc->ft_lock);
+
+  if(of==NULL){
+    *errp = EBADF;
+    return -1;
+  }
+
+  lock_acquire(of->of_lock);
+  if((of->openflags & O_ACCMODE) == O_RDONLY){
+    lock_release(of->of_lock);
+    *errp = EBADF;
+    return -1;
+  }
+  result = VOP_TRUNCATE(of->vn, len);
+  vnode_modified(of->vn);
+  lock_release(of->of_lock);
+  if(result){
+    *errp = result;
+    return -1;
+  }
+
+  return 0;
+}
+
+int
+sys_remove(userptr_t path, int *errp)
+{
+  char *kbuf;
+  int result;
+
+  if(path == NULL || !is_valid_pointer(path, proc_getas())){
+    *errp = EFAULT;
+    return -1;
+  }
+
+  kbuf = kmalloc(PATH_MAX);
+  if(kbuf == NULL){
+    *errp = ENOMEM;
+    return -1;
+  }
+  result = copyinstr(path, kbuf, PATH_MAX, NULL);
+  if(result == 0){
+    result = vfs_remove(kbuf);
+  }
+  kfree(kbuf);
+  if(result){
+    *errp = result;
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * futex_wait and futex_wake.
+ *
+ * Waiters hang off a small hash table indexed by physical address.
+ * Each bucket has one spinlock and one wchan; a waiter sleeps until
+ * futex_wake marks its own record as woken, so threads waiting on
+ * other words that hash to the same bucket just go back to sleep.
+ *
+ * The bucket lock is held from the check of the user word to the
+ * sleep, and futex_wake takes it too, so a wakeup sent after the
+ * word was changed cannot be missed.
+ *
+ * The address space lock is held from the translation of the user
+ * address until the waiter is queued, so another thread cannot unmap
+ * the page and have its frame reused in between. Once the waiter is
+ * queued, an munmap only means it may get a spurious wakeup.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <copyinout.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <wchan.h>
+#include <current.h>
+#include <proc.h>
+#include <vm.h>
+#include <addrspace.h>
+#include <futex.h>
+#include <syscall.h>
+
+#define FUTEX_BUCKETS 64
+
+struct futex_waiter {
+	paddr_t fw_paddr;		/* word waited on */
+	struct proc *fw_proc;		/* process of the waiter */
+	bool fw_woken;			/* set by the waker */
+	struct futex_waiter *fw_next;
+};
+
+struct futex_bucket {
+	struct spinlock fb_lock;
+	struct wchan *fb_wchan;
+	struct futex_waiter *fb_waiters;
+};
+
+static struct futex_bucket futex_table[FUTEX_BUCKETS];
+
+static
+struct futex_bucket *
+futex_bucket(paddr_t paddr)
+{
+	/* words are aligned: the low two bits carry nothing */
+	return &futex_table[((paddr >> 2) ^ (paddr >> 12)) % FUTEX_BUCKETS];
+}
+
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_BUCKETS; i++) {
+		spinlock_init(&futex_table[i].fb_lock);
+		futex_table[i].fb_wchan = wchan_create("futex");
+		if (futex_table[i].fb_wchan == NULL) {
+			panic("futex_bootstrap: out of memory\n");
+		}
+		futex_table[i].fb_waiters = NULL;
+	}
+}
+
+/*
+ * Wake up to N waiters of PADDR, or all of them if N is negative. If
+ * P is not NULL, wake the waiters of P instead, wherever they sleep.
+ * Returns how many were woken.
+ */
+static
+int
+futex_wakeup(struct futex_bucket *b, paddr_t paddr, struct proc *p, int n)
+{
+	struct futex_waiter **pw, *w;
+	int count = 0;
+
+	KASSERT(spinlock_do_i_hold(&b->fb_lock));
+	pw = &b->fb_waiters;
+	while (*pw != NULL && (n < 0 || count < n)) {
+		w = *pw;
+		if (p != NULL ? w->fw_proc == p : w->fw_paddr == paddr) {
+			*pw = w->fw_next;
+			w->fw_woken = true;
+			count++;
+		}
+		else {
+			pw = &w->fw_next;
+		}
+	}
+	if (count > 0) {
+		wchan_wakeall(b->fb_wchan, &b->fb_lock);
+	}
+	return count;
+}
+
+/*
+ * Find the physical address of the word at UADDR. On success, returns
+ * with the address space lock held; the caller releases it when done
+ * with the address.
+ */
+static
+int
+futex_lookup(userptr_t uaddr, struct addrspace *as, paddr_t *ret)
+{
+	int val, result;
+
+	if ((vaddr_t)uaddr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+	/* validates the pointer and faults the page in (without the lock) */
+	result = copyin(uaddr, &val, sizeof(val));
+	if (result) {
+		return result;
+	}
+	lock_acquire(as->as_lock);
+	result = as_translate(as, (vaddr_t)uaddr, ret);
+	if (result) {
+		lock_release(as->as_lock);
+	}
+	return result;
+}
+
+/*
+ * Sleep as long as the word at UADDR holds VAL. Fails with EAGAIN,
+ * without sleeping, if it does not.
+ */
+int
+sys_futex_wait(userptr_t uaddr, int val)
+{
+	struct addrspace *as = proc_getas();
+	struct futex_waiter w;
+	struct futex_bucket *b;
+	paddr_t paddr;
+	int result;
+
+	result = futex_lookup(uaddr, as, &paddr);
+	if (result) {
+		return result;
+	}
+	b = futex_bucket(paddr);
+
+	w.fw_paddr = paddr;
+	w.fw_proc = curproc;
+	w.fw_woken = false;
+
+	spinlock_acquire(&b->fb_lock);
+	/* the frame is in kseg0, so this read cannot fault */
+	if (*(volatile int *)PADDR_TO_KVADDR(paddr) != val) {
+		spinlock_release(&b->fb_lock);
+		lock_release(as->as_lock);
+		return EAGAIN;
+	}
+	if (curproc->p_exiting) {
+		/* futex_wakeproc has already run */
+		spinlock_release(&b->fb_lock);
+		lock_release(as->as_lock);
+		return EINTR;
+	}
+	w.fw_next = b->fb_waiters;
+	b->fb_waiters = &w;
+	/* queued: the page may go now (lock_release does not sleep) */
+	lock_release(as->as_lock);
+	while (!w.fw_woken) {
+		wchan_sleep(b->fb_wchan, &b->fb_lock);
+	}
+	spinlock_release(&b->fb_lock);
+
+	return 0;
+}
+
+/*
+ * Wake up to N threads sleeping on the word at UADDR. Returns the
+ * number woken.
+ */
+int
+sys_futex_wake(userptr_t uaddr, int n, int *errp)
+{
+	struct addrspace *as = proc_getas();
+	struct futex_bucket *b;
+	paddr_t paddr;
+	int result, count;
+
+	if (n <= 0) {
+		*errp = EINVAL;
+		return -1;
+	}
+	result = futex_lookup(uaddr, as, &paddr);
+	if (result) {
+		*errp = result;
+		return -1;
+	}
+	b = futex_bucket(paddr);
+
+	spinlock_acquire(&b->fb_lock);
+	count = futex_wakeup(b, paddr, NULL, n);
+	spinlock_release(&b->fb_lock);
+	lock_release(as->as_lock);
+
+	return count;
+}
+
+void
+futex_wakeproc(struct proc *p)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_BUCKETS; i++) {
+		spinlock_acquire(&futex_table[i].fb_lock);
+		futex_wakeup(&futex_table[i], 0, p, -1);
+		spinlock_release(&futex_table[i].fb_lock);
+	}
+}
@@ -59,6 +59,7 @@
 #include <addrspace.h>
 #include <vnode.h>
 #include <elf.h>
+#include <elfcache.h>
 
 /*
  * Load a segment at virtual address VADDR. The segment in memory
@@ -146,21 +147,19 @@ load_segment(struct addrspace *as, struct vnode *v,
 }
 
 /*
- * Load an ELF executable user program into the current address space.
- *
- * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ * Read and check the headers of the executable in V, and collect its
+ * loadable segments into IMG.
  */
+static
 int
-load_elf(struct vnode *v, vaddr_t *entrypoint)
+elf_parse(struct vnode *v, struct elf_image *img)
 {
 	Elf_Ehdr eh;   /* Executable header */
 	Elf_Phdr ph;   /* "Program header" = segment header */
+	struct elf_segment *seg;
 	int result, i;
 	struct iovec iov;
 	struct uio ku;
-	struct addrspace *as;
-
-	as = proc_getas();
 
 	/*
 	 * Read the executable header from offset 0 in the file.
@@ -203,7 +202,7 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	}
 
 	/*
-	 * Go through the list of segments and set up the address space.
+	 * Go through the list of segments and collect the ones to load.
 	 *
 	 * Ordinarily there will be one code segment, one read-only
 	 * data segment, and one data/bss segment, but there might
@@ -217,6 +216,8 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	 * to find where the phdr starts.
 	 */
 
+	img->ei_entry = eh.e_entry;
+	img->ei_nsegs = 0;
 	for (i=0; i<eh.e_phnum; i++) {
 		off_t offset = eh.e_phoff + i*eh.e_phentsize;
 		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
@@ -243,54 +244,115 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 			return ENOEXEC;
 		}
 
-		result = as_define_region(as,
-					  ph.p_vaddr, ph.p_memsz,
-					  ph.p_flags & PF_R,
-					  ph.p_flags & PF_W,
-					  ph.p_flags & PF_X);
+		if (img->ei_nsegs == ELF_MAXSEGS) {
+			kprintf("loadelf: too many segments\n");
+			return ENOEXEC;
+		}
+		seg = &img->ei_segs[img->ei_nsegs++];
+		seg->es_offset = ph.p_offset;
+		seg->es_vaddr = ph.p_vaddr;
+		seg->es_memsize = ph.p_memsz;
+		seg->es_filesize = ph.p_filesz;
+		seg->es_flags = ph.p_flags;
+	}
+
+	return 0;
+}
+
+/*
+ * Load an ELF executable user program into the current address space.
+ *
+ * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ */
+int
+load_elf(struct vnode *v, vaddr_t *entrypoint)
+{
+	struct elf_image img;
+	const struct elf_segment *seg;
+	unsigned i;
+	int result;
+#if OPT_SHELL
+	unsigned gen;
+	int texti = -1;
+#endif
+	struct addrspace *as;
+
+	as = proc_getas();
+
+#if OPT_SHELL
+	/* the headers of programs run recently are in the exec cache */
+	if (!elfcache_lookup(v, &img)) {
+		gen = vnode_gen(v);
+		result = elf_parse(v, &img);
 		if (result) {
 			return result;
 		}
+		elfcache_insert(v, gen, &img);
 	}
-
-	result = as_prepare_load(as);
+#else
+	result = elf_parse(v, &img);
 	if (result) {
 		return result;
 	}
+#endif
 
 	/*
-	 * Now actually load each segment.
+	 * Set up the address space.
 	 */
 
-	for (i=0; i<eh.e_phnum; i++) {
-		off_t offset = eh.e_phoff + i*eh.e_phentsize;
-		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
-
-		result = VOP_READ(v, &ku);
+	for (i=0; i<img.ei_nsegs; i++) {
+		seg = &img.ei_segs[i];
+		result = as_define_region(as,
+					  seg->es_vaddr, seg->es_memsize,
+					  seg->es_flags & PF_R,
+					  seg->es_flags & PF_W,
+					  seg->es_flags & PF_X);
 		if (result) {
 			return result;
 		}
+	}
 
-		if (ku.uio_resid != 0) {
-			/* short read; problem with executable? */
-			kprintf("ELF: short read on phdr - file truncated?\n");
-			return ENOEXEC;
+#if OPT_SHELL
+	/*
+	 * The first region, if it is read-only code, can be shared;
+	 * unless the file is open for writing, then it is loaded
+	 * privately like the others.
+	 */
+	seg = &img.ei_segs[0];
+	if (img.ei_nsegs > 0 && (seg->es_flags & (PF_W|PF_X)) == PF_X) {
+		result = as_share_text(as, v, seg->es_offset, seg->es_vaddr,
+				       seg->es_filesize);
+		if (result == 0) {
+			texti = 0;
 		}
+		else if (result != ETXTBSY) {
+			return result;
+		}
+	}
+#endif
 
-		switch (ph.p_type) {
-		    case PT_NULL: /* skip */ continue;
-		    case PT_PHDR: /* skip */ continue;
-		    case PT_MIPS_REGINFO: /* skip */ continue;
-		    case PT_LOAD: break;
-		    default:
-			kprintf("loadelf: unknown segment type %d\n",
-				ph.p_type);
-			return ENOEXEC;
+	result = as_prepare_load(as);
+	if (result) {
+		return result;
+	}
+
+	/*
+	 * Now actually load each segment.
+	 */
+
+	for (i=0; i<img.ei_nsegs; i++) {
+		seg = &img.ei_segs[i];
+
+#if OPT_SHELL
+		if ((int)i == texti) {
+			/* already in memory */
+			continue;
 		}
+#endif
 
-		result = load_segment(as, v, ph.p_offset, ph.p_vaddr,
-				      ph.p_memsz, ph.p_filesz,
-				      ph.p_flags & PF_X);
+		result = load_segment(as, v, seg->es_offset, seg->es_vaddr,
+				      seg->es_memsize, seg->es_filesize,
+				      seg->es_flags & PF_X);
 		if (result) {
 			return result;
 		}
@@ -301,7 +363,7 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 		return result;
 	}
 
-	*entrypoint = eh.e_entry;
+	*entrypoint = img.ei_entry;
 
 	return 0;
 }
@@ -21,9 +21,7 @@
 #include <kern/fcntl.h>
 #include <vfs.h>
 #include <kern/wait.h>
-
-static char karg[ARG_MAX]; // tmp vector to store the single argument before copying it into kargbuf
-static unsigned char kargbuf[ARG_MAX]; // tmp vector to store the arguments before copying them into the stack
+#include <kern/spawn.h>
 
 /*
  * system calls for process management
@@ -32,32 +30,22 @@ void
 sys__exit(int status)
 {
   struct proc *p = curproc;
-  spinlock_acquire(&p->p_lock);
+  proc_vfork_release(p, true); // a vforked child leaves the address space to its parent
   //p->p_status = (status & 0xff) << 2; /* just lower 8 bits returned (2 bit shift: see include/kern/wait.h) */
-  p->p_status = _MKWAIT_EXIT(status); /* just lower 8 bits returned (2 bit shift: see include/kern/wait.h) */
-  p->p_exited = 1;
-  spinlock_release(&p->p_lock);
-  proc_remthread(curthread);
-  proc_rm_parent_link(p->p_pid);  // remove the link to this process in his childrens
-  proc_signal_end(p);
-  thread_exit();
+  proc_exit(_MKWAIT_EXIT(status)); /* just lower 8 bits returned (2 bit shift: see include/kern/wait.h) */
 
   panic("thread_exit returned (should not happen)\n");
   (void) status; // TODO: status handling
 }
 
 int sys_waitpid(pid_t pid, int* statusp, int options, int *errp, bool is_kernel) {
-  struct proc *p = proc_search_pid(pid);
-  int s;
+  struct proc *p;
+  int s, result;
+  pid_t ret;
   
-  // Check if the pid argument named a nonexistent process
   *errp = 0;
-  if (p == NULL) {
-	  *errp = ESRCH;
-	  return -1;
-  }
   
-  // The options argument should be 0. It's not required to implement any options
+  // Only WNOHANG is supported
   if (options != 0 && options != WNOHANG) {
     *errp = EINVAL;
     return -1;
@@ -74,25 +62,25 @@ int sys_waitpid(pid_t pid, int* statusp, int options, int *errp, bool is_kernel)
     return -1;
   }
 
-  spinlock_acquire(&p->p_lock);
-  // if the process that called the waitpid is not the parent
-  if (!is_kernel && p->parent_proc != curproc) {
-    spinlock_release(&p->p_lock);
-    *errp = ECHILD;
-    return -1;
-  }
-
-  // Process has already exited
-  if (p->p_exited == 1){
-    s = p->p_status;
-    spinlock_release(&p->p_lock);
-    proc_destroy(p);
+  if (is_kernel) {
+    // processes started from the menu have no parent: wait by pid
+    p = proc_search_pid(pid);
+    if (p == NULL) {
+      *errp = ESRCH;
+      return -1;
+    }
+    s = proc_wait(p);
+    ret = pid;
   } else {
-    spinlock_release(&p->p_lock); 
-    if(options == WNOHANG){ // to check
+    // pid may be -1 (any child); only children can be waited for
+    result = proc_wait_child(curproc, pid, options == WNOHANG, &s, &ret);
+    if (result) {
+      *errp = result;
+      return -1;
+    }
+    if (ret == 0) {
+      // WNOHANG and no child has exited yet
       return 0;
-    } else {
-      s = proc_wait(p);
     }
   }
 
@@ -105,7 +93,7 @@ int sys_waitpid(pid_t pid, int* statusp, int options, int *errp, bool is_kernel)
     }
   }
     
-  return pid;
+  return ret;
 }
 
 pid_t sys_getpid(void) {
@@ -162,7 +150,7 @@ int sys_fork(struct trapframe *ctf, pid_t *retval) {
   /* TO BE DONE: linking parent/child, so that child terminated 
      on parent exit */
   // Parent/child linking
-  newp->parent_proc = curproc; 
+  proc_add_child(curproc, newp);
 
   result = thread_fork(
 		 curthread->t_name, newp,
@@ -179,118 +167,182 @@ int sys_fork(struct trapframe *ctf, pid_t *retval) {
   return 0;
 }
 
-/* It receive a string and the alignment and returns the len as the first greatest multiple of align.
-It also fills the remaining space with '\0' until it reaches a lenght of len+diff */
-static int
-align_arg(char arg[ARG_MAX], int align){
-  int len = strlen(arg) + 1 , diff;
+/*
+ * vfork: like fork, but the child runs on the parent's address space
+ * instead of a copy of it, and the parent sleeps until the child has
+ * called execv or exited. Meant for callers that exec right away; in
+ * the meantime the child must not return from the function that
+ * called vfork or change anything the parent relies on.
+ */
+int sys_vfork(struct trapframe *ctf, pid_t *retval) {
+  struct trapframe *tf_child;
+  struct semaphore *sem;
+  struct proc *newp;
+  int result;
+  char *name;
 
-  if(len % align == 0)
-    return len;
+  KASSERT(curproc != NULL);
 
-  diff = align - (len % align);
-  
-  for(int i = len; i < len+diff; i++)
-    arg[i] = '\0';
+  sem = sem_create("vfork", 0);
+  if(sem == NULL){
+    return ENOMEM;
+  }
 
-  return len + diff;
-}
+  spinlock_acquire(&curproc->p_lock);
+  name = curproc->p_name;
+  spinlock_release(&curproc->p_lock);
+  newp = proc_create_runprogram(name);
+  if(newp == NULL){
+    sem_destroy(sem);
+    if(is_proc_table_full())
+      return ENPROC;
+    else
+      return ENOMEM;
+  }
 
-/* It works like align_arg but it doesn't modify the string*/ 
-static int 
-get_aligned_len(char arg[ARG_MAX], int align){
-  int len = strlen(arg) + 1;
+  /* borrowed, not copied: proc_vfork_release hands it back */
+  newp->p_addrspace = proc_getas();
+  newp->p_vforksem = sem;
 
-  if(len % align == 0)
-    return len;
-  
-  return len + (align - (len % align));
+  proc_file_table_copy(curproc, newp);
+
+  tf_child = kmalloc(sizeof(struct trapframe));
+  if(tf_child == NULL){
+    newp->p_addrspace = NULL;
+    proc_destroy(newp);
+    sem_destroy(sem);
+    return ENOMEM;
+  }
+  memcpy(tf_child, ctf, sizeof(struct trapframe));
+
+  proc_add_child(curproc, newp);
+  *retval = newp->p_pid;
+
+  result = thread_fork(
+		 curthread->t_name, newp,
+		 call_enter_forked_process,
+		 (void *)tf_child, (unsigned long)0/*unused*/);
+
+  if (result){
+    newp->p_addrspace = NULL;
+    proc_destroy(newp);
+    kfree(tf_child);
+    sem_destroy(sem);
+    return result;
+  }
+
+  /* the child cannot be reaped before we get past this */
+  P(sem);
+  sem_destroy(sem);
+  return 0;
 }
 
-/* Copy the arguments from stack to kargbuf and return argc into nargs 
-and total length into buflen. The arguments are aligned on 32 bits */
+/*
+ * Arguments of an exec, staged in kernel memory between reading them
+ * from the old address space and writing them into the new one. Each
+ * exec has its own, so concurrent execs do not share anything.
+ *
+ * The buffer is filled from both ends in a single pass over the user
+ * argv: slot i of the argv vector at the front, the strings (each
+ * padded to 4 bytes) packed downward from the end, so that the tail
+ * is already the image of the top of the new user stack. Until
+ * copy_args_out runs, each slot holds the offset of its string.
+ */
+struct argbuf {
+  unsigned char *ab_buf;     /* ARG_MAX bytes */
+  size_t ab_strtop;          /* offset of the lowest string */
+  int ab_argc;
+};
+
+/* Copy the NULL-terminated argv at uargs into ab. */
 static int
-copy_args(userptr_t uargs, int *nargs, int *buflen){
-  int i = 0, err, n_last = 0, argc = 0, len = 0, arg_str_len_tot = 0;
+copy_args(userptr_t uargs, struct argbuf *ab){
+  unsigned char *buf;
+  uint32_t *vec;
+  size_t top = ARG_MAX, slot, len, alen;
   char *ptr;
-  unsigned int *p_begin = NULL;
-  unsigned char *p_end = NULL;
-  uint32_t offset, last_offset;
+  int argc = 0, err;
+
+  buf = kmalloc(ARG_MAX);
+  if(buf == NULL)
+    return ENOMEM;
+  vec = (uint32_t *)buf;
 
-  // Copy the argument and compute it's length
-  while((err = copyin((userptr_t)uargs + i*4, &ptr, sizeof(ptr))) == 0){
+  while((err = copyin((userptr_t)((vaddr_t)uargs + argc*sizeof(char*)), &ptr, sizeof(ptr))) == 0){
     if(ptr == NULL)
       break;
-    err = copyinstr((userptr_t)ptr, karg, sizeof(karg), NULL);
-    if(err)
-      return err;
-    i++;
-    argc += 1;
-    len += get_aligned_len(karg, 4) + sizeof(char*);
-    
-    // Check if the total size of the argument strings exceeds ARG_MAX
-    arg_str_len_tot += (strlen(ptr) + 1);
-    if (arg_str_len_tot > ARG_MAX)
-      return E2BIG;
+
+    // The vector needs this slot and the terminating NULL
+    slot = (argc + 2) * sizeof(char*);
+    if(slot >= top){
+      err = E2BIG;
+      break;
+    }
+
+    // Copy the string into the gap, then move it down next to the others
+    err = copyinstr((userptr_t)ptr, (char *)buf + slot, top - slot, &len);
+    if(err){
+      if(err == ENAMETOOLONG)
+        err = E2BIG;
+      break;
+    }
+    alen = ROUNDUP(len, 4);
+    if(slot + alen > top){
+      err = E2BIG;
+      break;
+    }
+    top -= alen;
+    memmove(buf + top, buf + slot, len);
+    bzero(buf + top + len, alen - len);
+
+    vec[argc++] = top;
   }
 
-  if(err)
+  if(err){
+    kfree(buf);
     return err;
+  }
 
-  // Add space for NULL pointer at the end of vector of pointer
-  len += sizeof(char*);
+  vec[argc] = 0;
+  ab->ab_buf = buf;
+  ab->ab_strtop = top;
+  ab->ab_argc = argc;
+  return 0;
+}
 
-  i = 0;
-  n_last = 0;
-  last_offset = (argc+1) * sizeof(char*);
-  p_begin = (unsigned int *) kargbuf;
-  p_end = kargbuf + last_offset;
-  // Copy the arguments in kargbuf and create the vector of indexes
-  while((err = copyin((userptr_t)uargs + i*4, &ptr, sizeof(ptr))) == 0){
-    if(ptr == NULL)
-      break;
-    err = copyinstr((userptr_t)ptr, karg, sizeof(karg), NULL);
-    if(err)
-      return err;
-      
-    offset = last_offset + n_last;
-    n_last = align_arg(karg, 4);
-    *p_begin = offset;
+/* Write the arguments to the top of the current user stack, moving
+ stackptr down past them; argvp receives the user address of argv */
+static int
+copy_args_out(struct argbuf *ab, vaddr_t *stackptr, userptr_t *argvp){
+  uint32_t *vec = (uint32_t *)ab->ab_buf;
+  size_t strlen_tot = ARG_MAX - ab->ab_strtop;
+  size_t veclen = (ab->ab_argc + 1) * sizeof(char*);
+  vaddr_t strbase, vecbase;
+  int i, err;
 
-    memcpy(p_end, karg, n_last);
+  strbase = *stackptr - strlen_tot;
+  vecbase = strbase - veclen;
 
-    p_end += n_last;
-    p_begin += 1;
-    last_offset = offset;
-    i++;
-  }
+  // Turn the offsets into the pointers the strings have on the stack
+  for(i = 0; i < ab->ab_argc; i++)
+    vec[i] = strbase + (vec[i] - ab->ab_strtop);
 
+  err = copyout(ab->ab_buf + ab->ab_strtop, (userptr_t)strbase, strlen_tot);
+  if(err)
+    return err;
+  err = copyout(vec, (userptr_t)vecbase, veclen);
   if(err)
     return err;
 
-  // NULL pointer at the end of vector of indexes
-  *p_begin = 0;
-
-  *nargs = argc;
-  *buflen = len;
-
+  *stackptr = vecbase;
+  *argvp = (userptr_t)vecbase;
   return 0;
 }
 
-/* It sobstitute the indexes with the pointers that the arguments
- will have into the stack */
-static int 
-adjust_kargbuf(int n_params, vaddr_t stack_ptr){
-  int i, index;
-  uint32_t new_offset = 0, old_offset = 0;
-
-  for(i = 0; i < n_params; i++){
-    index = i * sizeof(char*);
-    old_offset = *((unsigned int *)(kargbuf+index));
-    new_offset = stack_ptr + old_offset;
-    memcpy(kargbuf + index, &new_offset, sizeof(char*));
-  }
-  return 0;
+static void
+free_args(struct argbuf *ab){
+  kfree(ab->ab_buf);
+  ab->ab_buf = NULL;
 }
 
 int
@@ -299,12 +351,18 @@ sys_execv(userptr_t program, userptr_t args, int *errp)
 	struct addrspace *new_as, *old_as;
 	struct vnode *v;
 	vaddr_t entrypoint, stackptr;
-	int result, argc, buflen;
+	struct argbuf ab;
+	userptr_t argvptr;
+	int result, argc;
   char* prg_path, *prg_name;
 
   KASSERT(curthread != NULL);
   KASSERT(curproc != NULL);
-  KASSERT(curproc->p_numthreads == 1);
+  // The other threads would be left without their address space
+  if(curproc->p_numthreads != 1){
+    *errp = EBUSY;
+    return -1;
+  }
 
   // Check parameters validity
   if(!is_valid_pointer(program, proc_getas())){
@@ -366,8 +424,8 @@ sys_execv(userptr_t program, userptr_t args, int *errp)
 		return -1;
 	}
 
-  // Copy arguments from user stack to kargbuf
-  result = copy_args(args, &argc, &buflen);
+  // Copy arguments from the user stack to a private staging buffer
+  result = copy_args(args, &ab);
   if(result){
     kfree(prg_path);
     vfs_close(v);
@@ -378,6 +436,7 @@ sys_execv(userptr_t program, userptr_t args, int *errp)
 	/* Create a new address space. */
 	new_as = as_create();
 	if (new_as == NULL) {
+    free_args(&ab);
     kfree(prg_path);
 		vfs_close(v);
     *errp = ENOMEM;
@@ -392,6 +451,7 @@ sys_execv(userptr_t program, userptr_t args, int *errp)
 	/* Load the executable. */
 	result = load_elf(v, &entrypoint);
 	if (result) {
+    free_args(&ab);
     kfree(prg_path);
     as_deactivate(); // do nothing
     proc_setas(old_as);
@@ -406,6 +466,7 @@ sys_execv(userptr_t program, userptr_t args, int *errp)
   /* Define the user stack in the address space */
 	result = as_define_stack(new_as, &stackptr);
 	if (result) {
+    free_args(&ab);
     kfree(prg_path);
     as_deactivate(); // do nothing
     proc_setas(old_as);
@@ -417,23 +478,10 @@ sys_execv(userptr_t program, userptr_t args, int *errp)
 		return -1;
 	}
 
-  // Update stack pointer and update vector of pointers in kargbuf
-  stackptr -= buflen;
-  result = adjust_kargbuf(argc, stackptr);
-  if(result){
-    kfree(prg_path);
-    as_deactivate(); // do nothing
-    proc_setas(old_as);
-    as_activate();
-    as_destroy(new_as);
-    vfs_close(v);
-    *errp = result;
-		return -1;
-  }
-
-  // Copy arguments from kargbuf to stack
-  result = copyout(kargbuf, (userptr_t)stackptr, buflen);
+  // Copy arguments to the top of the new stack
+  result = copy_args_out(&ab, &stackptr, &argvptr);
   if(result){
+    free_args(&ab);
     kfree(prg_path);
     as_deactivate(); // do nothing
     proc_setas(old_as);
@@ -446,10 +494,14 @@ sys_execv(userptr_t program, userptr_t args, int *errp)
 
 	/* Done with the file now. */
 	vfs_close(v);
-  as_destroy(old_as);
+  // After vfork old_as is the parent's: give it back instead of destroying it
+  if(!proc_vfork_release(curproc, false)){
+    as_destroy(old_as);
+  }
   kfree(prg_path);
+  argc = ab.ab_argc;
+  free_args(&ab);
 
-  userptr_t argvptr = (userptr_t) stackptr;
   stackptr &= 0xFFFFFFF8;
 
 	/* Warp to user mode. */
@@ -462,3 +514,174 @@ sys_execv(userptr_t program, userptr_t args, int *errp)
   *errp = EINVAL;
 	return -1;
 }
+
+/*
+ * spawn: what the new process needs to start the program. Filled in
+ * by sys_spawn; the child's first thread loads the program, reports
+ * the outcome in result and wakes the parent through done.
+ */
+struct spawn_args {
+  struct vnode *v;            /* program, opened by the parent */
+  struct argbuf args;         /* arguments, staged by copy_args */
+  struct semaphore *done;
+  int result;
+};
+
+static void
+spawn_thread(void *data, unsigned long unused) {
+  struct spawn_args *sa = data;
+  struct addrspace *as;
+  vaddr_t entrypoint, stackptr;
+  userptr_t argvptr;
+  int argc = sa->args.ab_argc, result;
+
+  (void)unused;
+
+  as = as_create();
+  if (as == NULL) {
+    result = ENOMEM;
+  } else {
+    proc_setas(as);
+    as_activate();
+    result = load_elf(sa->v, &entrypoint);
+  }
+  if (!result) {
+    result = as_define_stack(as, &stackptr);
+  }
+  if (!result) {
+    result = copy_args_out(&sa->args, &stackptr, &argvptr);
+  }
+
+  vfs_close(sa->v);
+  free_args(&sa->args);
+  sa->result = result;
+  V(sa->done);
+  /* sa belongs to the parent again */
+
+  if (result) {
+    /* the parent reaps us; the address space goes with the process */
+    sys__exit(255);
+  }
+
+  stackptr &= 0xFFFFFFF8;
+
+  enter_new_process(argc, argc!=0?argvptr:NULL, NULL, stackptr, entrypoint);
+  panic("enter_new_process returned\n");
+}
+
+/*
+ * Start the program at path with arguments args in a new child
+ * process. Unlike fork+execv, the caller's address space is never
+ * copied: the child starts with a fresh one loaded from the ELF file.
+ * Its file table is a copy of the caller's with the nactions file
+ * actions at actions applied in order. Errors up to and including
+ * loading the program are reported to the caller.
+ */
+int
+sys_spawn(userptr_t path, userptr_t args, userptr_t actions, int nactions,
+          pid_t *retval) {
+  struct spawn_fileaction kactions[SPAWN_MAXACTIONS];
+  struct spawn_args sa;
+  struct proc *newp;
+  char *prg_path;
+  pid_t pid, ret;
+  int i, result, status;
+
+  KASSERT(curproc != NULL);
+
+  if (nactions < 0 || nactions > SPAWN_MAXACTIONS) {
+    return EINVAL;
+  }
+  if (nactions > 0) {
+    result = copyin(actions, kactions, nactions * sizeof(kactions[0]));
+    if (result) {
+      return result;
+    }
+  }
+
+  if (path == NULL || args == NULL) {
+    return EFAULT;
+  }
+  prg_path = kmalloc(PATH_MAX);
+  if (prg_path == NULL) {
+    return ENOMEM;
+  }
+  result = copyinstr(path, prg_path, PATH_MAX, NULL);
+  if (result) {
+    kfree(prg_path);
+    return result;
+  }
+
+  result = vfs_open(prg_path, O_RDONLY, 0, &sa.v);
+  if (result) {
+    kfree(prg_path);
+    return result;
+  }
+
+  // Copy arguments from the user stack; the child writes them out
+  result = copy_args(args, &sa.args);
+  if (result) {
+    goto fail_open;
+  }
+
+  sa.done = sem_create("spawn", 0);
+  if (sa.done == NULL) {
+    result = ENOMEM;
+    goto fail_args;
+  }
+
+  newp = proc_create_runprogram(prg_path);
+  if (newp == NULL) {
+    result = is_proc_table_full() ? ENPROC : ENOMEM;
+    goto fail_sem;
+  }
+
+  proc_file_table_copy(curproc, newp);
+  for (i = 0; i < nactions; i++) {
+    switch (kactions[i].sfa_op) {
+    case SPAWN_DUP2:
+      result = proc_fd_dup2(newp, kactions[i].sfa_fd, kactions[i].sfa_newfd);
+      break;
+    case SPAWN_CLOSE:
+      result = proc_fd_close(newp, kactions[i].sfa_fd);
+      break;
+    default:
+      result = EINVAL;
+      break;
+    }
+    if (result) {
+      proc_destroy(newp);
+      goto fail_sem;
+    }
+  }
+
+  proc_add_child(curproc, newp);
+  pid = newp->p_pid;
+
+  result = thread_fork(prg_path, newp, spawn_thread, &sa, 0);
+  if (result) {
+    proc_destroy(newp);
+    goto fail_sem;
+  }
+  kfree(prg_path);
+
+  /* the child owns v and argbuf from here on */
+  P(sa.done);
+  sem_destroy(sa.done);
+  if (sa.result) {
+    proc_wait_child(curproc, pid, false, &status, &ret);
+    return sa.result;
+  }
+
+  *retval = pid;
+  return 0;
+
+ fail_sem:
+  sem_destroy(sa.done);
+ fail_args:
+  free_args(&sa.args);
+ fail_open:
+  vfs_close(sa.v);
+  kfree(prg_path);
+  return result;
+}
@@ -0,0 +1,239 @@
+/*
+ * Per-syscall statistics.
+ *
+ * Each CPU has a table of SYSSTAT_NCALLS records, updated with
+ * interrupts off so a thread switch cannot tear an update. Nothing
+ * else is needed, since only the owning CPU writes its table; readers
+ * just add the tables up and may see a call half-recorded, which is
+ * fine for statistics. Likewise a reset racing with a call on another
+ * CPU can leave that one call behind.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/syscall.h>
+#include <lib.h>
+#include <spl.h>
+#include <clock.h>
+#include <cpu.h>
+#include <current.h>
+#include <copyinout.h>
+#include <syscall.h>
+#include <sysstat.h>
+#include <kern/syscallnames.h>
+
+#define SYSSTAT_MAXCPUS	32	/* as many as System/161 can have */
+
+static struct sysstat *sysstat_cpus[SYSSTAT_MAXCPUS];
+
+void
+sysstat_bootstrap(void)
+{
+	unsigned i, n;
+
+	n = cpu_count();
+	if (n > SYSSTAT_MAXCPUS) {
+		n = SYSSTAT_MAXCPUS;
+	}
+	for (i=0; i<n; i++) {
+		sysstat_cpus[i] = kmalloc(SYSSTAT_NCALLS *
+					  sizeof(struct sysstat));
+		if (sysstat_cpus[i] == NULL) {
+			panic("sysstat_bootstrap: out of memory\n");
+		}
+		bzero(sysstat_cpus[i], SYSSTAT_NCALLS * sizeof(struct sysstat));
+	}
+}
+
+/*
+ * This CPU's record for CALLNO, or NULL if there is none.
+ */
+static
+struct sysstat *
+sysstat_mine(int callno)
+{
+	if (callno < 0 || callno >= SYSSTAT_NCALLS ||
+	    curcpu->c_number >= SYSSTAT_MAXCPUS ||
+	    sysstat_cpus[curcpu->c_number] == NULL) {
+		return NULL;
+	}
+	return &sysstat_cpus[curcpu->c_number][callno];
+}
+
+/*
+ * Histogram bucket for a call that took T.
+ */
+static
+unsigned
+sysstat_bucket(const struct timespec *t)
+{
+	unsigned usecs, b;
+
+	if (t->tv_sec > 0) {
+		return SYSSTAT_NBUCKETS - 1;
+	}
+	usecs = t->tv_nsec / 1000;
+	for (b=0; usecs > 0 && b < SYSSTAT_NBUCKETS - 1; b++) {
+		usecs >>= 1;
+	}
+	return b;
+}
+
+void
+sysstat_enter(int callno)
+{
+	struct sysstat *ss;
+	int spl;
+
+	spl = splhigh();
+	ss = sysstat_mine(callno);
+	if (ss != NULL) {
+		ss->ss_calls++;
+	}
+	splx(spl);
+}
+
+void
+sysstat_exit(int callno, int err, const struct timespec *start)
+{
+	struct sysstat *ss;
+	struct timespec now, t;
+	int spl;
+
+	gettime(&now);
+	timespec_sub(&now, start, &t);
+
+	/* the thread may have moved; charge the CPU it leaves from */
+	spl = splhigh();
+	ss = sysstat_mine(callno);
+	if (ss != NULL) {
+		if (err) {
+			ss->ss_errors++;
+		}
+		ss->ss_nsecs += (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+		ss->ss_hist[sysstat_bucket(&t)]++;
+	}
+	splx(spl);
+}
+
+void
+sysstat_get(int callno, struct sysstat *ss)
+{
+	const struct sysstat *cs;
+	unsigned i, b;
+
+	KASSERT(callno >= 0 && callno < SYSSTAT_NCALLS);
+
+	bzero(ss, sizeof(*ss));
+	for (i=0; i<SYSSTAT_MAXCPUS; i++) {
+		if (sysstat_cpus[i] == NULL) {
+			continue;
+		}
+		cs = &sysstat_cpus[i][callno];
+		ss->ss_calls += cs->ss_calls;
+		ss->ss_errors += cs->ss_errors;
+		ss->ss_nsecs += cs->ss_nsecs;
+		for (b=0; b<SYSSTAT_NBUCKETS; b++) {
+			ss->ss_hist[b] += cs->ss_hist[b];
+		}
+	}
+}
+
+/*
+ * One line per call made, then its histogram, e.g.
+ *
+ *    read             1200       3        57
+ *        <1us:2 8us:640 16us:510 32us:48
+ *
+ * where each bucket is labelled with its lower bound. The mean is over
+ * the calls that returned, which leaves out _exit, __thread_exit and
+ * execv when it works.
+ */
+void
+sysstat_dump(void)
+{
+	struct sysstat ss;
+	uint32_t returned;
+	unsigned b;
+	int callno;
+	bool any = false;
+
+	kprintf("%-16s %8s %7s %9s\n", "syscall", "calls", "errors",
+		"mean (us)");
+	for (callno=0; callno<SYSSTAT_NCALLS; callno++) {
+		sysstat_get(callno, &ss);
+		if (ss.ss_calls == 0) {
+			continue;
+		}
+		any = true;
+
+		returned = 0;
+		for (b=0; b<SYSSTAT_NBUCKETS; b++) {
+			returned += ss.ss_hist[b];
+		}
+		if (syscall_names[callno] != NULL) {
+			kprintf("%-16s", syscall_names[callno]);
+		}
+		else {
+			kprintf("#%-15d", callno);
+		}
+		kprintf(" %8u %7u %9llu\n    ", ss.ss_calls, ss.ss_errors,
+			returned == 0 ? 0ULL :
+			(unsigned long long)(ss.ss_nsecs / returned / 1000));
+		for (b=0; b<SYSSTAT_NBUCKETS; b++) {
+			if (ss.ss_hist[b] == 0) {
+				continue;
+			}
+			if (b == 0) {
+				kprintf(" <1us:%u", ss.ss_hist[b]);
+			}
+			else {
+				kprintf(" %uus:%u", 1U << (b - 1),
+					ss.ss_hist[b]);
+			}
+		}
+		kprintf("\n");
+	}
+	if (!any) {
+		kprintf("(no system calls)\n");
+	}
+}
+
+void
+sysstat_reset(void)
+{
+	unsigned i;
+
+	for (i=0; i<SYSSTAT_MAXCPUS; i++) {
+		if (sysstat_cpus[i] != NULL) {
+			bzero(sysstat_cpus[i],
+			      SYSSTAT_NCALLS * sizeof(struct sysstat));
+		}
+	}
+}
+
+/*
+ * sysstat system call: copy the records for the first NCALLS call
+ * numbers out to BUF. Returns how many were copied.
+ */
+int
+sys_sysstat(userptr_t buf, unsigned ncalls, int32_t *retval)
+{
+	struct sysstat ss;
+	unsigned i;
+	int result;
+
+	if (ncalls > SYSSTAT_NCALLS) {
+		ncalls = SYSSTAT_NCALLS;
+	}
+	for (i=0; i<ncalls; i++) {
+		sysstat_get(i, &ss);
+		result = copyout(&ss, (userptr_t)((struct sysstat *)buf + i),
+				 sizeof(ss));
+		if (result) {
+			return result;
+		}
+	}
+	*retval = ncalls;
+	return 0;
+}
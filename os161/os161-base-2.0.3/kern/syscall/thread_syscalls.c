@@ -0,0 +1,196 @@
+/*
+ * User threads: thread_create, thread_exit and thread_join.
+ *
+ * All the threads of a process share its address space and file
+ * table; each runs on a user stack supplied by the caller (libc maps
+ * one per thread). The threads created through thread_create have a
+ * struct uthread in the process, which outlives the thread so that
+ * thread_join can collect the value passed to thread_exit.
+ *
+ * _exit from any thread ends the whole process: see proc_exit.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <copyinout.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <current.h>
+#include <thread.h>
+#include <proc.h>
+#include <vm.h>
+#include <mips/trapframe.h>
+#include <syscall.h>
+
+static
+struct uthread *
+uthread_find(struct proc *p, int tid)
+{
+	struct uthread *ut;
+
+	KASSERT(spinlock_do_i_hold(&p->p_lock));
+	for (ut = p->p_uthreads; ut != NULL; ut = ut->ut_next) {
+		if (ut->ut_tid == tid) {
+			return ut;
+		}
+	}
+	return NULL;
+}
+
+static
+void
+uthread_unlink(struct proc *p, struct uthread *ut)
+{
+	struct uthread **put;
+
+	KASSERT(spinlock_do_i_hold(&p->p_lock));
+	for (put = &p->p_uthreads; *put != ut; put = &(*put)->ut_next) {
+		KASSERT(*put != NULL);
+	}
+	*put = ut->ut_next;
+}
+
+static
+void
+uthread_start(void *tfv, unsigned long utv)
+{
+	struct uthread *ut = (struct uthread *)utv;
+
+	spinlock_acquire(&curproc->p_lock);
+	ut->ut_thread = curthread;
+	spinlock_release(&curproc->p_lock);
+
+	enter_new_thread(tfv);
+}
+
+/*
+ * Start a thread running ENTRY(ARG) on the user stack whose top is
+ * STACK. The new thread starts from a copy of the caller's registers,
+ * so it also inherits the global pointer. ENTRY must not return: it
+ * has nowhere to return to.
+ */
+int
+sys_thread_create(struct trapframe *ctf, vaddr_t entry, vaddr_t arg,
+		  vaddr_t stack, int *retval)
+{
+	struct proc *p = curproc;
+	struct trapframe *tf;
+	struct uthread *ut;
+	int tid, result;
+
+	if (entry == 0 || entry >= USERSPACETOP ||
+	    stack == 0 || stack > USERSPACETOP || stack % 8 != 0) {
+		return EINVAL;
+	}
+
+	tf = kmalloc(sizeof(*tf));
+	if (tf == NULL) {
+		return ENOMEM;
+	}
+	*tf = *ctf;
+	tf->tf_epc = entry;
+	tf->tf_a0 = arg;
+	tf->tf_sp = stack;
+	tf->tf_ra = 0;
+
+	ut = kmalloc(sizeof(*ut));
+	if (ut == NULL) {
+		kfree(tf);
+		return ENOMEM;
+	}
+	ut->ut_thread = NULL;
+	ut->ut_exited = false;
+	ut->ut_retval = NULL;
+
+	spinlock_acquire(&p->p_lock);
+	ut->ut_tid = tid = p->p_nexttid++;
+	ut->ut_next = p->p_uthreads;
+	p->p_uthreads = ut;
+	spinlock_release(&p->p_lock);
+
+	result = thread_fork(curthread->t_name, p, uthread_start, tf,
+			     (unsigned long)ut);
+	if (result) {
+		spinlock_acquire(&p->p_lock);
+		uthread_unlink(p, ut);
+		spinlock_release(&p->p_lock);
+		kfree(ut);
+		kfree(tf);
+		return result;
+	}
+
+	/* not ut->ut_tid: the thread may have exited and been joined */
+	*retval = tid;
+	return 0;
+}
+
+/*
+ * End the current thread, leaving RETVAL for thread_join. The last
+ * thread to leave ends the process, with status 0.
+ */
+void
+sys_thread_exit(userptr_t retval)
+{
+	struct proc *p = curproc;
+	struct uthread *ut;
+
+	spinlock_acquire(&p->p_lock);
+	for (ut = p->p_uthreads; ut != NULL; ut = ut->ut_next) {
+		if (ut->ut_thread == curthread) {
+			ut->ut_thread = NULL;
+			ut->ut_exited = true;
+			ut->ut_retval = retval;
+			break;
+		}
+	}
+	wchan_wakeall(p->p_joinchan, &p->p_lock);
+	spinlock_release(&p->p_lock);
+
+	proc_exit_thread();
+}
+
+/*
+ * Wait for thread TID to exit and store its exit value at RETVALP
+ * (unless NULL). Each thread can be joined once.
+ */
+int
+sys_thread_join(int tid, userptr_t retvalp)
+{
+	struct proc *p = curproc;
+	struct uthread *ut;
+	userptr_t val;
+
+	spinlock_acquire(&p->p_lock);
+	while (1) {
+		/* look again after sleeping: another joiner may have won */
+		ut = uthread_find(p, tid);
+		if (ut == NULL) {
+			spinlock_release(&p->p_lock);
+			return ESRCH;
+		}
+		if (ut->ut_thread == curthread) {
+			/* joining oneself would never return */
+			spinlock_release(&p->p_lock);
+			return EINVAL;
+		}
+		if (ut->ut_exited) {
+			break;
+		}
+		if (p->p_exiting) {
+			spinlock_release(&p->p_lock);
+			return EINTR;
+		}
+		wchan_sleep(p->p_joinchan, &p->p_lock);
+	}
+	uthread_unlink(p, ut);
+	spinlock_release(&p->p_lock);
+
+	val = ut->ut_retval;
+	kfree(ut);
+
+	if (retvalp != NULL) {
+		return copyout(&val, retvalp, sizeof(val));
+	}
+	return 0;
+}
@@ -28,7 +28,9 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <clock.h>
+#include <thread.h>
 #include <copyinout.h>
 #include <syscall.h>
 
@@ -56,3 +58,49 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+/* Longest sleep handed to clocksleep_ticks in one go. */
+#define NANOSLEEP_CHUNK (1U << 20)
+
+/*
+ * Sleep for the time in REQ, rounded up to whole hardclock ticks. We
+ * are never woken early, so REM (if not NULL) is always set to zero.
+ */
+int
+sys_nanosleep(userptr_t req, userptr_t rem)
+{
+	struct timespec ts;
+	uint64_t ticks;
+	unsigned chunk;
+	int result;
+
+	result = copyin(req, &ts, sizeof(ts));
+	if (result) {
+		return result;
+	}
+	if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+
+	ticks = (uint64_t)ts.tv_sec * HZ +
+		DIVROUNDUP(ts.tv_nsec, 1000000000 / HZ);
+	if (ticks == 0) {
+		thread_yield();
+	}
+	else {
+		/* the current tick is already partly gone */
+		ticks++;
+	}
+	while (ticks > 0) {
+		chunk = ticks > NANOSLEEP_CHUNK ? NANOSLEEP_CHUNK : ticks;
+		clocksleep_ticks(chunk);
+		ticks -= chunk;
+	}
+
+	if (rem != NULL) {
+		ts.tv_sec = 0;
+		ts.tv_nsec = 0;
+		return copyout(&ts, rem, sizeof(ts));
+	}
+	return 0;
+}
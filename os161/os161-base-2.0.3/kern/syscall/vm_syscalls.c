@@ -0,0 +1,148 @@
+/*
+ * mmap() and munmap().
+ *
+ * Mapped pages are given a frame only when first touched (see
+ * mapping_fault in dumbvm.c), so mapping a large file costs nothing
+ * until it is read, and only the pages actually used are loaded.
+ *
+ * Shared memory comes in two flavours, both backed by a shm object:
+ * MAP_SHARED|MAP_ANON creates a fresh one that fork() passes on to
+ * the children, and mapping a file of the "shm:" filesystem maps the
+ * named object behind it.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/mman.h>
+#include <lib.h>
+#include <syscall.h>
+#include <synch.h>
+#include <current.h>
+#include <proc.h>
+#include <vnode.h>
+#include <addrspace.h>
+#include <shm.h>
+
+vaddr_t
+sys_mmap(vaddr_t addr, size_t len, int prot, int flags, int fd,
+         off_t offset, int *errp)
+{
+  struct openfile *of;
+  struct vnode *vn = NULL;
+  struct shm_object *shm = NULL;
+  int sharing = flags & (MAP_SHARED | MAP_PRIVATE);
+  size_t npages;
+  int result;
+
+  if (len == 0 || len > USERSTACK) {
+    *errp = EINVAL;
+    return (vaddr_t)-1;
+  }
+  if (sharing != MAP_SHARED && sharing != MAP_PRIVATE) {
+    *errp = EINVAL;
+    return (vaddr_t)-1;
+  }
+  if (prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC)) {
+    *errp = EINVAL;
+    return (vaddr_t)-1;
+  }
+  npages = (len + PAGE_SIZE - 1) / PAGE_SIZE;
+
+  if (flags & MAP_ANON) {
+    /* the offset means nothing without a file */
+    offset = 0;
+    if (sharing == MAP_SHARED) {
+      shm = shm_create(npages);
+      if (shm == NULL) {
+        *errp = ENOMEM;
+        return (vaddr_t)-1;
+      }
+    }
+  }
+  else {
+    if (offset < 0 || (offset & ~(off_t)PAGE_FRAME) != 0) {
+      *errp = EINVAL;
+      return (vaddr_t)-1;
+    }
+    if (fd < 0 || fd >= OPEN_MAX) {
+      *errp = EBADF;
+      return (vaddr_t)-1;
+    }
+
+    rwlock_acquire_read(curproc->ft_lock);
+    of = curproc->fileTable[fd];
+    if (of != NULL) {
+      lock_acquire(of->of_lock);
+      /* we only ever read the file */
+      if ((of->openflags & O_ACCMODE) == O_WRONLY) {
+        result = EACCES;
+      }
+      else {
+        vn = of->vn;
+        VOP_INCREF(vn);
+        result = 0;
+      }
+      lock_release(of->of_lock);
+    }
+    else {
+      result = EBADF;
+    }
+    rwlock_release_read(curproc->ft_lock);
+    if (result) {
+      *errp = result;
+      return (vaddr_t)-1;
+    }
+
+    result = VOP_MMAP(vn, prot, flags, &shm);
+    if (result) {
+      VOP_DECREF(vn);
+      *errp = result;
+      return (vaddr_t)-1;
+    }
+
+    if (shm != NULL) {
+      /* a memory object: map its frames, the vnode is not needed */
+      VOP_DECREF(vn);
+      vn = NULL;
+      if (offset / PAGE_SIZE + npages > shm_npages(shm)) {
+        shm_decref(shm);
+        *errp = ENXIO;
+        return (vaddr_t)-1;
+      }
+    }
+  }
+
+  result = as_map(proc_getas(), &addr, npages, prot, flags, vn, offset, shm);
+  /* as_map took its own references */
+  if (vn != NULL) {
+    VOP_DECREF(vn);
+  }
+  if (shm != NULL) {
+    shm_decref(shm);
+  }
+  if (result) {
+    *errp = result;
+    return (vaddr_t)-1;
+  }
+  return addr;
+}
+
+int
+sys_munmap(vaddr_t addr, size_t len, int *errp)
+{
+  int result;
+
+  if ((addr & PAGE_FRAME) != addr || len == 0 ||
+      addr >= USERSTACK || len > USERSTACK - addr) {
+    *errp = EINVAL;
+    return -1;
+  }
+
+  result = as_unmap(proc_getas(), addr, (len + PAGE_SIZE - 1) / PAGE_SIZE);
+  if (result) {
+    *errp = result;
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Spinlock benchmark.
+ *
+ * NTHREADS threads hammer one lock, doing a little work inside it,
+ * first with a test-and-set spinlock and then with a ticket lock. For
+ * each we print the elapsed time and how often the lock went to a
+ * different CPU than the one that had it before: a lock that hands
+ * off in FIFO order changes CPU nearly every time when it is
+ * contended, while test-and-set tends to be grabbed back by the CPU
+ * that just released it.
+ *
+ * Run it with several CPUs configured in sys161.conf, or there will be
+ * nothing to measure.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <cpu.h>
+#include <current.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define NTHREADS	8
+#define NLOOPS		2000
+#define CRITWORK	20	/* delay loop rounds inside the lock */
+
+#define KIND_SPINLOCK	0
+#define KIND_TICKETLOCK	1
+
+static struct spinlock bench_splk;
+static struct ticketlock bench_tl;
+
+/* protected by the lock being measured */
+static unsigned long bench_count;
+static struct cpu *bench_lastcpu;
+static unsigned long bench_handoffs;
+
+static struct semaphore *bench_start;
+static struct semaphore *bench_done;
+
+static
+void
+bench_critical(void)
+{
+	volatile unsigned i;
+
+	bench_count++;
+	if (bench_lastcpu != curcpu->c_self) {
+		bench_lastcpu = curcpu->c_self;
+		bench_handoffs++;
+	}
+	for (i=0; i<CRITWORK; i++) {
+		/* nothing */
+	}
+}
+
+static
+void
+benchthread(void *junk, unsigned long kind)
+{
+	unsigned i;
+
+	(void)junk;
+
+	P(bench_start);
+	for (i=0; i<NLOOPS; i++) {
+		if (kind == KIND_TICKETLOCK) {
+			ticketlock_acquire(&bench_tl);
+			bench_critical();
+			ticketlock_release(&bench_tl);
+		}
+		else {
+			spinlock_acquire(&bench_splk);
+			bench_critical();
+			spinlock_release(&bench_splk);
+		}
+	}
+	V(bench_done);
+}
+
+static
+void
+bench_run(unsigned long kind, const char *name)
+{
+	struct timespec before, after;
+	unsigned i;
+	int result;
+
+	bench_count = 0;
+	bench_lastcpu = NULL;
+	bench_handoffs = 0;
+
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("spinbench", NULL, benchthread, NULL, kind);
+		if (result) {
+			panic("spinbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	gettime(&before);
+	for (i=0; i<NTHREADS; i++) {
+		V(bench_start);
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(bench_done);
+	}
+	gettime(&after);
+	timespec_sub(&after, &before, &after);
+
+	if (bench_count != NTHREADS * NLOOPS) {
+		kprintf("%s: counted %lu, expected %u: Test failed\n",
+			name, bench_count, NTHREADS * NLOOPS);
+	}
+	kprintf("%s: %llu.%09lu seconds, %lu of %lu acquisitions "
+		"changed CPU\n", name, (unsigned long long)after.tv_sec,
+		(unsigned long)after.tv_nsec, bench_handoffs, bench_count);
+}
+
+int
+spinbench(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	spinlock_init(&bench_splk);
+	ticketlock_init(&bench_tl);
+	bench_start = sem_create("spinbench start", 0);
+	bench_done = sem_create("spinbench done", 0);
+	if (bench_start == NULL || bench_done == NULL) {
+		panic("spinbench: sem_create failed\n");
+	}
+
+	kprintf("Starting spinlock benchmark (%u threads x %u)...\n",
+		NTHREADS, NLOOPS);
+	bench_run(KIND_SPINLOCK, "spinlock");
+	bench_run(KIND_TICKETLOCK, "ticketlock");
+
+	sem_destroy(bench_done);
+	sem_destroy(bench_start);
+	ticketlock_cleanup(&bench_tl);
+	spinlock_cleanup(&bench_splk);
+
+	kprintf("Spinlock benchmark done.\n");
+	return 0;
+}
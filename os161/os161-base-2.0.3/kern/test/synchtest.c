@@ -34,6 +34,7 @@
 #include <types.h>
 #include <lib.h>
 #include <clock.h>
+#include <spinlock.h>
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
@@ -399,3 +400,265 @@ cvtest2(int nargs, char **args)
 	kprintf("cvtest2 done\n");
 	return 0;
 }
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Reader-writer lock tests.
+ *
+ * rwtest runs readers and writers against each other, in both modes.
+ * Writers scribble on testval1-3 the way locktest does; readers check
+ * that the values are consistent and that no writer is inside with
+ * them. It also reports how many readers were inside at once, which
+ * should be more than one.
+ *
+ * rwtest2 checks who gets in first: queued readers and a queued
+ * writer when a writer releases the lock (this is what the two modes
+ * differ in), and a reader that arrives behind a queued writer.
+ */
+
+#define NRWLOOPS	60
+#define RWWRITERS	4	/* one thread in RWWRITERS writes */
+
+static struct rwlock *testrw;
+static struct spinlock rwtest_lock = SPINLOCK_INITIALIZER;
+static volatile unsigned rw_inside;	/* readers inside */
+static volatile unsigned rw_maxinside;
+static volatile bool rw_writing;
+static volatile bool rw_failed;
+
+static
+void
+rwfail(unsigned long num, const char *msg)
+{
+	kprintf("thread %lu: %s\n", num, msg);
+	rw_failed = true;
+}
+
+static
+void
+rwreadonce(unsigned long num)
+{
+	unsigned n;
+
+	rwlock_acquire_read(testrw);
+	spinlock_acquire(&rwtest_lock);
+	n = ++rw_inside;
+	if (n > rw_maxinside) {
+		rw_maxinside = n;
+	}
+	spinlock_release(&rwtest_lock);
+
+	if (testval2 != testval1*testval1 || testval3 != testval1%3) {
+		rwfail(num, "reader saw a half-done write");
+	}
+	/* let other readers come in meanwhile */
+	thread_yield();
+	if (rw_writing) {
+		rwfail(num, "writer inside with a reader");
+	}
+
+	spinlock_acquire(&rwtest_lock);
+	rw_inside--;
+	spinlock_release(&rwtest_lock);
+	rwlock_release_read(testrw);
+}
+
+static
+void
+rwwriteonce(unsigned long num)
+{
+	rwlock_acquire_write(testrw);
+	if (rw_writing || rw_inside > 0) {
+		rwfail(num, "writer not alone");
+	}
+	if (!rwlock_do_i_hold_write(testrw)) {
+		rwfail(num, "rwlock_do_i_hold_write");
+	}
+	rw_writing = true;
+	testval1 = num;
+	thread_yield();
+	testval2 = num*num;
+	testval3 = num%3;
+	rw_writing = false;
+	rwlock_release_write(testrw);
+}
+
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	int i;
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if (num % RWWRITERS == 0) {
+			rwwriteonce(num);
+		}
+		else {
+			rwreadonce(num);
+		}
+	}
+	V(donesem);
+}
+
+static
+void
+rwtest_mode(int mode, const char *modename)
+{
+	int i, result;
+
+	testrw = rwlock_create("testrw", mode);
+	if (testrw == NULL) {
+		panic("rwtest: rwlock_create failed\n");
+	}
+	testval1 = testval2 = testval3 = 0;
+	rw_inside = rw_maxinside = 0;
+	rw_writing = false;
+
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("rwtest", NULL, rwtestthread, NULL, i);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+
+	rwlock_destroy(testrw);
+	testrw = NULL;
+	kprintf("%s: up to %u readers at once\n", modename, rw_maxinside);
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	kprintf("Starting rwlock test...\n");
+	rw_failed = false;
+
+	rwtest_mode(RWLOCK_WRITERPREF, "writer preference");
+	rwtest_mode(RWLOCK_FAIR, "fair");
+
+	kprintf("rwlock test %s\n", rw_failed ? "FAILED" : "done");
+	return 0;
+}
+
+static char rw_order[4];		/* who got in, in order */
+static volatile unsigned rw_norder;
+
+static
+void
+rwrecord(char who)
+{
+	spinlock_acquire(&rwtest_lock);
+	KASSERT(rw_norder < sizeof(rw_order) - 1);
+	rw_order[rw_norder++] = who;
+	spinlock_release(&rwtest_lock);
+}
+
+static
+void
+rworderthread(void *junk, unsigned long write)
+{
+	(void)junk;
+
+	if (write) {
+		rwlock_acquire_write(testrw);
+		rwrecord('w');
+		rwlock_release_write(testrw);
+	}
+	else {
+		rwlock_acquire_read(testrw);
+		rwrecord('r');
+		/* hold on, so that a writer would get in now if it could */
+		clocksleep_ticks(2);
+		rwlock_release_read(testrw);
+	}
+	V(donesem);
+}
+
+/*
+ * Hold the lock (for writing if WRITE), queue up the threads in
+ * QUEUE ('r' or 'w', one at a time, giving each time to go to
+ * sleep), release it and check they got in in the order EXPECT.
+ */
+static
+void
+rwtest_order(int mode, bool write, const char *queue, const char *expect)
+{
+	unsigned i;
+	int result;
+
+	testrw = rwlock_create("testrw", mode);
+	if (testrw == NULL) {
+		panic("rwtest2: rwlock_create failed\n");
+	}
+	rw_norder = 0;
+	bzero(rw_order, sizeof(rw_order));
+
+	if (write) {
+		rwlock_acquire_write(testrw);
+	}
+	else {
+		rwlock_acquire_read(testrw);
+	}
+	for (i=0; queue[i] != 0; i++) {
+		result = thread_fork("rwtest2", NULL, rworderthread, NULL,
+				     queue[i] == 'w');
+		if (result) {
+			panic("rwtest2: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+		clocksleep_ticks(5);
+	}
+	if (write) {
+		rwlock_release_write(testrw);
+	}
+	else {
+		rwlock_release_read(testrw);
+	}
+	for (i=0; queue[i] != 0; i++) {
+		P(donesem);
+	}
+	rwlock_destroy(testrw);
+	testrw = NULL;
+
+	kprintf("%s holds %c, queued %s: got %s", mode == RWLOCK_FAIR ?
+		"fair" : "writer preference", write ? 'w' : 'r', queue,
+		rw_order);
+	if (strcmp(rw_order, expect)) {
+		kprintf(", expected %s\n", expect);
+		rw_failed = true;
+	}
+	else {
+		kprintf("\n");
+	}
+}
+
+int
+rwtest2(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	kprintf("Starting rwlock test 2...\n");
+	rw_failed = false;
+
+	/* a late reader must not overtake a waiting writer */
+	rwtest_order(RWLOCK_WRITERPREF, false, "wr", "wr");
+	rwtest_order(RWLOCK_FAIR, false, "wr", "wr");
+
+	/* on write release: the writer first, or the readers first */
+	rwtest_order(RWLOCK_WRITERPREF, true, "rrw", "wrr");
+	rwtest_order(RWLOCK_FAIR, true, "rrw", "rrw");
+
+	kprintf("rwlock test 2 %s\n", rw_failed ? "FAILED" : "done");
+	return 0;
+}
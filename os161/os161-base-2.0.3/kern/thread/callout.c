@@ -0,0 +1,208 @@
+/*
+ * Hierarchical timer wheel.
+ *
+ * There are WHEEL_LEVELS wheels of WHEEL_SIZE slots. A slot of level
+ * 0 is one tick, a slot of level 1 is WHEEL_SIZE ticks, and so on. A
+ * callout goes into the finest level whose span covers its delay, in
+ * the slot given by the matching bits of its expiry tick. Whenever the
+ * level-0 index wraps around, the next slot of level 1 is emptied and
+ * its callouts are put back in, which drops them into level 0 (and
+ * likewise up the levels).
+ *
+ * wheel_next is the next tick to process; delays are counted from it.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <clock.h>
+#include <callout.h>
+
+#define WHEEL_BITS	6
+#define WHEEL_SIZE	(1U << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS	4
+
+/* Longest delay the wheel can hold; longer ones are clamped. */
+#define WHEEL_MAXDELAY	((1U << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+static struct spinlock callout_lock = SPINLOCK_INITIALIZER;
+static struct callout *wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static unsigned wheel_next;
+static unsigned callout_count;		/* pending callouts */
+
+void
+callout_init(struct callout *co, void (*func)(void *), void *arg)
+{
+	co->co_func = func;
+	co->co_arg = arg;
+	co->co_expire = 0;
+	co->co_pending = false;
+	co->co_next = NULL;
+	co->co_pprev = NULL;
+}
+
+static
+void
+wheel_insert(struct callout *co)
+{
+	unsigned delta, level;
+	struct callout **slot;
+
+	KASSERT(spinlock_do_i_hold(&callout_lock));
+
+	delta = co->co_expire - wheel_next;
+	if ((int)delta < 0) {
+		/* already due: run it on the next tick */
+		co->co_expire = wheel_next;
+		delta = 0;
+	}
+	else if (delta > WHEEL_MAXDELAY) {
+		co->co_expire = wheel_next + WHEEL_MAXDELAY;
+		delta = WHEEL_MAXDELAY;
+	}
+
+	for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+		if (delta < 1U << (WHEEL_BITS * (level + 1))) {
+			break;
+		}
+	}
+	slot = &wheel[level][(co->co_expire >> (WHEEL_BITS * level))
+			     & WHEEL_MASK];
+
+	co->co_next = *slot;
+	if (*slot != NULL) {
+		(*slot)->co_pprev = &co->co_next;
+	}
+	co->co_pprev = slot;
+	*slot = co;
+	co->co_pending = true;
+}
+
+static
+void
+wheel_remove(struct callout *co)
+{
+	KASSERT(spinlock_do_i_hold(&callout_lock));
+	KASSERT(co->co_pending);
+
+	*co->co_pprev = co->co_next;
+	if (co->co_next != NULL) {
+		co->co_next->co_pprev = co->co_pprev;
+	}
+	co->co_next = NULL;
+	co->co_pprev = NULL;
+	co->co_pending = false;
+}
+
+/*
+ * Spread slot IDX of LEVEL over the finer levels. Returns IDX, so the
+ * caller knows whether this level wrapped around too.
+ */
+static
+unsigned
+wheel_cascade(unsigned level, unsigned idx)
+{
+	struct callout *list, *co;
+
+	list = wheel[level][idx];
+	wheel[level][idx] = NULL;
+	while (list != NULL) {
+		co = list;
+		list = co->co_next;
+		co->co_pending = false;
+		wheel_insert(co);
+	}
+	return idx;
+}
+
+void
+callout_schedule(struct callout *co, unsigned ticks)
+{
+	if (ticks == 0) {
+		ticks = 1;
+	}
+
+	spinlock_acquire(&callout_lock);
+	if (co->co_pending) {
+		wheel_remove(co);
+	}
+	else {
+		callout_count++;
+	}
+	co->co_expire = wheel_next + ticks - 1;
+	wheel_insert(co);
+	spinlock_release(&callout_lock);
+
+	/* the CPU that turns the wheel may be idling without ticks */
+	hardclock_wanted();
+}
+
+bool
+callout_cancel(struct callout *co)
+{
+	bool pending;
+
+	spinlock_acquire(&callout_lock);
+	pending = co->co_pending;
+	if (pending) {
+		wheel_remove(co);
+		callout_count--;
+	}
+	spinlock_release(&callout_lock);
+	return pending;
+}
+
+void
+callout_tick(void)
+{
+	unsigned idx, level;
+	struct callout *list, *co;
+	void (*func)(void *);
+	void *arg;
+
+	spinlock_acquire(&callout_lock);
+
+	idx = wheel_next & WHEEL_MASK;
+	for (level = 1; idx == 0 && level < WHEEL_LEVELS; level++) {
+		idx = wheel_cascade(level,
+			(wheel_next >> (WHEEL_BITS * level)) & WHEEL_MASK);
+	}
+
+	idx = wheel_next & WHEEL_MASK;
+	wheel_next++;
+
+	/*
+	 * Whatever is in the slot now is due. Take the whole list out
+	 * first: callouts scheduled by the functions we call may land in
+	 * this same slot, one lap later.
+	 */
+	list = wheel[0][idx];
+	wheel[0][idx] = NULL;
+	if (list != NULL) {
+		list->co_pprev = &list;
+	}
+	while ((co = list) != NULL) {
+		wheel_remove(co);
+		callout_count--;
+		func = co->co_func;
+		arg = co->co_arg;
+		/* CO may be freed as soon as the lock is dropped */
+		spinlock_release(&callout_lock);
+		func(arg);
+		spinlock_acquire(&callout_lock);
+	}
+
+	spinlock_release(&callout_lock);
+}
+
+bool
+callout_pending(void)
+{
+	bool ret;
+
+	spinlock_acquire(&callout_lock);
+	ret = callout_count > 0;
+	spinlock_release(&callout_lock);
+	return ret;
+}
@@ -30,17 +30,19 @@
 #include <types.h>
 #include <lib.h>
 #include <cpu.h>
+#include <mainbus.h>
 #include <wchan.h>
 #include <clock.h>
+#include <callout.h>
 #include <thread.h>
 #include <current.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution than one second.
+ * Callbacks at specific points in the future are scheduled with
+ * callouts (see callout.h), which have the resolution of one
+ * hardclock; clocksleep_ticks uses them to sleep for short times.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -50,8 +52,7 @@
  * Timing constants. These should be tuned along with any work done on
  * the scheduler.
  */
-#define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
-#define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
+#define SCHEDULE_HARDCLOCKS	25	/* Age run queues every 25 hardclocks. */
 
 /*
  * Once a second, everything waiting on lbolt is awakened by CPU 0.
@@ -59,6 +60,21 @@
 static struct wchan *lbolt;
 static struct spinlock lbolt_lock;
 
+/*
+ * CPU 0 turns the callout wheel, so it keeps ticking while callouts
+ * are pending even when idle. timekeeper_stopped is set while it
+ * idles without ticks, so that arming a callout can wake it up.
+ */
+static struct spinlock tick_lock = SPINLOCK_INITIALIZER;
+static struct cpu *timekeeper;
+static bool timekeeper_stopped;
+
+/*
+ * Threads in clocksleep_ticks wait here for their callout.
+ */
+static struct wchan *nap;
+static struct spinlock nap_lock;
+
 /*
  * Setup.
  */
@@ -70,6 +86,11 @@ hardclock_bootstrap(void)
 	if (lbolt == NULL) {
 		panic("Couldn't create lbolt\n");
 	}
+	spinlock_init(&nap_lock);
+	nap = wchan_create("nap");
+	if (nap == NULL) {
+		panic("Couldn't create nap\n");
+	}
 }
 
 /*
@@ -97,13 +118,58 @@ hardclock(void)
 	 */
 
 	curcpu->c_hardclocks++;
-	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
-		thread_consider_migration();
+	if (curcpu->c_number == 0) {
+		/* one CPU is enough to keep time */
+		callout_tick();
 	}
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
-	thread_yield();
+	thread_timeslice();
+}
+
+/*
+ * Tickless idle. An idle CPU has nothing to charge ticks to and does
+ * not need to reschedule, so it stops taking timer interrupts until
+ * something (an IPI or a device interrupt) wakes it up.
+ */
+bool
+hardclock_stop(void)
+{
+	if (curcpu->c_number == 0) {
+		spinlock_acquire(&tick_lock);
+		if (callout_pending()) {
+			spinlock_release(&tick_lock);
+			return false;
+		}
+		timekeeper = curcpu->c_self;
+		timekeeper_stopped = true;
+		spinlock_release(&tick_lock);
+	}
+	mainbus_stop_hardclock();
+	return true;
+}
+
+void
+hardclock_restart(void)
+{
+	if (curcpu->c_number == 0) {
+		spinlock_acquire(&tick_lock);
+		timekeeper_stopped = false;
+		spinlock_release(&tick_lock);
+	}
+	mainbus_start_hardclock();
+}
+
+void
+hardclock_wanted(void)
+{
+	spinlock_acquire(&tick_lock);
+	if (timekeeper_stopped) {
+		timekeeper_stopped = false;
+		ipi_send(timekeeper, IPI_UNIDLE);
+	}
+	spinlock_release(&tick_lock);
 }
 
 /*
@@ -119,3 +185,34 @@ clocksleep(int num_secs)
 	}
 	spinlock_release(&lbolt_lock);
 }
+
+static
+void
+clock_wakeup(void *data)
+{
+	bool *done = data;
+
+	spinlock_acquire(&nap_lock);
+	*done = true;
+	wchan_wakeall(nap, &nap_lock);
+	spinlock_release(&nap_lock);
+}
+
+/*
+ * Suspend execution for n hardclock ticks.
+ */
+void
+clocksleep_ticks(unsigned ticks)
+{
+	struct callout co;
+	bool done = false;
+
+	callout_init(&co, clock_wakeup, &done);
+	callout_schedule(&co, ticks);
+
+	spinlock_acquire(&nap_lock);
+	while (!done) {
+		wchan_sleep(nap, &nap_lock);
+	}
+	spinlock_release(&nap_lock);
+}
@@ -0,0 +1,227 @@
+/*
+ * Lock contention statistics.
+ *
+ * Records live in a fixed open-addressing hash table keyed by lock
+ * address and call site; when it fills up, new pairs are only counted
+ * as dropped. The table is guarded by a bare test-and-set word rather
+ * than a spinlock, since spinlocks themselves report here.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <clock.h>
+#include <lockstat.h>
+
+#define LOCKSTAT_NSITES	512	/* power of two */
+#define LOCKSTAT_NAMELEN	16
+
+struct lockstat_site {
+	const void *s_lock;		/* NULL if the slot is free */
+	const void *s_pc;
+	char s_name[LOCKSTAT_NAMELEN];
+	unsigned s_acquires;
+	unsigned s_contended;
+	struct timespec s_wait;		/* total */
+	struct timespec s_maxhold;
+	bool s_printed;			/* used by lockstat_dump */
+};
+
+volatile bool lockstat_enabled;
+
+static volatile spinlock_data_t lockstat_word = SPINLOCK_DATA_INITIALIZER;
+static struct lockstat_site lockstat_table[LOCKSTAT_NSITES];
+static unsigned lockstat_gen;		/* bumped on every reset */
+static unsigned lockstat_dropped;
+
+static
+int
+lockstat_lock(void)
+{
+	int spl;
+
+	spl = splhigh();
+	while (spinlock_data_get(&lockstat_word) != 0 ||
+	       spinlock_data_testandset(&lockstat_word) != 0) {
+		/* spin */
+	}
+	membar_store_any();
+	return spl;
+}
+
+static
+void
+lockstat_unlock(int spl)
+{
+	membar_any_store();
+	spinlock_data_set(&lockstat_word, 0);
+	splx(spl);
+}
+
+static
+bool
+timespec_gt(const struct timespec *a, const struct timespec *b)
+{
+	return a->tv_sec > b->tv_sec ||
+		(a->tv_sec == b->tv_sec && a->tv_nsec > b->tv_nsec);
+}
+
+/*
+ * Find (or make) the record for LOCK and PC. Returns NULL if the
+ * table is full.
+ */
+static
+struct lockstat_site *
+lockstat_lookup(const void *lock, const char *name, const void *pc)
+{
+	struct lockstat_site *s;
+	unsigned h, i;
+
+	h = ((uintptr_t)lock >> 3) ^ ((uintptr_t)pc >> 2);
+	for (i=0; i<LOCKSTAT_NSITES; i++) {
+		s = &lockstat_table[(h + i) % LOCKSTAT_NSITES];
+		if (s->s_lock == lock && s->s_pc == pc) {
+			return s;
+		}
+		if (s->s_lock == NULL) {
+			bzero(s, sizeof(*s));
+			s->s_lock = lock;
+			s->s_pc = pc;
+			snprintf(s->s_name, sizeof(s->s_name), "%s", name);
+			return s;
+		}
+	}
+	return NULL;
+}
+
+void
+lockstat_bootstrap(void)
+{
+	lockstat_enabled = true;
+}
+
+void
+lockstat_acquired(struct lockstat_lockable *l, const void *lock,
+		  const char *name, const void *pc,
+		  const struct timespec *waitstart)
+{
+	struct lockstat_site *s;
+	struct timespec now, wait;
+	int spl;
+
+	if (!lockstat_enabled) {
+		return;
+	}
+	gettime(&now);
+
+	spl = lockstat_lock();
+	if (!lockstat_enabled) {
+		/* lockstat_dump got in between */
+		lockstat_unlock(spl);
+		return;
+	}
+	s = lockstat_lookup(lock, name, pc);
+	if (s == NULL) {
+		lockstat_dropped++;
+	}
+	else {
+		s->s_acquires++;
+		if (waitstart != NULL) {
+			s->s_contended++;
+			timespec_sub(&now, waitstart, &wait);
+			timespec_add(&s->s_wait, &wait, &s->s_wait);
+		}
+	}
+	if (l != NULL) {
+		l->ls_site = s;
+		l->ls_gen = lockstat_gen;
+		l->ls_acquired = now;
+	}
+	lockstat_unlock(spl);
+}
+
+void
+lockstat_released(struct lockstat_lockable *l)
+{
+	struct timespec now, held;
+	int spl;
+
+	if (!lockstat_enabled || l->ls_site == NULL) {
+		return;
+	}
+	gettime(&now);
+	timespec_sub(&now, &l->ls_acquired, &held);
+
+	spl = lockstat_lock();
+	/* the record may have been reset and reused meanwhile */
+	if (l->ls_gen == lockstat_gen &&
+	    timespec_gt(&held, &l->ls_site->s_maxhold)) {
+		l->ls_site->s_maxhold = held;
+	}
+	l->ls_site = NULL;
+	lockstat_unlock(spl);
+}
+
+void
+lockstat_dump(unsigned n)
+{
+	struct lockstat_site *s, *best;
+	unsigned i, k;
+	int spl;
+
+	/*
+	 * Printing takes locks, which would come back here. Stop
+	 * collecting instead of holding lockstat_word; taking it once
+	 * makes sure nobody is still updating the table.
+	 */
+	lockstat_enabled = false;
+	spl = lockstat_lock();
+	lockstat_unlock(spl);
+
+	kprintf("%-16s %-10s %-10s %9s %9s %14s %14s\n", "lock", "addr",
+		"caller", "acquires", "contended", "wait (s)", "max hold (s)");
+	for (k=0; k<n; k++) {
+		best = NULL;
+		for (i=0; i<LOCKSTAT_NSITES; i++) {
+			s = &lockstat_table[i];
+			if (s->s_lock == NULL || s->s_printed ||
+			    s->s_contended == 0) {
+				continue;
+			}
+			if (best == NULL ||
+			    s->s_contended > best->s_contended ||
+			    (s->s_contended == best->s_contended &&
+			     timespec_gt(&s->s_wait, &best->s_wait))) {
+				best = s;
+			}
+		}
+		if (best == NULL) {
+			break;
+		}
+		best->s_printed = true;
+		kprintf("%-16s %p %p %9u %9u %4llu.%09lu %4llu.%09lu\n",
+			best->s_name, best->s_lock, best->s_pc,
+			best->s_acquires, best->s_contended,
+			(unsigned long long)best->s_wait.tv_sec,
+			(unsigned long)best->s_wait.tv_nsec,
+			(unsigned long long)best->s_maxhold.tv_sec,
+			(unsigned long)best->s_maxhold.tv_nsec);
+	}
+	if (k == 0) {
+		kprintf("(no contention)\n");
+	}
+	if (lockstat_dropped > 0) {
+		kprintf("%u acquisitions not counted: table full\n",
+			lockstat_dropped);
+	}
+
+	/* the same lock as the updates, so none is half done */
+	spl = lockstat_lock();
+	bzero(lockstat_table, sizeof(lockstat_table));
+	lockstat_dropped = 0;
+	lockstat_gen++;
+	lockstat_enabled = true;
+	lockstat_unlock(spl);
+}
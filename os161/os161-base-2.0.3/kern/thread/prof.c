@@ -0,0 +1,218 @@
+/*
+ * Sampling kernel profiler.
+ *
+ * Each CPU appends to its own buffer from the timer interrupt, with
+ * interrupts off, so the buffers need no lock; the control functions
+ * only touch them while sampling is off. Turning it off waits for
+ * ticks that already saw it on: each CPU marks itself in pb_intick
+ * before looking at prof_enabled, and prof_stop clears prof_enabled
+ * before waiting for the marks to go. A full buffer just counts what
+ * it drops.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <current.h>
+#include <membar.h>
+#include <prof.h>
+
+#define PROF_MAXCPUS	32	/* as many as System/161 can have */
+#define PROF_NSAMPLES	4096	/* per CPU; 40 seconds at HZ=100 */
+
+struct prof_sample {
+	vaddr_t ps_pc;		/* 0 for user mode */
+	vaddr_t ps_ra;
+};
+
+struct profbuf {
+	struct prof_sample *pb_samples;
+	unsigned pb_count;
+	unsigned pb_dropped;
+	volatile bool pb_intick;	/* prof_tick is running */
+};
+
+static struct profbuf prof_bufs[PROF_MAXCPUS];
+static unsigned prof_ncpus;		/* buffers set up by prof_start */
+static volatile bool prof_enabled;
+
+void
+prof_tick(vaddr_t pc, vaddr_t ra, bool user)
+{
+	struct profbuf *pb;
+
+	if (!prof_enabled || curcpu->c_number >= prof_ncpus) {
+		return;
+	}
+	pb = &prof_bufs[curcpu->c_number];
+	pb->pb_intick = true;
+	membar_any_any();
+	if (!prof_enabled) {
+		/* prof_stop got in between */
+	}
+	else if (pb->pb_count == PROF_NSAMPLES) {
+		pb->pb_dropped++;
+	}
+	else {
+		if (user) {
+			/* user addresses mean nothing against the kernel */
+			pc = ra = 0;
+		}
+		pb->pb_samples[pb->pb_count].ps_pc = pc;
+		pb->pb_samples[pb->pb_count].ps_ra = ra;
+		pb->pb_count++;
+	}
+	membar_store_store();
+	pb->pb_intick = false;
+}
+
+/*
+ * Wait until no CPU is inside prof_tick. Called with prof_enabled
+ * false, after which no new tick touches the buffers.
+ */
+static
+void
+prof_wait(void)
+{
+	unsigned i;
+
+	membar_any_any();
+	for (i=0; i<prof_ncpus; i++) {
+		while (prof_bufs[i].pb_intick) {
+			/* spin; a tick is short */
+		}
+	}
+	membar_load_load();
+}
+
+int
+prof_start(void)
+{
+	unsigned i, n;
+
+	if (prof_enabled) {
+		return EBUSY;
+	}
+	prof_wait();
+
+	n = cpu_count();
+	if (n > PROF_MAXCPUS) {
+		n = PROF_MAXCPUS;
+	}
+	for (i=0; i<n; i++) {
+		if (prof_bufs[i].pb_samples == NULL) {
+			prof_bufs[i].pb_samples =
+				kmalloc(PROF_NSAMPLES *
+					sizeof(struct prof_sample));
+			if (prof_bufs[i].pb_samples == NULL) {
+				return ENOMEM;
+			}
+		}
+	}
+	for (i=0; i<PROF_MAXCPUS; i++) {
+		prof_bufs[i].pb_count = 0;
+		prof_bufs[i].pb_dropped = 0;
+	}
+	prof_ncpus = n;
+
+	/* the buffers must be ready before anyone sees prof_enabled */
+	membar_store_store();
+	prof_enabled = true;
+	return 0;
+}
+
+void
+prof_stop(void)
+{
+	prof_enabled = false;
+	prof_wait();
+}
+
+static
+void
+prof_totals(unsigned *samples, unsigned *dropped)
+{
+	unsigned i;
+
+	*samples = *dropped = 0;
+	for (i=0; i<prof_ncpus; i++) {
+		*samples += prof_bufs[i].pb_count;
+		*dropped += prof_bufs[i].pb_dropped;
+	}
+}
+
+void
+prof_status(void)
+{
+	unsigned samples, dropped;
+
+	prof_totals(&samples, &dropped);
+	kprintf("prof: %s, %u samples, %u dropped\n",
+		prof_enabled ? "on" : "off", samples, dropped);
+}
+
+/*
+ * Print one line per distinct (pc, ra) with its count. The counting
+ * is done in a hash table sized for the worst case of all samples
+ * being different; if it cannot be had, every sample is printed on
+ * its own, which the script adds up just the same.
+ */
+void
+prof_dump(void)
+{
+	struct prof_hashent {
+		vaddr_t pc, ra;
+		unsigned count;
+	} *table;
+	const struct prof_sample *ps;
+	unsigned samples, dropped, size, i, j, h;
+
+	prof_stop();
+	prof_totals(&samples, &dropped);
+
+	size = 1;
+	while (size < 2 * samples) {
+		size *= 2;
+	}
+	table = samples > 0 ? kmalloc(size * sizeof(*table)) : NULL;
+	if (table != NULL) {
+		bzero(table, size * sizeof(*table));
+	}
+
+	kprintf("prof: begin %u samples %u dropped\n", samples, dropped);
+	for (i=0; i<prof_ncpus; i++) {
+		for (j=0; j<prof_bufs[i].pb_count; j++) {
+			ps = &prof_bufs[i].pb_samples[j];
+			if (table == NULL) {
+				kprintf("prof: 1 %08x %08x\n",
+					ps->ps_pc, ps->ps_ra);
+				continue;
+			}
+			h = ((ps->ps_pc >> 2) * 2654435761U) ^ (ps->ps_ra >> 2);
+			while (1) {
+				h &= size - 1;
+				if (table[h].count == 0) {
+					table[h].pc = ps->ps_pc;
+					table[h].ra = ps->ps_ra;
+				}
+				if (table[h].pc == ps->ps_pc &&
+				    table[h].ra == ps->ps_ra) {
+					table[h].count++;
+					break;
+				}
+				h++;
+			}
+		}
+	}
+	if (table != NULL) {
+		for (h=0; h<size; h++) {
+			if (table[h].count > 0) {
+				kprintf("prof: %u %08x %08x\n", table[h].count,
+					table[h].pc, table[h].ra);
+			}
+		}
+		kfree(table);
+	}
+	kprintf("prof: end\n");
+}
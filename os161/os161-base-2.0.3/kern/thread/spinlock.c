@@ -38,11 +38,32 @@
 #include <spinlock.h>
 #include <membar.h>
 #include <current.h>	/* for curcpu */
+#include <clock.h>	/* for gettime, used by lockstat */
 
 /*
  * Spinlocks.
  */
 
+/* Bounds, in delay loop rounds, of the backoff in spinlock_acquire. */
+#define SPINLOCK_BACKOFF_MIN	4
+#define SPINLOCK_BACKOFF_MAX	1024
+
+/* Ticket lock waiters spin this many rounds per CPU ahead of them. */
+#define TICKETLOCK_BACKOFF	32
+
+/*
+ * Waste some time without touching shared memory.
+ */
+static
+void
+spinlock_delay(unsigned rounds)
+{
+	volatile unsigned i;
+
+	for (i=0; i<rounds; i++) {
+		/* nothing */
+	}
+}
 
 /*
  * Initialize spinlock.
@@ -53,6 +74,7 @@ spinlock_init(struct spinlock *splk)
 	spinlock_data_set(&splk->splk_lock, 0);
 	splk->splk_holder = NULL;
 	HANGMAN_LOCKABLEINIT(&splk->splk_hangman, "spinlock");
+	LOCKSTAT_LOCKABLEINIT(&splk->splk_stat);
 }
 
 /*
@@ -76,6 +98,11 @@ void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+	unsigned backoff;
+#if OPT_LOCKSTAT
+	struct timespec waitstart;
+	bool waited = false;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -93,6 +120,7 @@ spinlock_acquire(struct spinlock *splk)
 		mycpu = NULL;
 	}
 
+	backoff = SPINLOCK_BACKOFF_MIN;
 	while (1) {
 		/*
 		 * Do test-test-and-set, that is, read first before
@@ -104,17 +132,35 @@ spinlock_acquire(struct spinlock *splk)
 		 * previously unheld and we now own it. If it was 1,
 		 * we don't.
 		 */
-		if (spinlock_data_get(&splk->splk_lock) != 0) {
-			continue;
+		if (spinlock_data_get(&splk->splk_lock) == 0 &&
+		    spinlock_data_testandset(&splk->splk_lock) == 0) {
+			break;
+		}
+
+		/*
+		 * Somebody else has it. Back off before looking again,
+		 * twice as long each time, so that when it is released
+		 * the waiters do not all go for it at once.
+		 */
+#if OPT_LOCKSTAT
+		if (!waited && lockstat_enabled) {
+			gettime(&waitstart);
+			waited = true;
 		}
-		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
-			continue;
+#endif
+		spinlock_delay(backoff);
+		if (backoff < SPINLOCK_BACKOFF_MAX) {
+			backoff *= 2;
 		}
-		break;
 	}
 
 	membar_store_any();
 	splk->splk_holder = mycpu;
+#if OPT_LOCKSTAT
+	lockstat_acquired(&splk->splk_stat, splk, "spinlock",
+			  __builtin_return_address(0),
+			  waited ? &waitstart : NULL);
+#endif
 
 	if (CURCPU_EXISTS()) {
 		HANGMAN_ACQUIRE(&curcpu->c_hangman, &splk->splk_hangman);
@@ -135,6 +181,9 @@ spinlock_release(struct spinlock *splk)
 		HANGMAN_RELEASE(&curcpu->c_hangman, &splk->splk_hangman);
 	}
 
+#if OPT_LOCKSTAT
+	lockstat_released(&splk->splk_stat);
+#endif
 	splk->splk_holder = NULL;
 	membar_any_store();
 	spinlock_data_set(&splk->splk_lock, 0);
@@ -154,3 +203,135 @@ spinlock_do_i_hold(struct spinlock *splk)
 	/* Assume we can read splk_holder atomically enough for this to work */
 	return (splk->splk_holder == curcpu->c_self);
 }
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Ticket locks.
+ */
+
+/*
+ * Initialize ticket lock.
+ */
+void
+ticketlock_init(struct ticketlock *tl)
+{
+	spinlock_data_set(&tl->tl_next, 0);
+	spinlock_data_set(&tl->tl_serving, 0);
+	tl->tl_holder = NULL;
+	HANGMAN_LOCKABLEINIT(&tl->tl_hangman, "ticketlock");
+	LOCKSTAT_LOCKABLEINIT(&tl->tl_stat);
+}
+
+/*
+ * Clean up ticket lock.
+ */
+void
+ticketlock_cleanup(struct ticketlock *tl)
+{
+	KASSERT(tl->tl_holder == NULL);
+	KASSERT(spinlock_data_get(&tl->tl_next) ==
+		spinlock_data_get(&tl->tl_serving));
+}
+
+/*
+ * Get the lock.
+ *
+ * As for spinlocks, disable interrupts first. Then take a ticket and
+ * wait for it to be served. Since we know how many CPUs are ahead of
+ * us, we can wait about as long as they will take before looking at
+ * the lock again.
+ */
+void
+ticketlock_acquire(struct ticketlock *tl)
+{
+	struct cpu *mycpu;
+	spinlock_data_t ticket, serving;
+#if OPT_LOCKSTAT
+	struct timespec waitstart;
+	bool waited = false;
+#endif
+
+	splraise(IPL_NONE, IPL_HIGH);
+
+	/* this must work before curcpu initialization */
+	if (CURCPU_EXISTS()) {
+		mycpu = curcpu->c_self;
+		if (tl->tl_holder == mycpu) {
+			panic("Deadlock on ticketlock %p\n", tl);
+		}
+		mycpu->c_spinlocks++;
+
+		HANGMAN_WAIT(&curcpu->c_hangman, &tl->tl_hangman);
+	}
+	else {
+		mycpu = NULL;
+	}
+
+	ticket = spinlock_data_fetchinc(&tl->tl_next);
+	while (1) {
+		serving = spinlock_data_get(&tl->tl_serving);
+		if (serving == ticket) {
+			break;
+		}
+#if OPT_LOCKSTAT
+		if (!waited && lockstat_enabled) {
+			gettime(&waitstart);
+			waited = true;
+		}
+#endif
+		spinlock_delay((ticket - serving) * TICKETLOCK_BACKOFF);
+	}
+
+	membar_store_any();
+	tl->tl_holder = mycpu;
+#if OPT_LOCKSTAT
+	lockstat_acquired(&tl->tl_stat, tl, "ticketlock",
+			  __builtin_return_address(0),
+			  waited ? &waitstart : NULL);
+#endif
+
+	if (CURCPU_EXISTS()) {
+		HANGMAN_ACQUIRE(&curcpu->c_hangman, &tl->tl_hangman);
+	}
+}
+
+/*
+ * Release the lock, handing it to the next ticket. Only the holder
+ * writes tl_serving, so this needs no atomic operation.
+ */
+void
+ticketlock_release(struct ticketlock *tl)
+{
+	spinlock_data_t serving;
+
+	/* this must work before curcpu initialization */
+	if (CURCPU_EXISTS()) {
+		KASSERT(tl->tl_holder == curcpu->c_self);
+		KASSERT(curcpu->c_spinlocks > 0);
+		curcpu->c_spinlocks--;
+		HANGMAN_RELEASE(&curcpu->c_hangman, &tl->tl_hangman);
+	}
+
+#if OPT_LOCKSTAT
+	lockstat_released(&tl->tl_stat);
+#endif
+	tl->tl_holder = NULL;
+	serving = spinlock_data_get(&tl->tl_serving);
+	membar_any_store();
+	spinlock_data_set(&tl->tl_serving, serving + 1);
+	spllower(IPL_HIGH, IPL_NONE);
+}
+
+/*
+ * Check if the current cpu holds the lock.
+ */
+bool
+ticketlock_do_i_hold(struct ticketlock *tl)
+{
+	if (!CURCPU_EXISTS()) {
+		return true;
+	}
+
+	return (tl->tl_holder == curcpu->c_self);
+}
@@ -35,10 +35,13 @@
 #include <types.h>
 #include <lib.h>
 #include <spinlock.h>
+#include <cpu.h>
 #include <wchan.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <clock.h>
+#include <lockstat.h>
 
 ////////////////////////////////////////////////////////////
 //
@@ -85,9 +88,19 @@ sem_destroy(struct semaphore *sem)
         kfree(sem);
 }
 
+/*
+ * P, charging the wait to CALLER for lockstat. Locks built on
+ * semaphores pass NULL, as they keep their own statistics.
+ */
+static
 void
-P(struct semaphore *sem)
+sem_p(struct semaphore *sem, const void *caller)
 {
+#if OPT_LOCKSTAT
+	struct timespec waitstart;
+	bool waited;
+#endif
+
         KASSERT(sem != NULL);
 
         /*
@@ -100,6 +113,12 @@ P(struct semaphore *sem)
 
 	/* Use the semaphore spinlock to protect the wchan as well. */
 	spinlock_acquire(&sem->sem_lock);
+#if OPT_LOCKSTAT
+	waited = sem->sem_count == 0 && lockstat_enabled;
+	if (waited) {
+		gettime(&waitstart);
+	}
+#endif
         while (sem->sem_count == 0) {
 		/*
 		 *
@@ -117,9 +136,23 @@ P(struct semaphore *sem)
         }
         KASSERT(sem->sem_count > 0);
         sem->sem_count--;
+#if OPT_LOCKSTAT
+	if (caller != NULL) {
+		lockstat_acquired(NULL, sem, sem->sem_name, caller,
+				  waited ? &waitstart : NULL);
+	}
+#else
+	(void)caller;
+#endif
 	spinlock_release(&sem->sem_lock);
 }
 
+void
+P(struct semaphore *sem)
+{
+	sem_p(sem, __builtin_return_address(0));
+}
+
 void
 V(struct semaphore *sem)
 {
@@ -170,7 +203,9 @@ lock_create(const char *name)
 	  return NULL;
 	}
 	lock->lk_owner = NULL;
+	lock->lk_ownercpu = NULL;
 	spinlock_init(&lock->lk_lock);
+	LOCKSTAT_LOCKABLEINIT(&lock->lk_stat);
 #else
 	HANGMAN_LOCKABLEINIT(&lock->lk_hangman, lock->lk_name);
 #endif	
@@ -196,9 +231,66 @@ lock_destroy(struct lock *lock)
         kfree(lock);
 }
 
+#if OPT_SHELL
+/*
+ * Adaptive locking: a lock held by a thread that is running on another
+ * CPU is likely to be released within a few instructions, so it is
+ * cheaper to wait for it here than to sleep and be woken up (two
+ * context switches). Spin while that is the case, for at most
+ * LOCK_SPIN_ROUNDS rounds, then let the caller sleep as usual.
+ *
+ * The spinning is done on plain volatile reads, backing off a little
+ * more each round: lk_lock is what the owner needs to release the
+ * lock, so taking it here would slow down the very release we wait
+ * for. The caller takes lk_lock once the owner looks gone or stopped
+ * running.
+ *
+ * Without lk_lock the owner may release the lock and exit while we
+ * look at it, so the owner thread is never dereferenced. Instead
+ * lock_acquire records in lk_ownercpu the CPU the owner took the lock
+ * on, and the owner counts as running as long as it is still that
+ * CPU's current thread. CPUs are never freed, and the two fields may
+ * be read from different owners only to give a wrong guess for one
+ * round: the next one sees that lk_owner has changed.
+ */
+#define LOCK_SPIN_ROUNDS 1000
+#define LOCK_SPIN_BACKOFF_MAX 64
+
+static
+void
+lock_spin(struct lock *lock)
+{
+	volatile struct thread *owner;
+	struct cpu *cpu;
+	volatile unsigned j;
+	unsigned i, backoff = 1;
+
+	for (i=0; i<LOCK_SPIN_ROUNDS; i++) {
+		owner = ((volatile struct lock *)lock)->lk_owner;
+		cpu = lock->lk_ownercpu;
+		if (owner == NULL || cpu == NULL || cpu == curcpu->c_self ||
+		    ((volatile struct cpu *)cpu)->c_curthread != owner) {
+			/* free (go take it) or not worth spinning for */
+			return;
+		}
+		for (j=0; j<backoff; j++) {
+			/* wait */
+		}
+		if (backoff < LOCK_SPIN_BACKOFF_MAX) {
+			backoff *= 2;
+		}
+	}
+}
+#endif
+
 void
 lock_acquire(struct lock *lock)
 {
+#if OPT_SHELL && OPT_LOCKSTAT
+	struct timespec waitstart;
+	bool waited;
+#endif
+
 	/* Call this (atomically) before waiting for a lock */
 	//HANGMAN_WAIT(&curthread->t_hangman, &lock->lk_hangman);
 
@@ -212,6 +304,13 @@ lock_acquire(struct lock *lock)
 
     KASSERT(curthread->t_in_interrupt == false);
 
+#if OPT_LOCKSTAT
+	waited = lock->lk_owner != NULL && lockstat_enabled;
+	if (waited) {
+		gettime(&waitstart);
+	}
+#endif
+
 #if USE_SEMAPHORE_FOR_LOCK
 /*
  *  G.Cabodi - 2019: P BEFORE(!!!) spinlock acquire. OS161 forbids sleeping/realeasing
@@ -220,9 +319,11 @@ lock_acquire(struct lock *lock)
  *  This is checked in various parts of the code (see for instance wchan_sleep.
  *  as P may result in "wait", it cannot be called while owning the spinlock.
  */
-    P(lock->lk_sem);
+    lock_spin(lock);
+    sem_p(lock->lk_sem, NULL);
 	spinlock_acquire(&lock->lk_lock);        
 #else
+    lock_spin(lock);
 	spinlock_acquire(&lock->lk_lock);        
 	while (lock->lk_owner != NULL) {
 		wchan_sleep(lock->lk_wchan, &lock->lk_lock);
@@ -230,6 +331,12 @@ lock_acquire(struct lock *lock)
 #endif
     KASSERT(lock->lk_owner == NULL);
     lock->lk_owner=curthread;
+    lock->lk_ownercpu=curcpu->c_self;
+#if OPT_LOCKSTAT
+	lockstat_acquired(&lock->lk_stat, lock, lock->lk_name,
+			  __builtin_return_address(0),
+			  waited ? &waitstart : NULL);
+#endif
 	spinlock_release(&lock->lk_lock);
 #endif
     (void)lock;  // suppress warning until code gets written
@@ -248,6 +355,9 @@ lock_release(struct lock *lock)
 	KASSERT(lock != NULL);
 	KASSERT(lock_do_i_hold(lock));
 	spinlock_acquire(&lock->lk_lock);
+#if OPT_LOCKSTAT
+	lockstat_released(&lock->lk_stat);
+#endif
     lock->lk_owner=NULL;
 	/*  G.Cabodi - 2019: no problem here owning a spinlock, as V/wchan_wakeone 
 	    do not lead to wait state */
@@ -394,3 +504,164 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 	(void)cv;    // suppress warning until code gets written
 	(void)lock;  // suppress warning until code gets written
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name, int mode)
+{
+	struct rwlock *rw;
+
+	KASSERT(mode == RWLOCK_WRITERPREF || mode == RWLOCK_FAIR);
+
+	rw = kmalloc(sizeof(*rw));
+	if (rw == NULL) {
+		return NULL;
+	}
+
+	rw->rw_name = kstrdup(name);
+	if (rw->rw_name == NULL) {
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_rwchan = wchan_create(rw->rw_name);
+	if (rw->rw_rwchan == NULL) {
+		kfree(rw->rw_name);
+		kfree(rw);
+		return NULL;
+	}
+	rw->rw_wwchan = wchan_create(rw->rw_name);
+	if (rw->rw_wwchan == NULL) {
+		wchan_destroy(rw->rw_rwchan);
+		kfree(rw->rw_name);
+		kfree(rw);
+		return NULL;
+	}
+
+	spinlock_init(&rw->rw_lock);
+	rw->rw_mode = mode;
+	rw->rw_readers = 0;
+	rw->rw_rwait = 0;
+	rw->rw_wwait = 0;
+	rw->rw_rgen = 0;
+	rw->rw_writer = NULL;
+	return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(rw->rw_readers == 0);
+	KASSERT(rw->rw_writer == NULL);
+	KASSERT(rw->rw_rwait == 0 && rw->rw_wwait == 0);
+
+	spinlock_cleanup(&rw->rw_lock);
+	wchan_destroy(rw->rw_wwchan);
+	wchan_destroy(rw->rw_rwchan);
+	kfree(rw->rw_name);
+	kfree(rw);
+}
+
+/*
+ * Let every queued reader in. They are counted in rw_readers here, so
+ * that a writer cannot slip in before they get to run.
+ */
+static
+void
+rwlock_admit_readers(struct rwlock *rw)
+{
+	KASSERT(spinlock_do_i_hold(&rw->rw_lock));
+
+	rw->rw_readers += rw->rw_rwait;
+	rw->rw_rwait = 0;
+	rw->rw_rgen++;
+	wchan_wakeall(rw->rw_rwchan, &rw->rw_lock);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+	unsigned gen;
+
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer != curthread);
+	if (rw->rw_writer == NULL && rw->rw_wwait == 0) {
+		rw->rw_readers++;
+	}
+	else {
+		/* wait to be let in by rwlock_admit_readers */
+		rw->rw_rwait++;
+		gen = rw->rw_rgen;
+		while (rw->rw_rgen == gen) {
+			wchan_sleep(rw->rw_rwchan, &rw->rw_lock);
+		}
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_readers > 0);
+	rw->rw_readers--;
+	if (rw->rw_readers == 0 && rw->rw_wwait > 0) {
+		wchan_wakeone(rw->rw_wwchan, &rw->rw_lock);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer != curthread);
+	rw->rw_wwait++;
+	while (rw->rw_writer != NULL || rw->rw_readers > 0) {
+		wchan_sleep(rw->rw_wwchan, &rw->rw_lock);
+	}
+	rw->rw_wwait--;
+	rw->rw_writer = curthread;
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer == curthread);
+	rw->rw_writer = NULL;
+	if (rw->rw_rwait > 0 &&
+	    (rw->rw_mode == RWLOCK_FAIR || rw->rw_wwait == 0)) {
+		rwlock_admit_readers(rw);
+	}
+	else if (rw->rw_wwait > 0) {
+		wchan_wakeone(rw->rw_wwchan, &rw->rw_lock);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+	bool res;
+
+	spinlock_acquire(&rw->rw_lock);
+	res = rw->rw_writer == curthread;
+	spinlock_release(&rw->rw_lock);
+	return res;
+}
@@ -49,6 +49,7 @@
 #include <synch.h>
 #include <addrspace.h>
 #include <mainbus.h>
+#include <clock.h>
 #include <vnode.h>
 
 
@@ -69,6 +70,10 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/* Work stealing (see below). */
+static void thread_kick_idle(struct cpu *c);
+static bool thread_steal(void);
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -140,6 +145,8 @@ thread_create(const char *name)
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
+	thread->t_prio = 0;
+	thread->t_ticks = 0;
 	#if OPT_SHELL == 0
 	HANGMAN_ACTORINIT(&thread->t_hangman, thread->t_name);
 	#endif
@@ -446,6 +453,51 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Number of CPUs. Their c_number runs from 0 to this minus one.
+ */
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+/*
+ * Scheduling levels.
+ *
+ * Each thread has a level, 0 (highest) to MLFQ_LEVELS-1. Run queues
+ * are kept sorted by level, first come first served within a level,
+ * which amounts to one queue per level with the highest nonempty one
+ * served first. New threads start at level 0. A thread that uses up
+ * its whole quantum, which doubles at each level, goes down a level;
+ * a thread woken up after sleeping goes up one, so threads that
+ * mostly wait for I/O stay ahead of the CPU hogs. schedule() ages
+ * waiting threads so that nothing starves.
+ */
+#define MLFQ_LEVELS		4
+#define MLFQ_QUANTUM(level)	(1U << (level))	/* in hardclocks */
+
+/*
+ * Put T on the run queue of C, after the other threads of its level.
+ */
+static
+void
+thread_enqueue(struct cpu *c, struct thread *t)
+{
+	struct threadlistnode *n;
+
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+
+	for (n = c->c_runqueue.tl_tail.tln_prev; n->tln_self != NULL;
+	     n = n->tln_prev) {
+		if (n->tln_self->t_prio <= t->t_prio) {
+			threadlist_insertafter(&c->c_runqueue, n->tln_self, t);
+			return;
+		}
+	}
+	threadlist_addhead(&c->c_runqueue, t);
+}
+
 /*
  * Make a thread runnable.
  *
@@ -468,9 +520,15 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		spinlock_acquire(&targetcpu->c_runqueue_lock);
 	}
 
+	if (target->t_state == S_SLEEP && target->t_prio > 0) {
+		/* it waited rather than computed: move it up */
+		target->t_prio--;
+		target->t_ticks = 0;
+	}
+
 	/* Target thread is now ready to run; put it on the run queue. */
 	target->t_state = S_READY;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	thread_enqueue(targetcpu, target);
 
 	if (targetcpu->c_isidle && targetcpu != curcpu->c_self) {
 		/*
@@ -479,6 +537,10 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		 */
 		ipi_send(targetcpu, IPI_UNIDLE);
 	}
+	else if (!targetcpu->c_isidle) {
+		/* it has to wait; let an idle processor steal it */
+		thread_kick_idle(targetcpu);
+	}
 
 	if (!already_have_lock) {
 		spinlock_release(&targetcpu->c_runqueue_lock);
@@ -566,6 +628,7 @@ void
 thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 {
 	struct thread *cur, *next;
+	bool stopped;
 	int spl;
 
 	DEBUGASSERT(curcpu->c_curthread == curthread);
@@ -648,7 +711,13 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		next = threadlist_remhead(&curcpu->c_runqueue);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
+			if (!thread_steal()) {
+				stopped = hardclock_stop();
+				cpu_idle();
+				if (stopped) {
+					hardclock_restart();
+				}
+			}
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
@@ -822,139 +891,165 @@ thread_yield(void)
 /*
  * Scheduler.
  *
- * This is called periodically from hardclock(). It should reshuffle
- * the current CPU's run queue by job priority.
+ * thread_timeslice is called from hardclock() on every tick. It
+ * charges the tick to the current thread; once the thread has used
+ * the quantum of its level it goes down a level and yields. It also
+ * yields early if a thread of a higher level is waiting.
  */
+void
+thread_timeslice(void)
+{
+	struct thread *cur = curthread;
+	struct thread *first;
+	bool preempt;
 
+	if (curcpu->c_isidle) {
+		return;
+	}
+
+	cur->t_ticks++;
+	if (cur->t_ticks >= MLFQ_QUANTUM(cur->t_prio)) {
+		cur->t_ticks = 0;
+		if (cur->t_prio < MLFQ_LEVELS - 1) {
+			cur->t_prio++;
+		}
+		thread_yield();
+		return;
+	}
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	first = curcpu->c_runqueue.tl_head.tln_next->tln_self;
+	preempt = first != NULL && first->t_prio < cur->t_prio;
+	spinlock_release(&curcpu->c_runqueue_lock);
+
+	if (preempt) {
+		thread_yield();
+	}
+}
+
+/*
+ * This is called periodically from hardclock(). It ages the threads
+ * waiting in the current CPU's run queue by moving each of them up a
+ * level, so that CPU-bound threads stuck at the bottom still run.
+ * Moving all of them up keeps the queue sorted.
+ */
 void
 schedule(void)
 {
-	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
-	 */
+	struct threadlistnode *n;
+	struct thread *t;
+
+	if (curcpu->c_runqueue.tl_count == 0) {
+		/* unlocked peek: nothing to age, don't bother locking */
+		return;
+	}
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	for (n = curcpu->c_runqueue.tl_head.tln_next; n->tln_self != NULL;
+	     n = n->tln_next) {
+		t = n->tln_self;
+		if (t->t_prio > 0) {
+			t->t_prio--;
+			t->t_ticks = 0;
+		}
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
 }
 
 /*
- * Thread migration.
+ * Work stealing.
  *
- * This is also called periodically from hardclock(). If the current
- * CPU is busy and other CPUs are idle, or less busy, it should move
- * threads across to those other other CPUs.
+ * A CPU that runs out of threads in thread_switch takes one from the
+ * busiest run queue before going idle, and a CPU that gets a thread
+ * queued behind a running one wakes up an idle CPU so that it comes
+ * and steals it. So load spreads out as soon as it appears, rather
+ * than at the next periodic rebalance.
  *
- * Migrating threads isn't free because of cache affinity; a thread's
- * working cache set will end up having to be moved to the other CPU,
- * which is fairly slow. The tradeoff between this performance loss
- * and the performance loss due to underutilization of some CPUs is
- * something that needs to be tuned and probably is workload-specific.
- *
- * For here and now, because we know we're running on System/161 and
- * System/161 does not (yet) model such cache effects, we'll be very
- * aggressive.
+ * The thread taken is the last one in the queue, i.e. the one of the
+ * lowest level that would have waited longest anyway. Migrating
+ * threads loses cache affinity, but System/161 does not model cache
+ * effects, so we steal eagerly.
+ */
+
+/*
+ * Wake up one idle CPU, other than the current one and C, if any.
  */
+static
 void
-thread_consider_migration(void)
+thread_kick_idle(struct cpu *c)
 {
-	unsigned my_count, total_count, one_share, to_send;
 	unsigned i, numcpus;
-	struct cpu *c;
-	struct threadlist victims;
-	struct thread *t;
+	struct cpu *other;
 
-	my_count = total_count = 0;
 	numcpus = cpuarray_num(&allcpus);
 	for (i=0; i<numcpus; i++) {
-		c = cpuarray_get(&allcpus, i);
-		spinlock_acquire(&c->c_runqueue_lock);
-		total_count += c->c_runqueue.tl_count;
-		if (c == curcpu->c_self) {
-			my_count = c->c_runqueue.tl_count;
+		other = cpuarray_get(&allcpus, i);
+		/* unlocked peek: at worst we send a useless interrupt */
+		if (other != c && other != curcpu->c_self && other->c_isidle) {
+			ipi_send(other, IPI_UNIDLE);
+			return;
 		}
-		spinlock_release(&c->c_runqueue_lock);
-	}
-
-	one_share = DIVROUNDUP(total_count, numcpus);
-	if (my_count < one_share) {
-		return;
 	}
+}
 
-	to_send = my_count - one_share;
-	threadlist_init(&victims);
-	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
-	}
-	spinlock_release(&curcpu->c_runqueue_lock);
+/*
+ * Move one thread from the busiest other run queue to ours. Called
+ * from thread_switch with no run queue locked, as the current CPU is
+ * about to go idle. Returns true if a thread was taken.
+ */
+static
+bool
+thread_steal(void)
+{
+	unsigned i, numcpus, most;
+	struct cpu *c, *victim;
+	struct threadlistnode *n;
+	struct thread *t;
 
-	for (i=0; i < numcpus && to_send > 0; i++) {
+	/* pick a victim by peeking at the counts without locking */
+	victim = NULL;
+	most = 0;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
 		c = cpuarray_get(&allcpus, i);
-		if (c == curcpu->c_self) {
-			continue;
-		}
-		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
-			t = threadlist_remhead(&victims);
-			/*
-			 * Ordinarily, curthread will not appear on
-			 * the run queue. However, it can under the
-			 * following circumstances:
-			 *   - it went to sleep;
-			 *   - the processor became idle, so it
-			 *     remained curthread;
-			 *   - it was reawakened, so it was put on the
-			 *     run queue;
-			 *   - and the processor hasn't fully unidled
-			 *     yet, so all these things are still true.
-			 *
-			 * If the timer interrupt happens at (almost)
-			 * exactly the proper moment, we can come here
-			 * while things are in this state and see
-			 * curthread. However, *migrating* curthread
-			 * can cause bad things to happen (Exercise:
-			 * Why? And what?) so shuffle it to the end of
-			 * the list and decrement to_send in order to
-			 * skip it. Then it goes back on our own run
-			 * queue below.
-			 */
-			if (t == curthread) {
-				threadlist_addtail(&victims, t);
-				to_send--;
-				continue;
-			}
-
-			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
-			DEBUG(DB_THREADS,
-			      "Migrated thread %s: cpu %u -> %u",
-			      t->t_name, curcpu->c_number, c->c_number);
-			to_send--;
-			if (c->c_isidle) {
-				/*
-				 * Other processor is idle; send
-				 * interrupt to make sure it unidles.
-				 */
-				ipi_send(c, IPI_UNIDLE);
-			}
+		if (c != curcpu->c_self && c->c_runqueue.tl_count > most) {
+			victim = c;
+			most = c->c_runqueue.tl_count;
 		}
-		spinlock_release(&c->c_runqueue_lock);
+	}
+	if (victim == NULL) {
+		return false;
 	}
 
-	/*
-	 * Because the code above isn't atomic, the thread counts may have
-	 * changed while we were working and we may end up with leftovers.
-	 * Don't panic; just put them back on our own run queue.
-	 */
-	if (!threadlist_isempty(&victims)) {
-		spinlock_acquire(&curcpu->c_runqueue_lock);
-		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+	spinlock_acquire(&victim->c_runqueue_lock);
+	t = NULL;
+	for (n = victim->c_runqueue.tl_tail.tln_prev; n->tln_self != NULL;
+	     n = n->tln_prev) {
+		/*
+		 * The run queue can briefly hold the thread the victim
+		 * is still running (it went to sleep, was woken up,
+		 * and the victim has not left the idle loop yet). That
+		 * one must stay.
+		 */
+		if (n->tln_self != victim->c_curthread) {
+			t = n->tln_self;
+			threadlist_remove(&victim->c_runqueue, t);
+			break;
 		}
-		spinlock_release(&curcpu->c_runqueue_lock);
 	}
+	spinlock_release(&victim->c_runqueue_lock);
+	if (t == NULL) {
+		return false;
+	}
+
+	DEBUG(DB_THREADS, "Stole thread %s: cpu %u -> %u",
+	      t->t_name, victim->c_number, curcpu->c_number);
 
-	KASSERT(threadlist_isempty(&victims));
-	threadlist_cleanup(&victims);
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	t->t_cpu = curcpu->c_self;
+	thread_enqueue(curcpu->c_self, t);
+	spinlock_release(&curcpu->c_runqueue_lock);
+	return true;
 }
 
 ////////////////////////////////////////////////////////////
@@ -1168,6 +1263,26 @@ ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 	spinlock_release(&target->c_ipi_lock);
 }
 
+/*
+ * Send a TLB shootdown IPI to all CPUs except this one. Returns the
+ * number of CPUs it went to.
+ */
+unsigned
+ipi_tlbshootdown_broadcast(const struct tlbshootdown *mapping)
+{
+	unsigned i, n = 0;
+	struct cpu *c;
+
+	for (i=0; i < cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c != curcpu->c_self) {
+			ipi_tlbshootdown(c, mapping);
+			n++;
+		}
+	}
+	return n;
+}
+
 /*
  * Handle an incoming interprocessor interrupt.
  */
@@ -1175,7 +1290,8 @@ void
 interprocessor_interrupt(void)
 {
 	uint32_t bits;
-	unsigned i;
+	unsigned i, nshootdown = 0;
+	struct tlbshootdown shootdown[TLBSHOOTDOWN_MAX];
 
 	spinlock_acquire(&curcpu->c_ipi_lock);
 	bits = curcpu->c_ipi_pending;
@@ -1205,16 +1321,22 @@ interprocessor_interrupt(void)
 	}
 	if (bits & (1U << IPI_TLBSHOOTDOWN)) {
 		/*
-		 * Note: depending on your VM system locking you might
-		 * need to release the ipi lock while calling
-		 * vm_tlbshootdown.
+		 * Take the requests and handle them after releasing
+		 * the ipi lock: vm_tlbshootdown may wake up the
+		 * sender, which takes a run queue lock, and run queue
+		 * locks are held while sending IPIs.
 		 */
-		for (i=0; i<curcpu->c_numshootdown; i++) {
-			vm_tlbshootdown(&curcpu->c_shootdown[i]);
+		nshootdown = curcpu->c_numshootdown;
+		for (i=0; i<nshootdown; i++) {
+			shootdown[i] = curcpu->c_shootdown[i];
 		}
 		curcpu->c_numshootdown = 0;
 	}
 
 	curcpu->c_ipi_pending = 0;
 	spinlock_release(&curcpu->c_ipi_lock);
+
+	for (i=0; i<nshootdown; i++) {
+		vm_tlbshootdown(&shootdown[i]);
+	}
 }
@@ -191,6 +191,19 @@ dev_stat(struct vnode *v, struct stat *statbuf)
 	return 0;
 }
 
+/*
+ * Return the size; 0 for character devices, as in dev_stat.
+ */
+static
+int
+dev_getsize(struct vnode *v, off_t *ret)
+{
+	struct device *d = v->vn_data;
+
+	*ret = (off_t)d->d_blocks * d->d_blocksize;
+	return 0;
+}
+
 /*
  * Return the type. A device is a "block device" if it has a known
  * length. A device that generates data in a stream is a "character
@@ -237,15 +250,19 @@ null_fsync(struct vnode *v)
 }
 
 /*
- * For mmap. If you want this to do anything, you have to write it
- * yourself. Some devices may not make sense to map. Others do.
+ * For mmap. None of our devices has memory that makes sense to map:
+ * the console and the random device are streams, and disks are only
+ * accessed through the filesystems mounted on them.
  */
 static
 int
-dev_mmap(struct vnode *v  /* add stuff as needed */)
+dev_mmap(struct vnode *v, int prot, int flags, struct shm_object **ret)
 {
 	(void)v;
-	return ENOSYS;
+	(void)prot;
+	(void)flags;
+	(void)ret;
+	return ENODEV;
 }
 
 /*
@@ -330,10 +347,12 @@ static const struct vnode_ops dev_vnode_ops = {
 	.vop_read = dev_read,
 	.vop_readlink = vopfail_uio_inval,
 	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_getdirents = vopfail_uio_notdir,
 	.vop_write = dev_write,
 	.vop_ioctl = dev_ioctl,
 	.vop_stat = dev_stat,
 	.vop_gettype = dev_gettype,
+	.vop_getsize = dev_getsize,
 	.vop_isseekable = dev_isseekable,
 	.vop_fsync = null_fsync,
 	.vop_mmap = dev_mmap,
@@ -0,0 +1,352 @@
+/*
+ * Anonymous pipes.
+ *
+ * Each pipe owns a PIPE_BUFSIZE ring buffer protected by a sleep lock
+ * (uiomove may fault, so a spinlock cannot be held across the copy).
+ * Readers sleep on pp_readcv while the buffer is empty, writers sleep
+ * on pp_writecv while it is full.
+ *
+ * The two ends are separate vnodes embedded in struct pipe. The
+ * openfile holding an end owns exactly one reference to its vnode, so
+ * VOP_RECLAIM on an end means that end has been closed everywhere.
+ * The pipe itself goes away when both ends have been reclaimed.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <stat.h>
+#include <uio.h>
+#include <synch.h>
+#include <vnode.h>
+#include <pipe.h>
+
+struct pipe {
+	char *pp_buf;			/* ring buffer */
+	unsigned pp_start;		/* index of first unread byte */
+	unsigned pp_count;		/* bytes currently buffered */
+	bool pp_readeropen;		/* read end still referenced */
+	bool pp_writeropen;		/* write end still referenced */
+	struct lock *pp_lock;		/* protects all of the above */
+	struct cv *pp_readcv;		/* readers wait here for data */
+	struct cv *pp_writecv;		/* writers wait here for space */
+	struct vnode pp_readvn;		/* read end */
+	struct vnode pp_writevn;	/* write end */
+};
+
+static const struct vnode_ops pipe_vnode_ops;
+
+static
+void
+pipe_destroy(struct pipe *pp)
+{
+	cv_destroy(pp->pp_writecv);
+	cv_destroy(pp->pp_readcv);
+	lock_destroy(pp->pp_lock);
+	kfree(pp->pp_buf);
+	kfree(pp);
+}
+
+/*
+ * Called when the last reference to one end goes away.
+ */
+static
+int
+pipe_reclaim(struct vnode *vn)
+{
+	struct pipe *pp = vn->vn_data;
+	bool lastend;
+
+	lock_acquire(pp->pp_lock);
+	/*
+	 * Clean up before marking this end closed: once both ends are
+	 * marked, the other end's reclaim may free pp, vn included.
+	 */
+	vnode_cleanup(vn);
+	if (vn == &pp->pp_readvn) {
+		pp->pp_readeropen = false;
+		/* blocked writers must fail with EPIPE */
+		cv_broadcast(pp->pp_writecv, pp->pp_lock);
+	}
+	else {
+		KASSERT(vn == &pp->pp_writevn);
+		pp->pp_writeropen = false;
+		/* blocked readers must see EOF */
+		cv_broadcast(pp->pp_readcv, pp->pp_lock);
+	}
+	lastend = !pp->pp_readeropen && !pp->pp_writeropen;
+	lock_release(pp->pp_lock);
+
+	if (lastend) {
+		pipe_destroy(pp);
+	}
+	return 0;
+}
+
+static
+int
+pipe_eachopen(struct vnode *vn, int openflags)
+{
+	(void)vn;
+	(void)openflags;
+	return 0;
+}
+
+/*
+ * Read: block until there is data or no writer is left, then hand
+ * back whatever is buffered (up to the request size).
+ */
+static
+int
+pipe_read(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *pp = vn->vn_data;
+	size_t len, chunk;
+	int result = 0;
+
+	KASSERT(uio->uio_rw == UIO_READ);
+	if (vn != &pp->pp_readvn) {
+		return EBADF;
+	}
+
+	lock_acquire(pp->pp_lock);
+	while (pp->pp_count == 0 && pp->pp_writeropen) {
+		cv_wait(pp->pp_readcv, pp->pp_lock);
+	}
+
+	/* empty and no writers: EOF */
+	len = pp->pp_count;
+	if (len > uio->uio_resid) {
+		len = uio->uio_resid;
+	}
+
+	while (len > 0) {
+		chunk = PIPE_BUFSIZE - pp->pp_start;
+		if (chunk > len) {
+			chunk = len;
+		}
+		result = uiomove(pp->pp_buf + pp->pp_start, chunk, uio);
+		if (result) {
+			break;
+		}
+		pp->pp_start = (pp->pp_start + chunk) % PIPE_BUFSIZE;
+		pp->pp_count -= chunk;
+		len -= chunk;
+	}
+
+	cv_broadcast(pp->pp_writecv, pp->pp_lock);
+	lock_release(pp->pp_lock);
+	return result;
+}
+
+/*
+ * Write: copy everything in, blocking whenever the buffer is full.
+ * Fails with EPIPE if the read end is gone and nothing was written.
+ */
+static
+int
+pipe_write(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *pp = vn->vn_data;
+	size_t chunk, tail;
+	bool written = false;
+	int result = 0;
+
+	KASSERT(uio->uio_rw == UIO_WRITE);
+	if (vn != &pp->pp_writevn) {
+		return EBADF;
+	}
+
+	lock_acquire(pp->pp_lock);
+	while (uio->uio_resid > 0) {
+		while (pp->pp_count == PIPE_BUFSIZE && pp->pp_readeropen) {
+			cv_wait(pp->pp_writecv, pp->pp_lock);
+		}
+		if (!pp->pp_readeropen) {
+			if (!written) {
+				result = EPIPE;
+			}
+			break;
+		}
+
+		tail = (pp->pp_start + pp->pp_count) % PIPE_BUFSIZE;
+		chunk = PIPE_BUFSIZE - pp->pp_count;
+		if (chunk > PIPE_BUFSIZE - tail) {
+			chunk = PIPE_BUFSIZE - tail;
+		}
+		if (chunk > uio->uio_resid) {
+			chunk = uio->uio_resid;
+		}
+		result = uiomove(pp->pp_buf + tail, chunk, uio);
+		if (result) {
+			break;
+		}
+		pp->pp_count += chunk;
+		written = true;
+		cv_broadcast(pp->pp_readcv, pp->pp_lock);
+	}
+	lock_release(pp->pp_lock);
+	return result;
+}
+
+static
+int
+pipe_ioctl(struct vnode *vn, int op, userptr_t data)
+{
+	(void)vn;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+static
+int
+pipe_gettype(struct vnode *vn, mode_t *ret)
+{
+	(void)vn;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+int
+pipe_getsize(struct vnode *vn, off_t *ret)
+{
+	struct pipe *pp = vn->vn_data;
+
+	lock_acquire(pp->pp_lock);
+	*ret = pp->pp_count;
+	lock_release(pp->pp_lock);
+	return 0;
+}
+
+static
+int
+pipe_stat(struct vnode *vn, struct stat *statbuf)
+{
+	struct pipe *pp = vn->vn_data;
+	int result;
+
+	bzero(statbuf, sizeof(struct stat));
+
+	result = VOP_GETTYPE(vn, &statbuf->st_mode);
+	if (result) {
+		return result;
+	}
+
+	lock_acquire(pp->pp_lock);
+	statbuf->st_size = pp->pp_count;
+	lock_release(pp->pp_lock);
+	statbuf->st_nlink = 1;
+	statbuf->st_blksize = PIPE_BUFSIZE;
+
+	return 0;
+}
+
+static
+bool
+pipe_isseekable(struct vnode *vn)
+{
+	(void)vn;
+	return false;
+}
+
+static
+int
+pipe_fsync(struct vnode *vn)
+{
+	(void)vn;
+	return 0;
+}
+
+static
+int
+pipe_truncate(struct vnode *vn, off_t len)
+{
+	(void)vn;
+	(void)len;
+	return EINVAL;
+}
+
+static const struct vnode_ops pipe_vnode_ops = {
+	.vop_magic = VOP_MAGIC,	/* mark this a valid vnode ops table */
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_getdirents = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_getsize = pipe_getsize,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_nosys,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+int
+pipe_create(struct vnode **ret_read, struct vnode **ret_write)
+{
+	struct pipe *pp;
+
+	pp = kmalloc(sizeof(*pp));
+	if (pp == NULL) {
+		return ENOMEM;
+	}
+	pp->pp_buf = kmalloc(PIPE_BUFSIZE);
+	if (pp->pp_buf == NULL) {
+		kfree(pp);
+		return ENOMEM;
+	}
+	pp->pp_lock = lock_create("pipe");
+	if (pp->pp_lock == NULL) {
+		kfree(pp->pp_buf);
+		kfree(pp);
+		return ENOMEM;
+	}
+	pp->pp_readcv = cv_create("pipe-read");
+	if (pp->pp_readcv == NULL) {
+		lock_destroy(pp->pp_lock);
+		kfree(pp->pp_buf);
+		kfree(pp);
+		return ENOMEM;
+	}
+	pp->pp_writecv = cv_create("pipe-write");
+	if (pp->pp_writecv == NULL) {
+		cv_destroy(pp->pp_readcv);
+		lock_destroy(pp->pp_lock);
+		kfree(pp->pp_buf);
+		kfree(pp);
+		return ENOMEM;
+	}
+
+	pp->pp_start = 0;
+	pp->pp_count = 0;
+	pp->pp_readeropen = true;
+	pp->pp_writeropen = true;
+
+	/* pipes do not belong to any filesystem, like devices */
+	vnode_init(&pp->pp_readvn, &pipe_vnode_ops, NULL, pp);
+	vnode_init(&pp->pp_writevn, &pipe_vnode_ops, NULL, pp);
+
+	*ret_read = &pp->pp_readvn;
+	*ret_write = &pp->pp_writevn;
+	return 0;
+}
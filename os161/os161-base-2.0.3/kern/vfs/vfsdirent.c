@@ -0,0 +1,94 @@
+/*
+ * Support code for vop_getdirents.
+ *
+ * The uio offset of a getdirents call is a filesystem cookie naming
+ * the next entry, exactly as for vop_getdirentry; uiomove advances it
+ * as a byte count, so callers must store the real cookie back into
+ * uio_offset once they are done copying records out.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/dirent.h>
+#include <limits.h>
+#include <lib.h>
+#include <uio.h>
+#include <vnode.h>
+
+/*
+ * Append one record to UIO. Returns ENOSPC, copying nothing, if the
+ * record does not fit in what is left of the buffer.
+ */
+int
+vnode_emitdirent(struct uio *uio, ino_t ino, mode_t type,
+		 nlink_t nlink, off_t size, const char *name)
+{
+	char rec[_DIRENT_RECLEN(NAME_MAX)];
+	struct dirent *d = (struct dirent *)rec;
+	size_t namelen, reclen;
+
+	namelen = strlen(name);
+	KASSERT(namelen <= NAME_MAX);
+	reclen = _DIRENT_RECLEN(namelen);
+	if (reclen > uio->uio_resid) {
+		return ENOSPC;
+	}
+
+	bzero(rec, reclen);
+	d->d_size = size;
+	d->d_ino = ino;
+	d->d_type = type;
+	d->d_nlink = nlink;
+	d->d_reclen = reclen;
+	memcpy(d->d_name, name, namelen);
+
+	return uiomove(rec, reclen, uio);
+}
+
+/*
+ * vop_getdirents for filesystems that only know how to hand out one
+ * name at a time. Only the name is known, so everything else in the
+ * records is reported as unknown.
+ */
+int
+vnode_getdirents_generic(struct vnode *dir, struct uio *uio)
+{
+	char name[NAME_MAX+1];
+	struct iovec iov;
+	struct uio ku;
+	off_t pos, nextpos;
+	bool any = false;
+	int result;
+
+	pos = uio->uio_offset;
+	while (1) {
+		uio_kinit(&iov, &ku, name, sizeof(name)-1, pos, UIO_READ);
+		result = VOP_GETDIRENTRY(dir, &ku);
+		if (result) {
+			break;
+		}
+		if (ku.uio_resid == sizeof(name)-1) {
+			/* end of directory */
+			break;
+		}
+		name[sizeof(name)-1 - ku.uio_resid] = 0;
+		nextpos = ku.uio_offset;
+
+		result = vnode_emitdirent(uio, 0, 0, 0, -1, name);
+		if (result) {
+			break;
+		}
+		any = true;
+		pos = nextpos;
+	}
+
+	uio->uio_offset = pos;
+	if (result == ENOSPC) {
+		/* a full buffer is the normal way to stop */
+		return any ? 0 : EINVAL;
+	}
+	if (result && any) {
+		/* hand back what we have; the error will recur next time */
+		return 0;
+	}
+	return result;
+}
@@ -83,23 +83,35 @@ vopfail_uio_nosys(struct vnode *vn, struct uio *uio)
 // mmap
 
 int
-vopfail_mmap_isdir(struct vnode *vn /*add stuff */)
+vopfail_mmap_isdir(struct vnode *vn, int prot, int flags,
+		struct shm_object **ret)
 {
 	(void)vn;
+	(void)prot;
+	(void)flags;
+	(void)ret;
 	return EISDIR;
 }
 
 int
-vopfail_mmap_perm(struct vnode *vn /*add stuff */)
+vopfail_mmap_perm(struct vnode *vn, int prot, int flags,
+		struct shm_object **ret)
 {
 	(void)vn;
+	(void)prot;
+	(void)flags;
+	(void)ret;
 	return EPERM;
 }
 
 int
-vopfail_mmap_nosys(struct vnode *vn /*add stuff */)
+vopfail_mmap_nosys(struct vnode *vn, int prot, int flags,
+		struct shm_object **ret)
 {
 	(void)vn;
+	(void)prot;
+	(void)flags;
+	(void)ret;
 	return ENOSYS;
 }
 
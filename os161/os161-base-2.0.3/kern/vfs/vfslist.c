@@ -43,6 +43,10 @@
 #include <fs.h>
 #include <vnode.h>
 #include <device.h>
+#include "opt-shell.h"
+#if OPT_SHELL
+#include <elfcache.h>
+#endif
 
 /*
  * Structure for a single named device.
@@ -114,6 +118,9 @@ vfs_bootstrap(void)
 
 	devnull_create();
 	semfs_bootstrap();
+#if OPT_SHELL
+	shmfs_bootstrap();
+#endif
 }
 
 /*
@@ -640,6 +647,11 @@ vfs_unmount(const char *devname)
 	struct knowndev *kd;
 	int result;
 
+#if OPT_SHELL
+	/* the exec cache holds on to vnodes of programs run recently */
+	elfcache_flush();
+#endif
+
 	vfs_biglock_acquire();
 
 	result = findmount(devname, &kd);
@@ -724,6 +736,10 @@ vfs_unmountall(void)
 	unsigned i, num;
 	int result;
 
+#if OPT_SHELL
+	elfcache_flush();
+#endif
+
 	vfs_biglock_acquire();
 
 	num = knowndevarray_num(knowndevs);
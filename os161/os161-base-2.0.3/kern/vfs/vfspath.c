@@ -38,6 +38,11 @@
 #include <lib.h>
 #include <vfs.h>
 #include <vnode.h>
+#include "opt-shell.h"
+#if OPT_SHELL
+#include <vmtext.h>
+#include <elfcache.h>
+#endif
 
 
 /* Does most of the work for open(). */
@@ -93,12 +98,21 @@ vfs_open(char *path, int openflags, mode_t mode, struct vnode **ret)
 		return result;
 	}
 
+#if OPT_SHELL
+	/* running programs are read straight from the shared text */
+	if (canwrite && text_busy(vn)) {
+		VOP_DECREF(vn);
+		return ETXTBSY;
+	}
+#endif
+
 	if (openflags & O_TRUNC) {
 		if (canwrite==0) {
 			result = EINVAL;
 		}
 		else {
 			result = VOP_TRUNCATE(vn, 0);
+			vnode_modified(vn);
 		}
 		if (result) {
 			VOP_DECREF(vn);
@@ -139,14 +153,31 @@ vfs_remove(char *path)
 	struct vnode *dir;
 	char name[NAME_MAX+1];
 	int result;
+#if OPT_SHELL
+	struct vnode *vn;
+#endif
 
 	result = vfs_lookparent(path, &dir, name, sizeof(name));
 	if (result) {
 		return result;
 	}
 
+#if OPT_SHELL
+	/* the exec cache must not keep a removed program alive */
+	if (VOP_LOOKUP(dir, name, &vn) != 0) {
+		vn = NULL;
+	}
+#endif
 	result = VOP_REMOVE(dir, name);
 	VOP_DECREF(dir);
+#if OPT_SHELL
+	if (vn != NULL) {
+		if (result == 0) {
+			elfcache_forget(vn);
+		}
+		VOP_DECREF(vn);
+	}
+#endif
 
 	return result;
 }
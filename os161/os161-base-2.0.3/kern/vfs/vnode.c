@@ -34,6 +34,7 @@
 #include <kern/errno.h>
 #include <lib.h>
 #include <synch.h>
+#include <stat.h>
 #include <vfs.h>
 #include <vnode.h>
 
@@ -49,6 +50,7 @@ vnode_init(struct vnode *vn, const struct vnode_ops *ops,
 
 	vn->vn_ops = ops;
 	vn->vn_refcount = 1;
+	vn->vn_gen = 0;
 	spinlock_init(&vn->vn_countlock);
 	vn->vn_fs = fs;
 	vn->vn_data = fsdata;
@@ -122,6 +124,28 @@ vnode_decref(struct vnode *vn)
 	}
 }
 
+/*
+ * Contents generation number.
+ */
+void
+vnode_modified(struct vnode *vn)
+{
+	spinlock_acquire(&vn->vn_countlock);
+	vn->vn_gen++;
+	spinlock_release(&vn->vn_countlock);
+}
+
+unsigned
+vnode_gen(struct vnode *vn)
+{
+	unsigned gen;
+
+	spinlock_acquire(&vn->vn_countlock);
+	gen = vn->vn_gen;
+	spinlock_release(&vn->vn_countlock);
+	return gen;
+}
+
 /*
  * Check for various things being valid.
  * Called before all VOP_* calls.
@@ -176,3 +200,20 @@ vnode_check(struct vnode *v, const char *opstr)
 	spinlock_release(&v->vn_countlock);
 	/*vfs_biglock_release();*/
 }
+
+/*
+ * vop_getsize for filesystems that can only find out through stat.
+ */
+int
+vnode_getsize_bystat(struct vnode *v, off_t *result)
+{
+	struct stat st;
+	int err;
+
+	err = VOP_STAT(v, &st);
+	if (err) {
+		return err;
+	}
+	*result = st.st_size;
+	return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * Shared memory objects. See shm.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <vm.h>
+#include <shm.h>
+
+struct shm_object {
+	struct lock *shm_lock;		/* protects all of the below */
+	unsigned shm_refcount;		/* mappings + name */
+	size_t shm_npages;		/* size in pages */
+	paddr_t *shm_frames;		/* frame of each page, or 0 */
+};
+
+static
+void
+shm_freepages(struct shm_object *shm, size_t from)
+{
+	size_t i;
+
+	for (i=from; i<shm->shm_npages; i++) {
+		if (shm->shm_frames[i] != 0) {
+			free_kpages(PADDR_TO_KVADDR(shm->shm_frames[i]));
+			shm->shm_frames[i] = 0;
+		}
+	}
+}
+
+struct shm_object *
+shm_create(size_t npages)
+{
+	struct shm_object *shm;
+	size_t i;
+
+	shm = kmalloc(sizeof(*shm));
+	if (shm == NULL) {
+		return NULL;
+	}
+	shm->shm_frames = NULL;
+	if (npages > 0) {
+		shm->shm_frames = kmalloc(npages * sizeof(paddr_t));
+		if (shm->shm_frames == NULL) {
+			kfree(shm);
+			return NULL;
+		}
+	}
+	shm->shm_lock = lock_create("shm");
+	if (shm->shm_lock == NULL) {
+		kfree(shm->shm_frames);
+		kfree(shm);
+		return NULL;
+	}
+	for (i=0; i<npages; i++) {
+		shm->shm_frames[i] = 0;
+	}
+	shm->shm_npages = npages;
+	shm->shm_refcount = 1;
+	return shm;
+}
+
+void
+shm_incref(struct shm_object *shm)
+{
+	lock_acquire(shm->shm_lock);
+	shm->shm_refcount++;
+	lock_release(shm->shm_lock);
+}
+
+void
+shm_decref(struct shm_object *shm)
+{
+	lock_acquire(shm->shm_lock);
+	KASSERT(shm->shm_refcount > 0);
+	if (--shm->shm_refcount > 0) {
+		lock_release(shm->shm_lock);
+		return;
+	}
+	lock_release(shm->shm_lock);
+
+	/* last reference: nobody else can find it */
+	shm_freepages(shm, 0);
+	lock_destroy(shm->shm_lock);
+	kfree(shm->shm_frames);
+	kfree(shm);
+}
+
+size_t
+shm_npages(struct shm_object *shm)
+{
+	size_t npages;
+
+	lock_acquire(shm->shm_lock);
+	npages = shm->shm_npages;
+	lock_release(shm->shm_lock);
+	return npages;
+}
+
+int
+shm_resize(struct shm_object *shm, size_t npages)
+{
+	paddr_t *frames;
+	size_t i;
+
+	lock_acquire(shm->shm_lock);
+	if (shm->shm_refcount > 1) {
+		/* mapped somewhere: the mappings have a fixed size */
+		lock_release(shm->shm_lock);
+		return EBUSY;
+	}
+	if (npages <= shm->shm_npages) {
+		shm_freepages(shm, npages);
+		shm->shm_npages = npages;
+		lock_release(shm->shm_lock);
+		return 0;
+	}
+
+	frames = kmalloc(npages * sizeof(paddr_t));
+	if (frames == NULL) {
+		lock_release(shm->shm_lock);
+		return ENOMEM;
+	}
+	for (i=0; i<npages; i++) {
+		frames[i] = i < shm->shm_npages ? shm->shm_frames[i] : 0;
+	}
+	kfree(shm->shm_frames);
+	shm->shm_frames = frames;
+	shm->shm_npages = npages;
+	lock_release(shm->shm_lock);
+	return 0;
+}
+
+int
+shm_getpage(struct shm_object *shm, unsigned idx, paddr_t *ret)
+{
+	vaddr_t kva;
+
+	lock_acquire(shm->shm_lock);
+	if (idx >= shm->shm_npages) {
+		lock_release(shm->shm_lock);
+		return EFAULT;
+	}
+	if (shm->shm_frames[idx] == 0) {
+		kva = alloc_kpages(1);
+		if (kva == 0) {
+			lock_release(shm->shm_lock);
+			return ENOMEM;
+		}
+		bzero((void *)kva, PAGE_SIZE);
+		shm->shm_frames[idx] = kva - MIPS_KSEG0;
+	}
+	*ret = shm->shm_frames[idx];
+	lock_release(shm->shm_lock);
+	return 0;
+}
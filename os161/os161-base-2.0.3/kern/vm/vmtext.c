@@ -0,0 +1,330 @@
+/*
+ * Shared program text. See vmtext.h.
+ *
+ * Text objects are kept in a list, which only holds as many entries
+ * as there are distinct programs running. The first exec of a program
+ * inserts its object marked as loading and reads it in without
+ * holding text_lock; concurrent execs of the same program find it and
+ * wait on text_cv until the load is over.
+ *
+ * Files open for writing are counted in a second list, also under
+ * text_lock, so that the check against sharing their text and the
+ * check against opening a running program for writing cannot race.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <uio.h>
+#include <vnode.h>
+#include <vm.h>
+#include <vmtext.h>
+
+struct text_object {
+	struct vnode *tx_vn;		/* the program (one reference) */
+	off_t tx_offset;		/* where the segment is in the file */
+	vaddr_t tx_vaddr;		/* and where it goes in memory */
+	size_t tx_filesize;
+	size_t tx_npages;
+	paddr_t tx_pbase;		/* frames, once loaded */
+	unsigned tx_refcount;		/* address spaces using it */
+	bool tx_loading;		/* being read in */
+	int tx_error;			/* outcome of the load */
+	struct text_object *tx_next;
+};
+
+struct text_writer {
+	struct vnode *tw_vn;		/* no reference: the openfile has one */
+	unsigned tw_count;		/* open files writing it */
+	struct text_writer *tw_next;
+};
+
+static struct lock *text_lock;		/* protects the lists and objects */
+static struct cv *text_cv;		/* signalled when a load ends */
+static struct text_object *texts;
+static struct text_writer *writers;
+
+void
+text_bootstrap(void)
+{
+	text_lock = lock_create("text");
+	text_cv = cv_create("text");
+	if (text_lock == NULL || text_cv == NULL) {
+		panic("text_bootstrap: out of memory\n");
+	}
+}
+
+static
+struct text_object *
+text_find(struct vnode *vn, off_t offset, vaddr_t vaddr, size_t filesize,
+	  size_t npages)
+{
+	struct text_object *tx;
+
+	KASSERT(lock_do_i_hold(text_lock));
+	for (tx = texts; tx != NULL; tx = tx->tx_next) {
+		if (tx->tx_vn == vn && tx->tx_offset == offset &&
+		    tx->tx_vaddr == vaddr && tx->tx_filesize == filesize &&
+		    tx->tx_npages == npages && tx->tx_error == 0) {
+			return tx;
+		}
+	}
+	return NULL;
+}
+
+static
+struct text_writer **
+text_writer_find(struct vnode *vn)
+{
+	struct text_writer **ptw;
+
+	KASSERT(lock_do_i_hold(text_lock));
+	for (ptw = &writers; *ptw != NULL; ptw = &(*ptw)->tw_next) {
+		if ((*ptw)->tw_vn == vn) {
+			break;
+		}
+	}
+	return ptw;
+}
+
+static
+bool
+text_running(struct vnode *vn)
+{
+	struct text_object *tx;
+
+	KASSERT(lock_do_i_hold(text_lock));
+	for (tx = texts; tx != NULL; tx = tx->tx_next) {
+		if (tx->tx_vn == vn && tx->tx_error == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static
+void
+text_unlink(struct text_object *tx)
+{
+	struct text_object **ptx;
+
+	KASSERT(lock_do_i_hold(text_lock));
+	for (ptx = &texts; *ptx != tx; ptx = &(*ptx)->tx_next) {
+		KASSERT(*ptx != NULL);
+	}
+	*ptx = tx->tx_next;
+}
+
+/*
+ * Allocate the frames and read the segment into them. The frames are
+ * written through their kernel addresses, as the text is mapped
+ * read-only in user space.
+ */
+static
+int
+text_load(struct text_object *tx)
+{
+	struct iovec iov;
+	struct uio ku;
+	vaddr_t kva;
+	int result;
+
+	kva = alloc_kpages(tx->tx_npages);
+	if (kva == 0) {
+		return ENOMEM;
+	}
+	bzero((void *)kva, tx->tx_npages * PAGE_SIZE);
+
+	uio_kinit(&iov, &ku, (void *)(kva + (tx->tx_vaddr & ~PAGE_FRAME)),
+		  tx->tx_filesize, tx->tx_offset, UIO_READ);
+	result = VOP_READ(tx->tx_vn, &ku);
+	if (result == 0 && ku.uio_resid != 0) {
+		kprintf("ELF: short read on segment - file truncated?\n");
+		result = ENOEXEC;
+	}
+	if (result) {
+		free_kpages(kva);
+		return result;
+	}
+
+	tx->tx_pbase = kva - MIPS_KSEG0;
+	return 0;
+}
+
+static
+void
+text_free(struct text_object *tx)
+{
+	if (tx->tx_pbase != 0) {
+		free_kpages(PADDR_TO_KVADDR(tx->tx_pbase));
+	}
+	VOP_DECREF(tx->tx_vn);
+	kfree(tx);
+}
+
+int
+text_get(struct vnode *vn, off_t offset, vaddr_t vaddr, size_t filesize,
+	 size_t npages, struct text_object **ret)
+{
+	struct text_object *tx;
+	bool last;
+	int result;
+
+	KASSERT(npages > 0);
+	KASSERT((vaddr & ~PAGE_FRAME) + filesize <= npages * PAGE_SIZE);
+
+	lock_acquire(text_lock);
+	if (*text_writer_find(vn) != NULL) {
+		lock_release(text_lock);
+		return ETXTBSY;
+	}
+	tx = text_find(vn, offset, vaddr, filesize, npages);
+	if (tx != NULL) {
+		tx->tx_refcount++;
+		while (tx->tx_loading) {
+			cv_wait(text_cv, text_lock);
+		}
+		result = tx->tx_error;
+		if (result) {
+			/* the loader has already unlinked it */
+			last = --tx->tx_refcount == 0;
+			lock_release(text_lock);
+			if (last) {
+				text_free(tx);
+			}
+			return result;
+		}
+		lock_release(text_lock);
+		*ret = tx;
+		return 0;
+	}
+
+	tx = kmalloc(sizeof(*tx));
+	if (tx == NULL) {
+		lock_release(text_lock);
+		return ENOMEM;
+	}
+	VOP_INCREF(vn);
+	tx->tx_vn = vn;
+	tx->tx_offset = offset;
+	tx->tx_vaddr = vaddr;
+	tx->tx_filesize = filesize;
+	tx->tx_npages = npages;
+	tx->tx_pbase = 0;
+	tx->tx_refcount = 1;
+	tx->tx_loading = true;
+	tx->tx_error = 0;
+	tx->tx_next = texts;
+	texts = tx;
+	lock_release(text_lock);
+
+	result = text_load(tx);
+
+	lock_acquire(text_lock);
+	tx->tx_loading = false;
+	tx->tx_error = result;
+	cv_broadcast(text_cv, text_lock);
+	if (result) {
+		/* waiters drop their references; the last one frees it */
+		text_unlink(tx);
+		last = --tx->tx_refcount == 0;
+		lock_release(text_lock);
+		if (last) {
+			text_free(tx);
+		}
+		return result;
+	}
+	lock_release(text_lock);
+
+	*ret = tx;
+	return 0;
+}
+
+void
+text_incref(struct text_object *tx)
+{
+	lock_acquire(text_lock);
+	KASSERT(tx->tx_refcount > 0);
+	tx->tx_refcount++;
+	lock_release(text_lock);
+}
+
+void
+text_decref(struct text_object *tx)
+{
+	lock_acquire(text_lock);
+	KASSERT(tx->tx_refcount > 0);
+	if (--tx->tx_refcount > 0) {
+		lock_release(text_lock);
+		return;
+	}
+	text_unlink(tx);
+	lock_release(text_lock);
+
+	/* last reference: nobody else can find it */
+	text_free(tx);
+}
+
+paddr_t
+text_pbase(struct text_object *tx)
+{
+	KASSERT(!tx->tx_loading && tx->tx_pbase != 0);
+	return tx->tx_pbase;
+}
+
+bool
+text_busy(struct vnode *vn)
+{
+	bool busy;
+
+	lock_acquire(text_lock);
+	busy = text_running(vn);
+	lock_release(text_lock);
+	return busy;
+}
+
+int
+text_write_begin(struct vnode *vn)
+{
+	struct text_writer **ptw, *tw;
+
+	lock_acquire(text_lock);
+	if (text_running(vn)) {
+		lock_release(text_lock);
+		return ETXTBSY;
+	}
+	ptw = text_writer_find(vn);
+	if (*ptw == NULL) {
+		tw = kmalloc(sizeof(*tw));
+		if (tw == NULL) {
+			lock_release(text_lock);
+			return ENOMEM;
+		}
+		tw->tw_vn = vn;
+		tw->tw_count = 0;
+		tw->tw_next = NULL;
+		*ptw = tw;
+	}
+	(*ptw)->tw_count++;
+	lock_release(text_lock);
+	return 0;
+}
+
+void
+text_write_end(struct vnode *vn)
+{
+	struct text_writer **ptw, *tw;
+
+	lock_acquire(text_lock);
+	ptw = text_writer_find(vn);
+	tw = *ptw;
+	KASSERT(tw != NULL && tw->tw_count > 0);
+	if (--tw->tw_count > 0) {
+		lock_release(text_lock);
+		return;
+	}
+	*ptw = tw->tw_next;
+	lock_release(text_lock);
+	kfree(tw);
+}
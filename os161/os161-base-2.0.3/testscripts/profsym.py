@@ -0,0 +1,126 @@
+#!/usr/pkg/bin/python2.7
+# profsym.py - symbolize a kernel profile
+# usage: profsym.py [options] kernel [logfile]
+# options:
+#    --nm=PROGRAM	nm to read the kernel symbols with
+#			(default mips-harvard-os161-nm)
+#    --folded		Print folded stacks ("caller;function count"),
+#			the input format of flamegraph.pl and friends,
+#			instead of a flat profile
+#
+# Reads the output of the "prof dump" kernel menu command from logfile
+# (or standard input), e.g. a System/161 console log or the output
+# file of test.py, and resolves the addresses in it against the
+# kernel ELF file. If the log has several dumps, the last one is used.
+#
+# Each sample has the interrupted PC and the RA register. RA is the
+# caller only if the function had not yet made a call of its own; if
+# it points back into the same function it is ignored, so the stacks
+# are one or two frames deep. Samples taken in user mode show up as
+# [user].
+#
+
+from __future__ import print_function
+
+import sys
+import bisect
+import subprocess
+from optparse import OptionParser
+
+############################################################
+# symbols
+
+def readsyms(nm, kernel):
+	out = subprocess.check_output([nm, "-n", kernel])
+	if not isinstance(out, str):
+		out = out.decode("ascii", "replace")
+	addrs = []
+	names = []
+	for line in out.splitlines():
+		fields = line.split()
+		if len(fields) != 3 or fields[1] not in "tT":
+			continue
+		addrs.append(int(fields[0], 16))
+		names.append(fields[2])
+	return (addrs, names)
+
+def lookup(syms, addr):
+	(addrs, names) = syms
+	i = bisect.bisect_right(addrs, addr) - 1
+	if i < 0:
+		return "0x%08x" % addr
+	return names[i]
+
+############################################################
+# samples
+
+def readdump(f):
+	samples = None
+	for line in f:
+		fields = line.split()
+		if len(fields) < 2 or fields[0] != "prof:":
+			continue
+		if fields[1] == "begin":
+			samples = []
+		elif fields[1] == "end" or samples is None:
+			continue
+		elif len(fields) == 4:
+			samples.append((int(fields[1]), int(fields[2], 16),
+					int(fields[3], 16)))
+	if samples is None:
+		sys.stderr.write("profsym: no prof dump found\n")
+		sys.exit(1)
+	return samples
+
+def stackof(syms, pc, ra):
+	if pc == 0:
+		return ("[user]",)
+	fn = lookup(syms, pc)
+	caller = lookup(syms, ra)
+	if ra == 0 or caller == fn:
+		return (fn,)
+	return (caller, fn)
+
+############################################################
+# main
+
+def main():
+	p = OptionParser(usage="%prog [options] kernel [logfile]")
+	p.add_option("--nm", dest="nm", default="mips-harvard-os161-nm")
+	p.add_option("--folded", action="store_true", dest="folded",
+		     default=False)
+	(options, args) = p.parse_args()
+	if len(args) < 1 or len(args) > 2:
+		p.print_usage(sys.stderr)
+		sys.exit(1)
+
+	syms = readsyms(options.nm, args[0])
+	if len(args) == 2:
+		f = open(args[1])
+		samples = readdump(f)
+		f.close()
+	else:
+		samples = readdump(sys.stdin)
+
+	stacks = {}
+	total = 0
+	for (count, pc, ra) in samples:
+		s = stackof(syms, pc, ra)
+		stacks[s] = stacks.get(s, 0) + count
+		total += count
+
+	if options.folded:
+		for s in sorted(stacks):
+			print("%s %d" % (";".join(s), stacks[s]))
+		return
+
+	# flat profile: samples in each function itself
+	flat = {}
+	for s in stacks:
+		flat[s[-1]] = flat.get(s[-1], 0) + stacks[s]
+	print("%8s %7s  %s" % ("samples", "%", "function"))
+	for fn in sorted(flat, key=lambda fn: -flat[fn]):
+		print("%8d %6.2f%%  %s" % (flat[fn], 100.0 * flat[fn] / total,
+					  fn))
+
+main()
@@ -107,6 +107,20 @@ isdir(const char *path)
 	return S_ISDIR(buf.st_mode);
 }
 
+/*
+ * Same, for an entry returned by getdents. Only falls back to
+ * opening the file if the filesystem did not report its type.
+ */
+static
+int
+entisdir(const char *path, const struct dirent *d)
+{
+	if (d->d_type != 0) {
+		return S_ISDIR(d->d_type);
+	}
+	return isdir(path);
+}
+
 /*
  * When listing one of several subdirectories, show the name of the
  * directory.
@@ -127,18 +141,25 @@ printheader(const char *file)
 }
 
 /*
- * Show a single file.
+ * Show a single file. D is its directory entry, if we got here by
+ * listing a directory, and NULL otherwise.
  * We don't do the neat multicolumn listing that Unix ls does.
  */
 static
 void
-print(const char *path)
+print(const char *path, const struct dirent *d)
 {
 	struct stat statbuf;
 	const char *file;
 	int typech;
 
-	if (lopt || sopt) {
+	if (d != NULL && d->d_type != 0 && !sopt) {
+		/* getdents already gave us everything -l shows */
+		statbuf.st_mode = d->d_type;
+		statbuf.st_nlink = d->d_nlink;
+		statbuf.st_size = d->d_size;
+	}
+	else if (lopt || sopt) {
 		int fd;
 
 		fd = open(path, O_RDONLY);
@@ -193,9 +214,10 @@ void
 listdir(const char *path, int showheader)
 {
 	int fd;
-	char buf[1024];
+	off_t buf[1024/sizeof(off_t)];	/* aligned for struct dirent */
 	char newpath[1024];
-	ssize_t len;
+	const struct dirent *d;
+	ssize_t len, pos;
 
 	if (showheader) {
 		printheader(path);
@@ -212,19 +234,25 @@ listdir(const char *path, int showheader)
 	/*
 	 * List the directory.
 	 */
-	while ((len = getdirentry(fd, buf, sizeof(buf)-1)) > 0) {
-		buf[len] = 0;
+	while ((len = getdents(fd, buf, sizeof(buf))) > 0) {
+		for (pos = 0; pos < len; pos += d->d_reclen) {
+			d = (const struct dirent *)((char *)buf + pos);
+			if (d->d_reclen == 0) {
+				errx(1, "%s: getdents: bad record", path);
+			}
 
-		/* Assemble the full name of the new item */
-		snprintf(newpath, sizeof(newpath), "%s/%s", path, buf);
+			/* Assemble the full name of the new item */
+			snprintf(newpath, sizeof(newpath), "%s/%s",
+				 path, d->d_name);
 
-		if (aopt || buf[0]!='.') {
-			/* Print it */
-			print(newpath);
+			if (aopt || d->d_name[0]!='.') {
+				/* Print it */
+				print(newpath, d);
+			}
 		}
 	}
 	if (len<0) {
-		err(1, "%s: getdirentry", path);
+		err(1, "%s: getdents", path);
 	}
 
 	/* Done */
@@ -236,9 +264,10 @@ void
 recursedir(const char *path)
 {
 	int fd;
-	char buf[1024];
+	off_t buf[1024/sizeof(off_t)];	/* aligned for struct dirent */
 	char newpath[1024];
-	int len;
+	const struct dirent *d;
+	ssize_t len, pos;
 
 	/*
 	 * Open it.
@@ -251,29 +280,36 @@ recursedir(const char *path)
 	/*
 	 * List the directory.
 	 */
-	while ((len = getdirentry(fd, buf, sizeof(buf)-1)) > 0) {
-		buf[len] = 0;
+	while ((len = getdents(fd, buf, sizeof(buf))) > 0) {
+		for (pos = 0; pos < len; pos += d->d_reclen) {
+			d = (const struct dirent *)((char *)buf + pos);
+			if (d->d_reclen == 0) {
+				errx(1, "%s: getdents: bad record", path);
+			}
 
-		/* Assemble the full name of the new item */
-		snprintf(newpath, sizeof(newpath), "%s/%s", path, buf);
+			if (!aopt && d->d_name[0]=='.') {
+				/* skip this one */
+				continue;
+			}
 
-		if (!aopt && buf[0]=='.') {
-			/* skip this one */
-			continue;
-		}
+			if (!strcmp(d->d_name, ".") ||
+			    !strcmp(d->d_name, "..")) {
+				/* always skip these */
+				continue;
+			}
 
-		if (!strcmp(buf, ".") || !strcmp(buf, "..")) {
-			/* always skip these */
-			continue;
-		}
+			/* Assemble the full name of the new item */
+			snprintf(newpath, sizeof(newpath), "%s/%s",
+				 path, d->d_name);
 
-		if (!isdir(newpath)) {
-			continue;
-		}
+			if (!entisdir(newpath, d)) {
+				continue;
+			}
 
-		listdir(newpath, 1 /*showheader*/);
-		if (Ropt) {
-			recursedir(newpath);
+			listdir(newpath, 1 /*showheader*/);
+			if (Ropt) {
+				recursedir(newpath);
+			}
 		}
 	}
 	if (len<0) {
@@ -294,7 +330,7 @@ listitem(const char *path, int showheader)
 		}
 	}
 	else {
-		print(path);
+		print(path, NULL);
 	}
 }
 
@@ -37,7 +37,6 @@
 
 #include <sys/types.h>
 #include <sys/wait.h>
-#include <assert.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -69,47 +68,8 @@ struct exitinfo {
 /* set to nonzero if __time syscall seems to work */
 static int timing = 0;
 
-/* array of backgrounded jobs (allows "foregrounding") */
-#define MAXBG 128
-static pid_t bgpids[MAXBG];
-
-/*
- * can_bg
- * just checks for an open slot.
- */
-static
-int
-can_bg(void)
-{
-	int i;
-
-	for (i = 0; i < MAXBG; i++) {
-		if (bgpids[i] == 0) {
-			return 1;
-		}
-	}
-
-	return 0;
-}
-
-/*
- * remember_bg
- * sticks the pid in an open slot in the background array.  note the assert --
- * better check can_bg before calling this.
- */
-static
-void
-remember_bg(pid_t pid)
-{
-	int i;
-	for (i = 0; i < MAXBG; i++) {
-		if (bgpids[i] == 0) {
-			bgpids[i] = pid;
-			return;
-		}
-	}
-	assert(0);
-}
+/* max number of commands connected by "|" in a single pipeline */
+#define MAXSTAGES 16
 
 /*
  * constructor for exitinfo
@@ -209,50 +169,42 @@ dowait(pid_t pid)
 	}
 }
 
-#ifdef WNOHANG
 /*
- * dowaitpoll
- * like dowait, but uses WNOHANG. returns true if we got something.
+ * reapany
+ * wait for whichever child exits next and report it. with WNOHANG in
+ * OPTIONS, just check. returns true if we got something.
  */
 static
 int
-dowaitpoll(pid_t pid)
+reapany(int options)
 {
 	struct exitinfo ei;
 	pid_t foundpid;
 	int status;
 
-	foundpid = waitpid(pid, &status, WNOHANG);
-	if (foundpid < 0) {
-		warn("pid %d", pid);
+	foundpid = waitpid(-1, &status, options);
+	if (foundpid <= 0) {
+		/* nothing exited yet, or no children left (ECHILD) */
+		return 0;
 	}
-	else if (foundpid != 0) {
-		printf("pid %d: ", pid);
-		readstatus(status, &ei);
-		printstatus(&ei, 1);
-		return 1;
-	}
-	return 0;
+	printf("pid %d: ", foundpid);
+	readstatus(status, &ei);
+	printstatus(&ei, 1);
+	return 1;
 }
 
 /*
  * waitpoll
- * poll all background jobs for having exited.
+ * report all background jobs that have exited.
  */
 static
 void
 waitpoll(void)
 {
-	int i;
-	for (i=0; i < MAXBG; i++) {
-		if (bgpids[i] != 0) {
-			if (dowaitpoll(bgpids[i])) {
-				bgpids[i] = 0;
-			}
-		}
+	while (reapany(WNOHANG)) {
+		/* nothing */
 	}
 }
-#endif /* WNOHANG */
 
 /*
  * wait
@@ -264,26 +216,17 @@ static
 void
 cmd_wait(int ac, char *av[], struct exitinfo *ei)
 {
-	int i;
 	pid_t pid;
 
 	if (ac == 2) {
 		pid = atoi(av[1]);
 		dowait(pid);
-		for (i = 0; i < MAXBG; i++) {
-			if (bgpids[i]==pid) {
-				bgpids[i] = 0;
-			}
-		}
 		exitinfo_exit(ei, 0);
 		return;
 	}
 	else if (ac == 1) {
-		for (i=0; i < MAXBG; i++) {
-			if (bgpids[i] != 0) {
-				dowait(bgpids[i]);
-				bgpids[i] = 0;
-			}
+		while (reapany(0)) {
+			/* until there are no children left */
 		}
 		exitinfo_exit(ei, 0);
 		return;
@@ -359,19 +302,25 @@ static struct {
  * docommand
  * tokenizes the command line using strtok.  if there aren't any commands,
  * simply returns.  checks to see if it's a builtin, running it if it is.
- * otherwise, it's a standard command.  check for the '&', try to background
- * the job if possible, otherwise just run it and wait on it.
+ * otherwise, it's a standard command (or a pipeline of commands separated
+ * by "|").  check for the '&', try to background the job if possible,
+ * otherwise just run it and wait on it.
  */
 static
 void
 docommand(char *buf, struct exitinfo *ei)
 {
 	char *args[NARG_MAX + 1];
-	int nargs, i;
+	char **stage[MAXSTAGES];
+	pid_t pids[MAXSTAGES];
+	int nargs, nstages, i;
 	char *s;
 	pid_t pid;
 	int status;
 	int bg=0;
+	int infd, pfd[2];
+	struct spawn_fileaction act[5];
+	int nact;
 	time_t startsecs, endsecs;
 	unsigned long startnsecs, endnsecs;
 
@@ -405,60 +354,124 @@ docommand(char *buf, struct exitinfo *ei)
 
 	if (nargs > 0 && !strcmp(args[nargs-1], "&")) {
 		/* background */
-		if (!can_bg()) {
-			printf("%s: Too many background jobs; wait for "
-			       "some to finish before starting more\n",
-			       args[0]);
-			exitinfo_exit(ei, 1);
-			return;
-		}
 		nargs--;
 		args[nargs] = NULL;
 		bg = 1;
 	}
 
+	/* split the command line into pipeline stages */
+	nstages = 0;
+	stage[nstages++] = &args[0];
+	for (i=0; i<nargs; i++) {
+		if (!strcmp(args[i], "|")) {
+			if (nstages >= MAXSTAGES) {
+				printf("%s: Too many commands in pipeline\n",
+				       args[0]);
+				exitinfo_exit(ei, 1);
+				return;
+			}
+			args[i] = NULL;
+			stage[nstages++] = &args[i+1];
+		}
+	}
+	for (i=0; i<nstages; i++) {
+		if (stage[i][0] == NULL) {
+			printf("sh: Syntax error: empty command in pipeline\n");
+			exitinfo_exit(ei, 1);
+			return;
+		}
+	}
+
 	if (timing) {
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
-			warn("fork");
-			exitinfo_exit(ei, 255);
-			return;
-		case 0:
-			/* child */
-			execvp(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
+	/*
+	 * Start the stages left to right. INFD is the read end of the
+	 * pipe coming from the previous stage (-1 for the first one).
+	 */
+	infd = -1;
+	for (i=0; i<nstages; i++) {
+		if (i < nstages-1 && pipe(pfd) < 0) {
+			warn("pipe");
+			break;
+		}
+
+		/*
+		 * Plumb the stage in through spawn file actions; the
+		 * kernel applies them to the child's copy of our file
+		 * table, so there is no fork and nothing to undo here.
+		 */
+		nact = 0;
+		if (infd >= 0) {
+			act[nact].sfa_op = SPAWN_DUP2;
+			act[nact].sfa_fd = infd;
+			act[nact++].sfa_newfd = STDIN_FILENO;
+			act[nact].sfa_op = SPAWN_CLOSE;
+			act[nact++].sfa_fd = infd;
+		}
+		if (i < nstages-1) {
+			act[nact].sfa_op = SPAWN_CLOSE;
+			act[nact++].sfa_fd = pfd[0];
+			act[nact].sfa_op = SPAWN_DUP2;
+			act[nact].sfa_fd = pfd[1];
+			act[nact++].sfa_newfd = STDOUT_FILENO;
+			act[nact].sfa_op = SPAWN_CLOSE;
+			act[nact++].sfa_fd = pfd[1];
+		}
+
+		pid = spawnp(stage[i][0], stage[i], act, nact);
+		if (pid < 0) {
+			warn("%s", stage[i][0]);
+			if (i < nstages-1) {
+				close(pfd[0]);
+				close(pfd[1]);
+			}
 			break;
+		}
+
+		/* parent: the ends now belong to the children */
+		pids[i] = pid;
+		if (infd >= 0) {
+			close(infd);
+			infd = -1;
+		}
+		if (i < nstages-1) {
+			close(pfd[1]);
+			infd = pfd[0];
+		}
+	}
+	if (infd >= 0) {
+		close(infd);
+	}
+	if (i < nstages) {
+		/* reap the stages that did start; they see EOF/EPIPE */
+		nstages = i;
+		for (i=0; i<nstages; i++) {
+			waitpid(pids[i], &status, 0);
+		}
+		exitinfo_exit(ei, 255);
+		return;
 	}
 
 	/* parent */
 	if (bg) {
-		/* background this command */
-		remember_bg(pid);
-		printf("[%d] %s ... &\n", pid, args[0]);
+		/* background this command; waitpoll reports it */
+		printf("[%d] %s ... &\n", pids[nstages-1], args[0]);
 		exitinfo_exit(ei, 0);
 		return;
 	}
 
-	if (waitpid(pid, &status, 0) < 0) {
-		warn("waitpid");
-		exitinfo_exit(ei, 255);
-	}
-	else {
-		readstatus(status, ei);
+	/* the exit status of a pipeline is that of its last command */
+	exitinfo_exit(ei, 0);
+	for (i=0; i<nstages; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			warn("waitpid");
+			exitinfo_exit(ei, 255);
+		}
+		else if (i == nstages-1) {
+			readstatus(status, ei);
+		}
 	}
 
 	if (timing) {
@@ -538,9 +551,7 @@ interactive(void)
 		getcmd(buf, sizeof(buf));
 		docommand(buf, &ei);
 		printstatus(&ei, 0);
-#ifdef WNOHANG
 		waitpoll();
-#endif
 	}
 }
 
@@ -0,0 +1,75 @@
+#ifndef _PTHREAD_H_
+#define _PTHREAD_H_
+
+#include <sys/cdefs.h>   /* for __DEAD */
+#include <sys/types.h>   /* for size_t */
+
+/*
+ * Minimal POSIX threads.
+ *
+ * Threads share the address space and the file table of the process;
+ * each one runs on its own stack, mapped with mmap() when the thread
+ * is created and unmapped when it is joined. A thread that is never
+ * joined keeps its stack until the process exits.
+ *
+ * Mutexes and condition variables spin on a word of memory with
+ * atomic instructions and only enter the kernel (__futex_wait and
+ * __futex_wake) to sleep or to wake a sleeper, so taking a free mutex
+ * or signalling a condition nobody waits on costs no system call.
+ * Since futexes are keyed by physical address, they also work between
+ * processes when placed in shared memory.
+ *
+ * Note that malloc, stdio and errno are not thread-safe: serialize
+ * their use yourself.
+ */
+
+typedef struct __pthread *pthread_t;
+
+typedef struct {
+	size_t pa_stacksize;
+} pthread_attr_t;
+
+typedef struct {
+	volatile int pm_state;	/* 0 free, 1 held, 2 held with waiters */
+} pthread_mutex_t;
+
+typedef struct {
+	volatile int pc_seq;	/* bumped by every signal */
+	volatile int pc_waiters;
+} pthread_cond_t;
+
+#define PTHREAD_MUTEX_INITIALIZER	{ 0 }
+#define PTHREAD_COND_INITIALIZER	{ 0, 0 }
+
+/* Stack size used when no attributes are given. */
+#define PTHREAD_STACK_DEFAULT	(64*1024)
+
+/* Smallest stack accepted by pthread_attr_setstacksize. */
+#define PTHREAD_STACK_MIN	4096
+
+int pthread_attr_init(pthread_attr_t *attr);
+int pthread_attr_setstacksize(pthread_attr_t *attr, size_t size);
+
+/*
+ * These return 0 on success and an error code (not -1/errno) on
+ * failure, as POSIX specifies.
+ */
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+		   void *(*start)(void *), void *arg);
+__DEAD void pthread_exit(void *retval);
+int pthread_join(pthread_t thread, void **retval);
+
+/* Attributes are not supported; pass NULL. */
+int pthread_mutex_init(pthread_mutex_t *m, const void *attr);
+int pthread_mutex_destroy(pthread_mutex_t *m);
+int pthread_mutex_lock(pthread_mutex_t *m);
+int pthread_mutex_trylock(pthread_mutex_t *m);
+int pthread_mutex_unlock(pthread_mutex_t *m);
+
+int pthread_cond_init(pthread_cond_t *c, const void *attr);
+int pthread_cond_destroy(pthread_cond_t *c);
+int pthread_cond_wait(pthread_cond_t *c, pthread_mutex_t *m);
+int pthread_cond_signal(pthread_cond_t *c);
+int pthread_cond_broadcast(pthread_cond_t *c);
+
+#endif /* _PTHREAD_H_ */
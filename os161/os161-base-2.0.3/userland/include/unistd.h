@@ -38,10 +38,14 @@
  * kernel includes. This way user-level code doesn't need to know
  * about the kern/ headers.
  */
+#include <kern/dirent.h>
 #include <kern/fcntl.h>
 #include <kern/ioctl.h>
+#include <kern/mman.h>
 #include <kern/reboot.h>
 #include <kern/seek.h>
+#include <kern/spawn.h>
+#include <kern/sysstat.h>
 #include <kern/time.h>
 #include <kern/unistd.h>
 #include <kern/wait.h>
@@ -68,6 +72,8 @@
  *     remove:   stdio.h
  *     rename:   stdio.h
  *     time:     time.h
+ *     mmap:     sys/mman.h
+ *     munmap:   sys/mman.h
  *
  * Also note that the prototypes for open() and mkdir() contain, for
  * compatibility with Unix, an extra argument that is not meaningful
@@ -112,6 +118,7 @@
 __DEAD void _exit(int code);
 int execv(const char *prog, char *const *args);
 pid_t fork(void);
+pid_t vfork(void);
 pid_t waitpid(pid_t pid, int *returncode, int flags);
 /*
  * Open actually takes either two or three args: the optional third
@@ -142,12 +149,25 @@ int chdir(const char *path);
 /* Optional. */
 void *sbrk(__intptr_t change);
 ssize_t getdirentry(int filehandle, char *buf, size_t buflen);
+ssize_t getdents(int filehandle, void *buf, size_t buflen);
 int symlink(const char *target, const char *linkname);
 ssize_t readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
+void *mmap(void *addr, size_t len, int prot, int flags, int filehandle,
+	   off_t offset);
+int munmap(void *addr, size_t len);
+pid_t spawn(const char *prog, char *const *args,
+	    const struct spawn_fileaction *actions, int nactions);
 int __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
 ssize_t __getcwd(char *buf, size_t buflen);
+int __thread_create(void (*entry)(void *), void *arg, void *stacktop);
+__DEAD void __thread_exit(void *retval);
+int __thread_join(int tid, void **retval);
+int __futex_wait(volatile int *addr, int val);
+int __futex_wake(volatile int *addr, int n);
+int sysstat(struct sysstat *buf, unsigned ncalls);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -156,6 +176,8 @@ ssize_t __getcwd(char *buf, size_t buflen);
  */
 
 int execvp(const char *prog, char *const *args); /* calls execv */
+pid_t spawnp(const char *prog, char *const *args,	/* calls spawn */
+	     const struct spawn_fileaction *actions, int nactions);
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
 
@@ -74,18 +74,15 @@ system(const char *cmd)
 
 	argv[nargs] = NULL;
 
-	pid = fork();
-	switch (pid) {
-	    case -1:
-		return -1;
-	    case 0:
-		/* child */
-		execv(argv[0], argv);
-		/* exec only returns if it fails */
-		_exit(255);
-	    default:
-		/* parent */
-		waitpid(pid, &status, 0);
-		return status;
+	pid = spawn(argv[0], argv, NULL, 0);
+	if (pid < 0) {
+		if (errno == ENPROC || errno == ENOMEM) {
+			/* could not make a process at all */
+			return -1;
+		}
+		/* report a program that would not load as fork+exec did */
+		return _MKWAIT_EXIT(255);
 	}
+	waitpid(pid, &status, 0);
+	return status;
 }
@@ -0,0 +1,111 @@
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+/*
+ * Thread control block. It lives at the top of the thread's own stack
+ * mapping, so creating a thread needs no malloc (which is not
+ * thread-safe) and joining it frees everything with one munmap.
+ */
+struct __pthread {
+	int pt_tid;
+	void *pt_stack;			/* base of the mapping */
+	size_t pt_stacksize;		/* size of the mapping */
+	void *(*pt_start)(void *);
+	void *pt_arg;
+};
+
+/* Argument save area the MIPS calling convention wants above sp. */
+#define ARGSAVE 16
+
+int
+pthread_attr_init(pthread_attr_t *attr)
+{
+	attr->pa_stacksize = PTHREAD_STACK_DEFAULT;
+	return 0;
+}
+
+int
+pthread_attr_setstacksize(pthread_attr_t *attr, size_t size)
+{
+	if (size < PTHREAD_STACK_MIN) {
+		return EINVAL;
+	}
+	attr->pa_stacksize = size;
+	return 0;
+}
+
+/*
+ * First code run by every new thread.
+ */
+static
+void
+pthread_start(void *data)
+{
+	struct __pthread *t = data;
+
+	__thread_exit(t->pt_start(t->pt_arg));
+}
+
+int
+pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+	       void *(*start)(void *), void *arg)
+{
+	struct __pthread *t;
+	size_t size;
+	char *stack;
+	uintptr_t top;
+	int tid, err;
+
+	size = attr != NULL ? attr->pa_stacksize : PTHREAD_STACK_DEFAULT;
+	stack = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON,
+		     -1, 0);
+	if (stack == MAP_FAILED) {
+		return errno;
+	}
+
+	t = (struct __pthread *)(stack + size) - 1;
+	t->pt_stack = stack;
+	t->pt_stacksize = size;
+	t->pt_start = start;
+	t->pt_arg = arg;
+
+	top = ((uintptr_t)t - ARGSAVE) & ~(uintptr_t)7;
+
+	/* t->pt_tid is only read by pthread_join, so setting it late is ok */
+	tid = __thread_create(pthread_start, t, (void *)top);
+	if (tid < 0) {
+		err = errno;
+		munmap(stack, size);
+		return err;
+	}
+	t->pt_tid = tid;
+	*thread = t;
+	return 0;
+}
+
+void
+pthread_exit(void *retval)
+{
+	__thread_exit(retval);
+}
+
+int
+pthread_join(pthread_t thread, void **retval)
+{
+	void *stack;
+	size_t size;
+
+	if (__thread_join(thread->pt_tid, retval) < 0) {
+		return errno;
+	}
+
+	/* the block goes away with the stack */
+	stack = thread->pt_stack;
+	size = thread->pt_stacksize;
+	munmap(stack, size);
+	return 0;
+}
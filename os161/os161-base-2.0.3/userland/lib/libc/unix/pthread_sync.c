@@ -0,0 +1,204 @@
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+/*
+ * Mutexes and condition variables on top of __futex_wait/__futex_wake.
+ *
+ * The mutex is the classic three-state futex lock: 0 is free, 1 is
+ * held, 2 is held and somebody may be sleeping on it. Only a thread
+ * that finds the lock taken makes a system call, and only an unlock
+ * that finds state 2 wakes anyone up.
+ */
+
+/* Large enough to wake every sleeper. */
+#define WAKE_ALL 0x7fffffff
+
+/*
+ * Atomic operations, using LL/SC like the kernel spinlocks. Each
+ * returns the old value and ends with a SYNC so that it also works as
+ * a memory barrier.
+ */
+
+static
+int
+atomic_cas(volatile int *p, int old, int new)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		"1: ll %0, 0(%2);"	/*   prev = *p */
+		"bne %0, %3, 2f;"	/*   give up if prev != old */
+		"move %1, %4;"
+		"sc %1, 0(%2);"		/*   *p = new; tmp = success? */
+		"beqz %1, 1b;"		/*   retry if the store failed */
+		"2: sync;"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (old), "r" (new)
+		: "memory");
+	return prev;
+}
+
+static
+int
+atomic_swap(volatile int *p, int new)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		"1: ll %0, 0(%2);"
+		"move %1, %3;"
+		"sc %1, 0(%2);"
+		"beqz %1, 1b;"
+		"sync;"
+		".set pop"
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (new)
+		: "memory");
+	return prev;
+}
+
+static
+int
+atomic_add(volatile int *p, int delta)
+{
+	int prev, tmp;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		"1: ll %0, 0(%2);"
+		"addu %1, %0, %3;"
+		"sc %1, 0(%2);"
+		"beqz %1, 1b;"
+		"sync;"
+		".set pop"
+		: "=&r" (prev), "=&r" (tmp)
+		: "r" (p), "r" (delta)
+		: "memory");
+	return prev;
+}
+
+////////////////////////////////////////////////////////////
+
+int
+pthread_mutex_init(pthread_mutex_t *m, const void *attr)
+{
+	if (attr != NULL) {
+		return EINVAL;
+	}
+	m->pm_state = 0;
+	return 0;
+}
+
+int
+pthread_mutex_destroy(pthread_mutex_t *m)
+{
+	return m->pm_state != 0 ? EBUSY : 0;
+}
+
+/*
+ * Slow path: mark the lock contended and sleep until it is handed
+ * over free. The lock is always taken in state 2 here, because we
+ * cannot know whether others are still sleeping.
+ */
+static
+void
+mutex_lock_contended(pthread_mutex_t *m)
+{
+	while (atomic_swap(&m->pm_state, 2) != 0) {
+		__futex_wait(&m->pm_state, 2);
+	}
+}
+
+int
+pthread_mutex_lock(pthread_mutex_t *m)
+{
+	if (atomic_cas(&m->pm_state, 0, 1) != 0) {
+		mutex_lock_contended(m);
+	}
+	return 0;
+}
+
+int
+pthread_mutex_trylock(pthread_mutex_t *m)
+{
+	return atomic_cas(&m->pm_state, 0, 1) == 0 ? 0 : EBUSY;
+}
+
+int
+pthread_mutex_unlock(pthread_mutex_t *m)
+{
+	if (atomic_swap(&m->pm_state, 0) == 2) {
+		__futex_wake(&m->pm_state, 1);
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * A condition variable is a sequence number: waiters sleep as long as
+ * it keeps the value they saw before releasing the mutex, and every
+ * signal bumps it. pc_waiters lets signal skip the system call when
+ * nobody is waiting.
+ */
+
+int
+pthread_cond_init(pthread_cond_t *c, const void *attr)
+{
+	if (attr != NULL) {
+		return EINVAL;
+	}
+	c->pc_seq = 0;
+	c->pc_waiters = 0;
+	return 0;
+}
+
+int
+pthread_cond_destroy(pthread_cond_t *c)
+{
+	return c->pc_waiters != 0 ? EBUSY : 0;
+}
+
+int
+pthread_cond_wait(pthread_cond_t *c, pthread_mutex_t *m)
+{
+	int seq;
+
+	atomic_add(&c->pc_waiters, 1);
+	seq = c->pc_seq;
+	pthread_mutex_unlock(m);
+
+	/* EAGAIN just means we were signalled before getting to sleep */
+	__futex_wait(&c->pc_seq, seq);
+
+	atomic_add(&c->pc_waiters, -1);
+	mutex_lock_contended(m);
+	return 0;
+}
+
+int
+pthread_cond_signal(pthread_cond_t *c)
+{
+	if (c->pc_waiters > 0) {
+		atomic_add(&c->pc_seq, 1);
+		__futex_wake(&c->pc_seq, 1);
+	}
+	return 0;
+}
+
+int
+pthread_cond_broadcast(pthread_cond_t *c)
+{
+	if (c->pc_waiters > 0) {
+		atomic_add(&c->pc_seq, 1);
+		__futex_wake(&c->pc_seq, WAKE_ALL);
+	}
+	return 0;
+}
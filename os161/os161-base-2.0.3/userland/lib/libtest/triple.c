@@ -42,14 +42,19 @@ static
 pid_t
 spawnv(const char *prog, char **argv)
 {
-	pid_t pid = fork();
+	pid_t pid = vfork();
 	switch (pid) {
 	    case -1:
-		err(1, "fork");
+		err(1, "vfork");
 	    case 0:
-		/* child */
+		/*
+		 * child: we are running on our parent's memory until
+		 * execv succeeds, so leave with _exit() rather than
+		 * err(), which would run its atexit handlers.
+		 */
 		execv(prog, argv);
-		err(1, "%s: execv", prog);
+		warn("%s: execv", prog);
+		_exit(1);
 	    default:
 		/* parent */
 		break;
@@ -0,0 +1,188 @@
+/*
+ * futextest - test pthread mutexes and condition variables under
+ * contention.
+ *
+ * First several threads bump a shared counter in a mutex, with a
+ * read-modify-write stretched out so that a broken mutex loses
+ * updates; trylock is mixed in. Then producers and consumers pass
+ * numbered items through a small ring buffer guarded by a mutex and
+ * two condition variables, and the consumers check that every item
+ * arrives exactly once.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <err.h>
+
+#define NTHREADS  6
+#define NITER     5000
+
+#define NPROD     3
+#define NCONS     3
+#define NSLOTS    4
+#define NITEMS    3000		/* per producer */
+
+static pthread_mutex_t countlock = PTHREAD_MUTEX_INITIALIZER;
+static volatile unsigned counter;
+
+static pthread_mutex_t ringlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notfull = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t notempty = PTHREAD_COND_INITIALIZER;
+static unsigned ring[NSLOTS];
+static unsigned ringhead, ringcount;
+static unsigned producersleft = NPROD;
+static unsigned char seen[NPROD * NITEMS];	/* under ringlock */
+
+static
+void
+check(int result, const char *what)
+{
+	if (result) {
+		errx(1, "%s: %s", what, strerror(result));
+	}
+}
+
+static
+void *
+bump(void *arg)
+{
+	unsigned i, v;
+	volatile unsigned j;
+
+	(void)arg;
+	for (i=0; i<NITER; i++) {
+		if (i % 8 == 0) {
+			while (pthread_mutex_trylock(&countlock) != 0) {
+				/* spin */
+			}
+		}
+		else {
+			check(pthread_mutex_lock(&countlock), "lock");
+		}
+		v = counter;
+		for (j=0; j<20; j++) {
+			/* widen the window */
+		}
+		counter = v + 1;
+		check(pthread_mutex_unlock(&countlock), "unlock");
+	}
+	return NULL;
+}
+
+static
+void
+mutextest(void)
+{
+	pthread_t t[NTHREADS];
+	int i;
+
+	for (i=0; i<NTHREADS; i++) {
+		check(pthread_create(&t[i], NULL, bump, NULL), "pthread_create");
+	}
+	for (i=0; i<NTHREADS; i++) {
+		check(pthread_join(t[i], NULL), "pthread_join");
+	}
+	if (counter != NTHREADS * NITER) {
+		errx(1, "mutex: counter is %u, expected %u", counter,
+		     NTHREADS * NITER);
+	}
+	printf("Mutex ok.\n");
+}
+
+static
+void *
+produce(void *arg)
+{
+	unsigned base = (unsigned)(uintptr_t)arg * NITEMS;
+	unsigned i;
+
+	for (i=0; i<NITEMS; i++) {
+		check(pthread_mutex_lock(&ringlock), "lock");
+		while (ringcount == NSLOTS) {
+			check(pthread_cond_wait(&notfull, &ringlock),
+			      "cond_wait");
+		}
+		ring[(ringhead + ringcount) % NSLOTS] = base + i;
+		ringcount++;
+		check(pthread_cond_signal(&notempty), "cond_signal");
+		check(pthread_mutex_unlock(&ringlock), "unlock");
+	}
+
+	check(pthread_mutex_lock(&ringlock), "lock");
+	producersleft--;
+	/* consumers waiting on an empty ring must see the end */
+	check(pthread_cond_broadcast(&notempty), "cond_broadcast");
+	check(pthread_mutex_unlock(&ringlock), "unlock");
+	return NULL;
+}
+
+static
+void *
+consume(void *arg)
+{
+	unsigned item;
+
+	(void)arg;
+	check(pthread_mutex_lock(&ringlock), "lock");
+	while (1) {
+		while (ringcount == 0 && producersleft > 0) {
+			check(pthread_cond_wait(&notempty, &ringlock),
+			      "cond_wait");
+		}
+		if (ringcount == 0) {
+			break;
+		}
+		item = ring[ringhead];
+		ringhead = (ringhead + 1) % NSLOTS;
+		ringcount--;
+		if (item >= NPROD * NITEMS || seen[item]) {
+			errx(1, "cond: bad or repeated item %u", item);
+		}
+		seen[item] = 1;
+		check(pthread_cond_signal(&notfull), "cond_signal");
+	}
+	check(pthread_mutex_unlock(&ringlock), "unlock");
+	return NULL;
+}
+
+static
+void
+condtest(void)
+{
+	pthread_t prod[NPROD], cons[NCONS];
+	uintptr_t i;
+
+	for (i=0; i<NCONS; i++) {
+		check(pthread_create(&cons[i], NULL, consume, NULL),
+		      "pthread_create");
+	}
+	for (i=0; i<NPROD; i++) {
+		check(pthread_create(&prod[i], NULL, produce, (void *)i),
+		      "pthread_create");
+	}
+	for (i=0; i<NPROD; i++) {
+		check(pthread_join(prod[i], NULL), "pthread_join");
+	}
+	for (i=0; i<NCONS; i++) {
+		check(pthread_join(cons[i], NULL), "pthread_join");
+	}
+	for (i=0; i<NPROD * NITEMS; i++) {
+		if (!seen[i]) {
+			errx(1, "cond: item %lu lost", (unsigned long)i);
+		}
+	}
+	printf("Condition variables ok.\n");
+}
+
+int
+main(void)
+{
+	mutextest();
+	condtest();
+	printf("futextest: passed\n");
+	return 0;
+}
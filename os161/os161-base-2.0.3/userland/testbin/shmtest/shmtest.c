@@ -0,0 +1,225 @@
+/*
+ * shmtest - test shared memory.
+ *
+ * First checks that a MAP_SHARED|MAP_ANON mapping is shared with a
+ * forked child. Then runs a producer and a consumer that pass a few
+ * megabytes through a named segment ("shm:") without ever copying
+ * them through the kernel; semfs semaphores ("sem:") count the full
+ * and empty slots.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define PAGE      4096
+#define NSLOTS    8
+#define SLOTWORDS (PAGE / sizeof(unsigned))
+#define TOTAL     (4*1024*1024)		/* bytes to pass */
+#define NITEMS    (TOTAL / PAGE)
+
+#define SEGNAME   "shm:shmtest"
+#define EMPTYNAME "sem:shmtest.empty"
+#define FULLNAME  "sem:shmtest.full"
+
+static
+int
+dowait(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFSIGNALED(status)) {
+		warnx("pid %d: signal %d", pid, WTERMSIG(status));
+		return 1;
+	}
+	return WEXITSTATUS(status);
+}
+
+static
+int
+semopen(const char *name, unsigned count)
+{
+	int fd;
+	char c = 0;
+
+	fd = open(name, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", name);
+	}
+	while (count-- > 0) {
+		if (write(fd, &c, 1) != 1) {
+			err(1, "%s: write", name);
+		}
+	}
+	return fd;
+}
+
+static
+void
+P(int fd)
+{
+	char c;
+
+	if (read(fd, &c, 1) != 1) {
+		err(1, "P");
+	}
+}
+
+static
+void
+V(int fd)
+{
+	char c = 0;
+
+	if (write(fd, &c, 1) != 1) {
+		err(1, "V");
+	}
+}
+
+static
+unsigned *
+segmap(int fd)
+{
+	void *p;
+
+	p = mmap(NULL, NSLOTS*PAGE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		err(1, "%s: mmap", SEGNAME);
+	}
+	return p;
+}
+
+static
+void
+test_anon(void)
+{
+	volatile unsigned *p;
+	pid_t pid;
+
+	printf("shmtest: anonymous shared memory across fork...\n");
+	p = mmap(NULL, PAGE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANON, -1, 0);
+	if (p == MAP_FAILED) {
+		err(1, "mmap");
+	}
+	p[0] = 1;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		p[0] = 0xbeef;
+		_exit(0);
+	}
+	if (dowait(pid) != 0 || p[0] != 0xbeef) {
+		errx(1, "FAILED: child's write not seen (0x%x)", p[0]);
+	}
+	if (munmap((void *)p, PAGE) < 0) {
+		err(1, "munmap");
+	}
+	printf("shmtest: passed\n");
+}
+
+static
+void
+consumer(void)
+{
+	int segfd, emptyfd, fullfd;
+	unsigned *slots, *s;
+	unsigned i, j;
+
+	/* find everything again by name */
+	segfd = open(SEGNAME, O_RDWR);
+	emptyfd = open(EMPTYNAME, O_RDWR);
+	fullfd = open(FULLNAME, O_RDWR);
+	if (segfd < 0 || emptyfd < 0 || fullfd < 0) {
+		err(1, "consumer: open");
+	}
+	slots = segmap(segfd);
+	close(segfd);
+
+	for (i=0; i<NITEMS; i++) {
+		P(fullfd);
+		s = slots + (i % NSLOTS) * SLOTWORDS;
+		for (j=0; j<SLOTWORDS; j++) {
+			if (s[j] != i * SLOTWORDS + j) {
+				errx(1, "FAILED: item %u word %u is %u",
+				     i, j, s[j]);
+			}
+		}
+		V(emptyfd);
+	}
+	_exit(0);
+}
+
+static
+void
+test_named(void)
+{
+	int segfd, emptyfd, fullfd;
+	unsigned *slots, *s;
+	unsigned i, j;
+	pid_t pid;
+
+	printf("shmtest: passing %u KB through %s...\n", TOTAL/1024, SEGNAME);
+
+	segfd = open(SEGNAME, O_RDWR|O_CREAT, 0664);
+	if (segfd < 0) {
+		err(1, "%s", SEGNAME);
+	}
+	if (ftruncate(segfd, NSLOTS*PAGE) < 0) {
+		err(1, "%s: ftruncate", SEGNAME);
+	}
+	emptyfd = semopen(EMPTYNAME, NSLOTS);
+	fullfd = semopen(FULLNAME, 0);
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(segfd);
+		close(emptyfd);
+		close(fullfd);
+		consumer();
+	}
+
+	slots = segmap(segfd);
+	close(segfd);
+	for (i=0; i<NITEMS; i++) {
+		P(emptyfd);
+		s = slots + (i % NSLOTS) * SLOTWORDS;
+		for (j=0; j<SLOTWORDS; j++) {
+			s[j] = i * SLOTWORDS + j;
+		}
+		V(fullfd);
+	}
+
+	if (dowait(pid) != 0) {
+		errx(1, "FAILED: consumer failed");
+	}
+	munmap(slots, NSLOTS*PAGE);
+	close(emptyfd);
+	close(fullfd);
+	remove(SEGNAME);
+	remove(EMPTYNAME);
+	remove(FULLNAME);
+	printf("shmtest: passed\n");
+}
+
+int
+main(void)
+{
+	test_anon();
+	test_named();
+	return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * sysstat - print the kernel's system call statistics.
+ *
+ * Usage: sysstat [prog [args...]]
+ *
+ * With no arguments, prints the counts since boot (or since the last
+ * "sysstat reset" in the kernel menu). Otherwise runs PROG and prints
+ * only what changed while it ran, which includes the calls made by
+ * any other process running at the same time.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <kern/syscall.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <kern/syscallnames.h>
+
+static struct sysstat before[SYSSTAT_NCALLS], after[SYSSTAT_NCALLS];
+
+static
+void
+getstats(struct sysstat *buf)
+{
+	if (sysstat(buf, SYSSTAT_NCALLS) != SYSSTAT_NCALLS) {
+		errx(1, "sysstat: short read");
+	}
+}
+
+/*
+ * Print AFTER minus BEFORE, one line per call made plus one for its
+ * latency histogram; each bucket is labelled with its lower bound.
+ * As in the kernel's dump, the mean leaves out the calls that did not
+ * return (_exit, __thread_exit, execv when it works).
+ */
+static
+void
+print(void)
+{
+	struct sysstat d;
+	unsigned i, b, returned;
+
+	printf("%-16s %8s %7s %9s\n", "syscall", "calls", "errors",
+	       "mean (us)");
+	for (i=0; i<SYSSTAT_NCALLS; i++) {
+		d.ss_calls = after[i].ss_calls - before[i].ss_calls;
+		if (d.ss_calls == 0) {
+			continue;
+		}
+		d.ss_errors = after[i].ss_errors - before[i].ss_errors;
+		d.ss_nsecs = after[i].ss_nsecs - before[i].ss_nsecs;
+		returned = 0;
+		for (b=0; b<SYSSTAT_NBUCKETS; b++) {
+			d.ss_hist[b] = after[i].ss_hist[b] - before[i].ss_hist[b];
+			returned += d.ss_hist[b];
+		}
+
+		if (syscall_names[i] != NULL) {
+			printf("%-16s", syscall_names[i]);
+		}
+		else {
+			printf("#%-15u", i);
+		}
+		printf(" %8u %7u %9llu\n    ", d.ss_calls, d.ss_errors,
+		       returned == 0 ? 0ULL :
+		       (unsigned long long)(d.ss_nsecs / returned / 1000));
+		for (b=0; b<SYSSTAT_NBUCKETS; b++) {
+			if (d.ss_hist[b] == 0) {
+				continue;
+			}
+			if (b == 0) {
+				printf(" <1us:%u", d.ss_hist[b]);
+			}
+			else {
+				printf(" %uus:%u", 1U << (b - 1), d.ss_hist[b]);
+			}
+		}
+		printf("\n");
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	pid_t pid;
+	int status;
+
+	if (argc < 2) {
+		/* before stays all zeros */
+		getstats(after);
+		print();
+		return 0;
+	}
+
+	getstats(before);
+	pid = spawnp(argv[1], argv + 1, NULL, 0);
+	if (pid < 0) {
+		err(1, "%s", argv[1]);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	getstats(after);
+	print();
+	return 0;
+}
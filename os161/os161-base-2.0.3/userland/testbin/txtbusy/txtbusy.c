@@ -0,0 +1,160 @@
+/*
+ * txtbusy - test the interaction of shared program text with files
+ * open for writing.
+ *
+ * A running program cannot be opened for writing (ETXTBSY). A program
+ * that is already open for writing can still be run, but its text is
+ * loaded privately instead of shared, so opening it for writing again
+ * while it runs must work.
+ *
+ * Run it as /testbin/txtbusy; it makes a copy of itself in the current
+ * directory and removes it at the end.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define PROGNAME  "/testbin/txtbusy"
+#define COPYNAME  "txtbusy.tmp"
+
+/*
+ * Copy ourselves to COPYNAME and return the file, still open for
+ * writing.
+ */
+static
+int
+makecopy(void)
+{
+	char buf[4096];
+	int in, out;
+	ssize_t len;
+
+	in = open(PROGNAME, O_RDONLY);
+	if (in < 0) {
+		err(1, "%s", PROGNAME);
+	}
+	out = open(COPYNAME, O_WRONLY|O_CREAT|O_TRUNC, 0775);
+	if (out < 0) {
+		err(1, "%s", COPYNAME);
+	}
+	while ((len = read(in, buf, sizeof(buf))) > 0) {
+		if (write(out, buf, len) != len) {
+			err(1, "%s: write", COPYNAME);
+		}
+	}
+	if (len < 0) {
+		err(1, "%s: read", PROGNAME);
+	}
+	close(in);
+	return out;
+}
+
+/*
+ * Running ourselves: the file cannot be written.
+ */
+static
+void
+selftest(void)
+{
+	int fd;
+
+	fd = open(PROGNAME, O_WRONLY);
+	if (fd >= 0) {
+		errx(1, "%s: opened for writing while running", PROGNAME);
+	}
+	if (errno != ETXTBSY) {
+		err(1, "%s: expected ETXTBSY", PROGNAME);
+	}
+	printf("Running program not writable: ok.\n");
+}
+
+/*
+ * Run the copy while it is open for writing, and open it for writing
+ * again while it runs.
+ */
+static
+void
+writertest(void)
+{
+	char fdstr[2][16], c;
+	char *args[5];
+	int out, fd, p[2], ready[2], status;
+	pid_t pid;
+
+	out = makecopy();
+	if (pipe(p) < 0 || pipe(ready) < 0) {
+		err(1, "pipe");
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(p[1]);
+		close(ready[0]);
+		snprintf(fdstr[0], sizeof(fdstr[0]), "%d", p[0]);
+		snprintf(fdstr[1], sizeof(fdstr[1]), "%d", ready[1]);
+		args[0] = (char *)COPYNAME;
+		args[1] = (char *)"child";
+		args[2] = fdstr[0];
+		args[3] = fdstr[1];
+		args[4] = NULL;
+		execv(COPYNAME, args);
+		err(1, "%s: exec while open for writing", COPYNAME);
+	}
+	close(p[0]);
+	close(ready[1]);
+
+	/* the child is running the copy until we close the pipe */
+	if (read(ready[0], &c, 1) != 1) {
+		errx(1, "%s: child did not start", COPYNAME);
+	}
+	close(ready[0]);
+	fd = open(COPYNAME, O_WRONLY);
+	if (fd < 0) {
+		err(1, "%s: open for writing while running privately",
+		    COPYNAME);
+	}
+	close(fd);
+
+	close(p[1]);
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "%s: child failed", COPYNAME);
+	}
+	close(out);
+	remove(COPYNAME);
+	printf("Program open for writing runs privately: ok.\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	char c;
+
+	if (argc == 4 && !strcmp(argv[1], "child")) {
+		/* say we are running, then wait for the pipe to close */
+		c = 0;
+		write(atoi(argv[3]), &c, 1);
+		close(atoi(argv[3]));
+		while (read(atoi(argv[2]), &c, 1) > 0) {
+			/* nothing */
+		}
+		return 0;
+	}
+
+	selftest();
+	writertest();
+	printf("txtbusy: passed\n");
+	return 0;
+}
@@ -28,82 +28,200 @@
  */
 
 /*
- * Test multiple user level threads inside a process. The program
- * forks 3 threads off 2 to functions, each of which displays a string
- * every once in a while.
+ * Test multiple user level threads inside a process, through the
+ * pthread library.
  *
- * This won't do much of anything unless you implement user-level
- * threads.
- *
- * It also makes various assumptions about the thread API. In
- * particular, it believes (1) that you create a thread by calling
- * "threadfork()" and passing the address for execution of the new
- * thread to begin at, (2) that if the parent thread exits any child
- * threads will keep running, and (3) child threads will exit if they
- * return from the function they started in. If any or all of these
- * assumptions are not met by your user-level threads, you will need
- * to patch this test accordingly.
- *
- * This is also a rather basic test and you'll probably want to write
- * some more of your own.
+ * First forks 3 threads off to 2 functions, each of which displays a
+ * string every once in a while, and joins them. Then checks that
+ * pthread_join hands back the value a thread returned or passed to
+ * pthread_exit. Last, a child process starts threads that never stop
+ * and calls exit() from its main thread, which must end the whole
+ * process with that status.
  */
 
 
-#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <err.h>
 
 #define NTHREADS  3
-#define MAX       1<<25
+#define MAX       (1<<20)
+#define NJOIN     8
+#define NSPIN     4
+#define EXITCODE  7
 
 /* counter for the loop in the threads:
    This variable is shared and incremented by each
    thread during his computation */
 volatile int count = 0;
 
-/* the 2 threads : */
-void ThreadRunner(void);
-void BladeRunner(void);
-
-int
-main(int argc, char *argv[])
-{
-    int i;
-
-    (void)argc;
-    (void)argv;
-
-    for (i=0; i<NTHREADS; i++) {
-	if (i)
-	    threadfork(ThreadRunner);
-        else
-	    threadfork(BladeRunner);
-    }
+/* bumped by the threads that never stop */
+volatile unsigned spins = 0;
 
-    printf("Parent has left.\n");
-    return 0;
-}
+/* the 2 threads : */
+static void *ThreadRunner(void *);
+static void *BladeRunner(void *);
 
 /* multiple threads will simply print out the global variable.
    Even though there is no synchronization, we should get some
    random results.
 */
 
-void
-BladeRunner()
+static
+void *
+BladeRunner(void *arg)
 {
+    (void)arg;
     while (count < MAX) {
 	if (count % 500 == 0)
 	    printf("Blade ");
 	count++;
     }
+    return NULL;
 }
 
-void
-ThreadRunner()
+static
+void *
+ThreadRunner(void *arg)
 {
+    (void)arg;
     while (count < MAX) {
 	if (count % 513 == 0)
 	    printf(" Runner\n");
 	count++;
     }
+    return NULL;
+}
+
+static
+void
+runners(void)
+{
+    pthread_t t[NTHREADS];
+    int i, result;
+
+    for (i=0; i<NTHREADS; i++) {
+	result = pthread_create(&t[i], NULL,
+				i ? ThreadRunner : BladeRunner, NULL);
+	if (result) {
+	    errx(1, "pthread_create: %s", strerror(result));
+	}
+    }
+    for (i=0; i<NTHREADS; i++) {
+	result = pthread_join(t[i], NULL);
+	if (result) {
+	    errx(1, "pthread_join: %s", strerror(result));
+	}
+    }
+    printf("\nRunners done.\n");
+}
+
+/* odd ones leave through pthread_exit, even ones by returning */
+static
+void *
+square(void *arg)
+{
+    uintptr_t n = (uintptr_t)arg;
+
+    if (n % 2) {
+	pthread_exit((void *)(n * n));
+    }
+    return (void *)(n * n);
+}
+
+static
+void
+joins(void)
+{
+    pthread_t t[NJOIN];
+    void *ret;
+    uintptr_t i;
+    int result;
+
+    for (i=0; i<NJOIN; i++) {
+	result = pthread_create(&t[i], NULL, square, (void *)i);
+	if (result) {
+	    errx(1, "pthread_create: %s", strerror(result));
+	}
+    }
+    /* join in reverse, so some are joined before they finish */
+    for (i=NJOIN; i-- > 0; ) {
+	result = pthread_join(t[i], &ret);
+	if (result) {
+	    errx(1, "pthread_join: %s", strerror(result));
+	}
+	if ((uintptr_t)ret != i * i) {
+	    errx(1, "thread %lu returned %lu, not %lu",
+		 (unsigned long)i, (unsigned long)(uintptr_t)ret,
+		 (unsigned long)(i * i));
+	}
+    }
+    printf("Join values ok.\n");
+}
+
+static
+void *
+spin(void *arg)
+{
+    (void)arg;
+    while (1) {
+	spins++;
+    }
+    /* not reached */
+    return NULL;
+}
+
+static
+void
+exits(void)
+{
+    pthread_t t;
+    pid_t pid;
+    int i, result, status;
+
+    pid = fork();
+    if (pid < 0) {
+	err(1, "fork");
+    }
+    if (pid == 0) {
+	for (i=0; i<NSPIN; i++) {
+	    result = pthread_create(&t, NULL, spin, NULL);
+	    if (result) {
+		errx(1, "pthread_create: %s", strerror(result));
+	    }
+	}
+	/* make sure they got going */
+	while (spins < 100000) {
+	    /* nothing */
+	}
+	exit(EXITCODE);
+    }
+
+    if (waitpid(pid, &status, 0) < 0) {
+	err(1, "waitpid");
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXITCODE) {
+	errx(1, "child with running threads: status %d, expected exit %d",
+	     status, EXITCODE);
+    }
+    printf("Exit with running threads ok.\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    runners();
+    joins();
+    exits();
+    printf("userthreads: passed\n");
+    return 0;
 }